@@ -0,0 +1,355 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <numbers>
+#include <optional>
+#include <sndfile.h>
+#include <thread>
+
+#include "half_band_fir.h"
+#include "lstm_model.h"
+
+/**
+ * Headless batch processor: runs the (pruned) LSTM model over a set of audio files,
+ * using the same signal chain as the plugin (sum to mono, 2x oversampling at
+ * sample rates up to 48 kHz, LSTM, DC blocker). Since this doesn't depend on JUCE,
+ * the resampling uses the plugin's linear-phase half-band FIR mode, and the output
+ * is compensated for its latency.
+ */
+
+struct Options
+{
+    int hidden_size = LSTM_Model::max_hidden_size;
+    Ranking ranking = Ranking::Mean_Activations;
+    Activation activation = Activation::Exact;
+    bool oversampling = true;
+    int num_threads = std::max ((int) std::thread::hardware_concurrency(), 1);
+    int block_size = 4096;
+    std::filesystem::path weights_path { std::string { MODELS_DIR } + "/lstm.json" };
+    std::filesystem::path output_dir { "processed" };
+    std::vector<std::filesystem::path> input_files {};
+};
+
+static void print_usage()
+{
+    std::cout << "Usage: neural_pruning_cli [options] <input files...>\n"
+              << "Options:\n"
+              << "  --hidden-size <N>     Pruned hidden size (" << LSTM_Model::min_hidden_size << "-" << LSTM_Model::max_hidden_size << ")\n"
+              << "  --ranking <ranking>   min_weights, mean_activations, or minimization\n"
+              << "  --activation <mode>   exact, rational, polynomial, or table\n"
+              << "  --no-oversampling     Run the network at the file's sample rate\n"
+              << "  --threads <N>         Number of files to process at once\n"
+              << "  --block-size <N>      Number of samples to read at a time\n"
+              << "  --weights <path>      Model weights (.json or .bin)\n"
+              << "  --output-dir <path>   Where to write the processed files (default: processed)\n";
+}
+
+static std::optional<Options> parse_args (int argc, char* argv[])
+{
+    Options options {};
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg { argv[i] };
+        const auto next_arg = [&]() -> std::string_view
+        { return i + 1 < argc ? argv[++i] : ""; };
+
+        if (arg == "--hidden-size")
+            options.hidden_size = std::atoi (next_arg().data());
+        else if (arg == "--ranking")
+        {
+            const auto ranking = next_arg();
+            if (ranking == "min_weights")
+                options.ranking = Ranking::Min_Weights;
+            else if (ranking == "mean_activations")
+                options.ranking = Ranking::Mean_Activations;
+            else if (ranking == "minimization")
+                options.ranking = Ranking::Minimization;
+            else
+                return std::nullopt;
+        }
+        else if (arg == "--activation")
+        {
+            const auto activation = next_arg();
+            if (activation == "exact")
+                options.activation = Activation::Exact;
+            else if (activation == "rational")
+                options.activation = Activation::Rational;
+            else if (activation == "polynomial")
+                options.activation = Activation::Polynomial;
+            else if (activation == "table")
+                options.activation = Activation::Table;
+            else
+                return std::nullopt;
+        }
+        else if (arg == "--no-oversampling")
+            options.oversampling = false;
+        else if (arg == "--threads")
+            options.num_threads = std::max (std::atoi (next_arg().data()), 1);
+        else if (arg == "--block-size")
+            options.block_size = std::max (std::atoi (next_arg().data()), 1);
+        else if (arg == "--weights")
+            options.weights_path = next_arg();
+        else if (arg == "--output-dir")
+            options.output_dir = next_arg();
+        else if (arg.starts_with ("--"))
+            return std::nullopt;
+        else
+            options.input_files.emplace_back (arg);
+    }
+
+    if (options.input_files.empty()
+        || options.hidden_size < LSTM_Model::min_hidden_size
+        || options.hidden_size > LSTM_Model::max_hidden_size)
+        return std::nullopt;
+
+    return options;
+}
+
+static std::optional<LSTM_Weights> load_weights (const std::filesystem::path& weights_path)
+{
+    std::ifstream weights_file { weights_path, std::ifstream::binary };
+    if (! weights_file)
+        return std::nullopt;
+
+    if (weights_path.extension() == ".bin")
+    {
+        std::vector<std::byte> weights_data (std::filesystem::file_size (weights_path));
+        weights_file.read (reinterpret_cast<char*> (weights_data.data()), (std::streamsize) weights_data.size());
+        return LSTM_Weights::from_binary (weights_data);
+    }
+
+    nlohmann::json model_json {};
+    weights_file >> model_json;
+    return LSTM_Weights::from_json (model_json);
+}
+
+/** First-order TPT highpass filter (same as the plugin's DC blocker) */
+struct DC_Blocker
+{
+    float G = 0.0f;
+    float state = 0.0f;
+
+    void prepare (double sample_rate, double cutoff_hz)
+    {
+        const auto g = std::tan (std::numbers::pi * cutoff_hz / sample_rate);
+        G = static_cast<float> (g / (1.0 + g));
+        state = 0.0f;
+    }
+
+    void process (float* data, int num_samples) noexcept
+    {
+        for (int n = 0; n < num_samples; ++n)
+        {
+            const auto v = (data[n] - state) * G;
+            const auto low_pass = v + state;
+            state = low_pass + v;
+            data[n] -= low_pass;
+        }
+    }
+};
+
+struct File_Result
+{
+    double audio_seconds {};
+    double process_seconds {};
+};
+
+/** Everything that one worker thread needs to process files (one at a time) */
+struct File_Processor
+{
+    LSTM_Model lstm_model {};
+    Half_Band_FIR upsampler {};
+    Half_Band_FIR downsampler {};
+    DC_Blocker dc_blocker {};
+
+    std::vector<float> interleaved_data {};
+    std::vector<float> mono_data {};
+    std::vector<float> os_data {};
+
+    /** The pruned weights are built once, and shared between all of the processors (see LSTM_Model::make_shared_weights()). */
+    File_Processor (const LSTM_Model::Shared_Weights& weights, const Options& options)
+    {
+        lstm_model.publish_model (LSTM_Model::make_model (options.hidden_size, weights));
+        lstm_model.activation = options.activation;
+        lstm_model.update_active_model();
+        lstm_model.free_retired_model();
+
+        upsampler.prepare (1);
+        downsampler.prepare (1);
+    }
+
+    std::optional<File_Result> process_file (const std::filesystem::path& input_path, const Options& options)
+    {
+        SF_INFO file_info {};
+        auto* input_file = sf_open (input_path.string().c_str(), SFM_READ, &file_info);
+        if (input_file == nullptr)
+            return std::nullopt;
+
+        const auto output_path = options.output_dir / input_path.filename();
+        auto output_file_info = file_info;
+        auto* output_file = sf_open (output_path.string().c_str(), SFM_WRITE, &output_file_info);
+        if (output_file == nullptr)
+        {
+            sf_close (input_file);
+            return std::nullopt;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        // same rule as the plugin: run the network at 88.2/96 kHz
+        const auto os_ratio = options.oversampling && file_info.samplerate <= 48000 ? 2 : 1;
+        const auto latency_samples = os_ratio > 1 ? Half_Band_FIR::latency_samples : 0;
+
+        // start each file from scratch
+        std::visit ([] (auto& model)
+                    { model.lstm.reset(); },
+                    *lstm_model.update_active_model());
+        upsampler.reset();
+        downsampler.reset();
+        dc_blocker.prepare ((double) file_info.samplerate, 10.0);
+
+        const auto num_channels = file_info.channels;
+        interleaved_data.resize ((size_t) (options.block_size * num_channels));
+        mono_data.resize ((size_t) options.block_size);
+        os_data.resize ((size_t) (options.block_size * os_ratio));
+
+        auto samples_to_skip = latency_samples;
+        auto flush_samples = latency_samples;
+        while (true)
+        {
+            auto num_samples = (int) sf_readf_float (input_file, interleaved_data.data(), options.block_size);
+            if (num_samples == 0)
+            {
+                // push some zeros through to flush out the resampling latency
+                if (flush_samples == 0)
+                    break;
+                num_samples = std::min (flush_samples, options.block_size);
+                flush_samples -= num_samples;
+                std::fill (interleaved_data.begin(), interleaved_data.begin() + num_samples * num_channels, 0.0f);
+            }
+
+            for (int n = 0; n < num_samples; ++n)
+            {
+                auto sum = 0.0f;
+                for (int ch = 0; ch < num_channels; ++ch)
+                    sum += interleaved_data[(size_t) (n * num_channels + ch)];
+                mono_data[(size_t) n] = sum / (float) num_channels;
+            }
+
+            if (os_ratio > 1)
+            {
+                upsampler.upsample (mono_data.data(), os_data.data(), num_samples, 0);
+                lstm_model.process (std::span { os_data.data(), (size_t) (num_samples * os_ratio) });
+                downsampler.downsample (os_data.data(), mono_data.data(), num_samples, 0);
+            }
+            else
+            {
+                lstm_model.process (std::span { mono_data.data(), (size_t) num_samples });
+            }
+
+            dc_blocker.process (mono_data.data(), num_samples);
+
+            const auto skip = std::min (samples_to_skip, num_samples);
+            samples_to_skip -= skip;
+            for (int n = skip; n < num_samples; ++n)
+                for (int ch = 0; ch < num_channels; ++ch)
+                    interleaved_data[(size_t) ((n - skip) * num_channels + ch)] = mono_data[(size_t) n];
+            sf_writef_float (output_file, interleaved_data.data(), num_samples - skip);
+        }
+
+        sf_close (input_file);
+        sf_close (output_file);
+
+        return File_Result {
+            .audio_seconds = (double) file_info.frames / (double) file_info.samplerate,
+            .process_seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count(),
+        };
+    }
+};
+
+int main (int argc, char* argv[])
+{
+    const auto options = parse_args (argc, argv);
+    if (! options.has_value())
+    {
+        print_usage();
+        return 1;
+    }
+
+    const auto weights = load_weights (options->weights_path);
+    if (! weights.has_value())
+    {
+        std::cerr << "Unable to load model weights from " << options->weights_path << std::endl;
+        return 1;
+    }
+
+    std::filesystem::create_directories (options->output_dir);
+
+    // the output files are opened for writing while the inputs are being read, so they had better not be the same files!
+    for (const auto& input_file : options->input_files)
+    {
+        std::error_code error {};
+        if (std::filesystem::equivalent (input_file, options->output_dir / input_file.filename(), error))
+        {
+            std::cerr << "Refusing to overwrite input file " << input_file << ", please choose a different output directory" << std::endl;
+            return 1;
+        }
+    }
+
+    const auto shared_weights = LSTM_Model::make_shared_weights (*weights, LSTM_Model::get_surviving_units (options->hidden_size, options->ranking));
+
+    const auto num_files = options->input_files.size();
+    const auto num_threads = std::min ((size_t) options->num_threads, num_files);
+    std::cout << "Processing " << num_files << " files with hidden size " << options->hidden_size
+              << ", on " << num_threads << " threads" << std::endl;
+
+    std::atomic<size_t> next_file { 0 };
+    std::mutex results_mutex {};
+    File_Result total_result {};
+    int num_failed = 0;
+
+    const auto batch_start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers {};
+    for (size_t thread_idx = 0; thread_idx < num_threads; ++thread_idx)
+    {
+        workers.emplace_back (
+            [&]
+            {
+                File_Processor processor { shared_weights, *options };
+                for (auto file_idx = next_file++; file_idx < num_files; file_idx = next_file++)
+                {
+                    const auto& input_file = options->input_files[file_idx];
+                    const auto result = processor.process_file (input_file, *options);
+
+                    std::lock_guard lock { results_mutex };
+                    if (! result.has_value())
+                    {
+                        std::cerr << "Unable to process file: " << input_file << std::endl;
+                        num_failed++;
+                        continue;
+                    }
+
+                    total_result.audio_seconds += result->audio_seconds;
+                    total_result.process_seconds += result->process_seconds;
+                    std::cout << input_file.filename().string() << ": "
+                              << result->audio_seconds << " seconds of audio, in "
+                              << result->process_seconds << " seconds (RTF: "
+                              << result->audio_seconds / result->process_seconds << ")" << std::endl;
+                }
+            });
+    }
+
+    for (auto& worker : workers)
+        worker.join();
+    const auto batch_seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - batch_start).count();
+
+    std::cout << "Processed " << total_result.audio_seconds << " seconds of audio in " << batch_seconds << " seconds" << std::endl;
+    std::cout << "Total RTF: " << total_result.audio_seconds / batch_seconds
+              << " (per thread: " << total_result.audio_seconds / total_result.process_seconds << ")" << std::endl;
+
+    return num_failed == 0 ? 0 : 1;
+}
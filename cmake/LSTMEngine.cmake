@@ -0,0 +1,50 @@
+set(LSTM_ENGINE_SOURCE_DIR "${CMAKE_CURRENT_LIST_DIR}/../plugin")
+
+# Builds the (JUCE-free) LSTM model, weights, Dense/Conv models, SIMD kernels, and DSP helpers as a static library,
+# so that they can be shared between the plugin and the command-line tools.
+# MODEL_GRID sets which hidden sizes get their own model instantiation (see lstm_model.h).
+function(add_lstm_engine target)
+    set(oneValueArgs MODEL_GRID)
+    cmake_parse_arguments(ARG "" "${oneValueArgs}" "" ${ARGN})
+    if(NOT ARG_MODEL_GRID)
+        set(ARG_MODEL_GRID 1)
+    endif()
+
+    message(STATUS "Setting up LSTM engine ${target}, with model grid: ${ARG_MODEL_GRID}")
+    add_library(${target} STATIC
+        ${LSTM_ENGINE_SOURCE_DIR}/lstm_model.cpp
+        ${LSTM_ENGINE_SOURCE_DIR}/lstm_weights.cpp
+        ${LSTM_ENGINE_SOURCE_DIR}/lstm_interleaved_weights.cpp
+        ${LSTM_ENGINE_SOURCE_DIR}/masked_lstm_model.cpp
+        ${LSTM_ENGINE_SOURCE_DIR}/feedforward_weights.cpp
+        ${LSTM_ENGINE_SOURCE_DIR}/feedforward_model.cpp
+        ${LSTM_ENGINE_SOURCE_DIR}/lstm_kernels.cpp
+        ${LSTM_ENGINE_SOURCE_DIR}/pruned_model_cache.cpp
+        ${LSTM_ENGINE_SOURCE_DIR}/shared_model_store.cpp
+        ${LSTM_ENGINE_SOURCE_DIR}/model_cost_table.cpp
+        ${LSTM_ENGINE_SOURCE_DIR}/segment_renderer.cpp
+        ${LSTM_ENGINE_SOURCE_DIR}/half_band_fir.cpp
+    )
+    target_include_directories(${target} PUBLIC ${LSTM_ENGINE_SOURCE_DIR})
+    find_package(Threads REQUIRED)
+    target_link_libraries(${target} PUBLIC RTNeural Threads::Threads)
+    target_compile_definitions(${target} PUBLIC LSTM_MODEL_GRID=${ARG_MODEL_GRID})
+    set_target_properties(${target} PROPERTIES POSITION_INDEPENDENT_CODE ON)
+
+    # SIMD kernels, compiled per instruction set and chosen at runtime
+    if(CMAKE_SYSTEM_PROCESSOR MATCHES "x86_64|AMD64" AND NOT CMAKE_OSX_ARCHITECTURES MATCHES "arm64")
+        set(avx2_source ${LSTM_ENGINE_SOURCE_DIR}/lstm_kernels_avx2.cpp)
+        set(avx512_source ${LSTM_ENGINE_SOURCE_DIR}/lstm_kernels_avx512.cpp)
+        target_sources(${target} PRIVATE ${LSTM_ENGINE_SOURCE_DIR}/lstm_kernels_sse.cpp ${avx2_source} ${avx512_source})
+        target_compile_definitions(${target} PUBLIC NEURAL_PRUNING_X86_KERNELS=1)
+        if(MSVC)
+            set_source_files_properties(${avx2_source} TARGET_DIRECTORY ${target} PROPERTIES COMPILE_OPTIONS "/arch:AVX2")
+            set_source_files_properties(${avx512_source} TARGET_DIRECTORY ${target} PROPERTIES COMPILE_OPTIONS "/arch:AVX512")
+        else()
+            set_source_files_properties(${avx2_source} TARGET_DIRECTORY ${target} PROPERTIES COMPILE_OPTIONS "-mavx2;-mfma;-mf16c")
+            set_source_files_properties(${avx512_source} TARGET_DIRECTORY ${target} PROPERTIES COMPILE_OPTIONS "-mavx512f;-mavx512bw;-mfma")
+        endif()
+    else()
+        target_compile_definitions(${target} PUBLIC NEURAL_PRUNING_X86_KERNELS=0)
+    endif()
+endfunction(add_lstm_engine)
@@ -7,6 +7,8 @@ function(package_plugin plugin_target)
         COMMAND ${CMAKE_COMMAND} -E make_directory package
     )
 
+    get_target_property(plugin_resources ${plugin_target} NEURAL_PRUNING_PLUGIN_RESOURCES)
+
     foreach(target IN ITEMS ${plugin_target}_VST3 ${plugin_target}_AU ${plugin_target}_CLAP)
         if(NOT TARGET ${target})
             continue()
@@ -22,6 +24,15 @@ function(package_plugin plugin_target)
             COMMAND ${CMAKE_COMMAND} -E echo "Copying target ${plugin_artefact_file_path} to package/${plugin_file_name}"
             COMMAND ${CMAKE_COMMAND} "-Dsrc=${plugin_artefact_file_path}" "-Ddest=package" "-P" "${JUCE_CMAKE_UTILS_DIR}/copyDir.cmake"
         )
+
+        # the CLAP is a single file outside of macOS, so its resources have to be shipped next to it
+        if(plugin_resources AND target STREQUAL "${plugin_target}_CLAP" AND NOT APPLE)
+            add_custom_command(TARGET ${package_target}
+                POST_BUILD
+                WORKING_DIRECTORY ${CMAKE_BINARY_DIR}
+                COMMAND ${CMAKE_COMMAND} -E copy_if_different ${plugin_resources} package
+            )
+        endif()
     endforeach()
     add_custom_command(TARGET ${package_target}
         POST_BUILD
@@ -0,0 +1,151 @@
+#include "accuracy_meter.h"
+
+Accuracy_Meter::Accuracy_Meter (Shared_Model_Store& store)
+    : juce::Thread { "Accuracy Meter" },
+      model_store { store }
+{
+}
+
+Accuracy_Meter::~Accuracy_Meter()
+{
+    stopThread (1000);
+}
+
+void Accuracy_Meter::prepare (int max_block_size)
+{
+    block_pairs.resize ((size_t) max_block_size);
+    num_captured = 0;
+    reset();
+}
+
+void Accuracy_Meter::capture_input (const float* input, int num_samples) noexcept
+{
+    // a block that's bigger than we prepared for can't be captured in full, which
+    // puts the reference model out of sync just like a queue overflow does
+    num_captured = std::min (num_samples, (int) block_pairs.size());
+    if (num_captured < num_samples)
+        samples_dropped.store (true, std::memory_order_relaxed);
+
+    for (int n = 0; n < num_captured; ++n)
+        block_pairs[(size_t) n].input = input[n];
+}
+
+void Accuracy_Meter::push_output (const float* output, int num_samples) noexcept
+{
+    jassert (num_samples >= num_captured);
+    juce::ignoreUnused (num_samples);
+    for (int n = 0; n < num_captured; ++n)
+        block_pairs[(size_t) n].output = output[n];
+
+    const auto num_pushed = queue.push (block_pairs.data(), (size_t) num_captured);
+    if (num_pushed < (size_t) num_captured)
+        samples_dropped.store (true, std::memory_order_relaxed);
+}
+
+void Accuracy_Meter::reset() noexcept
+{
+    reset_requested.store (true, std::memory_order_release);
+}
+
+void Accuracy_Meter::set_enabled (bool should_be_enabled) noexcept
+{
+    enabled.store (should_be_enabled, std::memory_order_release);
+    reset();
+    notify();
+}
+
+Accuracy_Meter::Stats Accuracy_Meter::get_stats() const noexcept
+{
+    return {
+        .mse = mse.load (std::memory_order_relaxed),
+        .esr = esr.load (std::memory_order_relaxed),
+        .is_measuring = is_measuring.load (std::memory_order_relaxed),
+    };
+}
+
+void Accuracy_Meter::run()
+{
+    static constexpr size_t chunk_size = 256;
+    std::array<Sample_Pair, chunk_size> pairs {};
+    std::array<float, chunk_size> reference_output {};
+
+    static constexpr auto smoothing = 1.0 / (double) averaging_samples;
+    auto error_power = 0.0;
+    auto signal_power = 0.0;
+    auto average_weight = 0.0; // total weight of the samples in the running averages, for the bias correction
+    auto warm_up_remaining = warm_up_samples;
+
+    while (! threadShouldExit())
+    {
+        if (! enabled.load (std::memory_order_acquire))
+        {
+            // drop anything that was pushed before the meter was turned off
+            while (queue.pop (pairs.data(), chunk_size) > 0)
+            {
+            }
+            wait (100);
+            continue;
+        }
+
+        if (reference_model == nullptr)
+        {
+            reference_model = model_store.make_model (LSTM_Model::max_hidden_size, Ranking::Mean_Activations);
+            reset_requested.store (true, std::memory_order_relaxed);
+        }
+
+        if (reset_requested.exchange (false, std::memory_order_acq_rel))
+        {
+            std::visit ([] (auto& model)
+                        { model.lstm.reset(); },
+                        *reference_model);
+            error_power = 0.0;
+            signal_power = 0.0;
+            average_weight = 0.0;
+            warm_up_remaining = warm_up_samples;
+            samples_dropped.store (false, std::memory_order_relaxed);
+            is_measuring.store (false, std::memory_order_relaxed);
+        }
+
+        if (samples_dropped.exchange (false, std::memory_order_relaxed))
+            warm_up_remaining = warm_up_samples;
+
+        const auto num_pairs = queue.pop (pairs.data(), chunk_size);
+        if (num_pairs == 0)
+        {
+            wait (20);
+            continue;
+        }
+
+        for (size_t n = 0; n < num_pairs; ++n)
+            reference_output[n] = pairs[n].input;
+        std::visit (
+            [&reference_output, num_pairs] (auto& model)
+            {
+                float* const channels[] = { reference_output.data() };
+                model.process (channels, (int) num_pairs);
+            },
+            *reference_model);
+
+        for (size_t n = 0; n < num_pairs; ++n)
+        {
+            if (warm_up_remaining > 0)
+            {
+                --warm_up_remaining;
+                continue;
+            }
+
+            const auto error = (double) pairs[n].output - (double) reference_output[n];
+            error_power += (error * error - error_power) * smoothing;
+            signal_power += ((double) reference_output[n] * (double) reference_output[n] - signal_power) * smoothing;
+            average_weight += (1.0 - average_weight) * smoothing;
+        }
+
+        if (warm_up_remaining == 0 && average_weight > 0.0)
+        {
+            // the averages start from zero, so they need to be scaled up by the weight that they've accumulated so far
+            mse.store (error_power / average_weight, std::memory_order_relaxed);
+            esr.store (signal_power > 0.0 ? error_power / signal_power : 0.0, std::memory_order_relaxed);
+            is_measuring.store (true, std::memory_order_relaxed);
+        }
+    }
+}
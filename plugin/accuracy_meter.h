@@ -0,0 +1,83 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include "lock_free_queue.h"
+#include "shared_model_store.h"
+
+/**
+ * Live null test between the (pruned) model that the plugin is running and the
+ * full-size reference model (unpruned, float32 weights, exact activations).
+ * The reference is the full-size LSTM, so the meter only measures the plugin
+ * while it's running the LSTM (the Dense and Conv networks were trained
+ * separately, and don't have an LSTM to null against).
+ *
+ * The audio thread pushes the model's input and output into an SPSC queue, and
+ * a background thread runs the reference model over the same input, keeping
+ * running averages of the squared error and the reference signal power, which
+ * are published as the MSE and the error-to-signal ratio (ESR).
+ *
+ * The running averages are bias-corrected, so that they don't read low while
+ * they're filling up after a reset.
+ *
+ * If the background thread falls behind and the queue overflows (or a block is
+ * bigger than the meter was prepared for, so it can't all be captured), the
+ * reference model's state gets out of sync for a while, so we stop measuring
+ * until the reference model has warmed up again.
+ *
+ * The reference model is only built (on the background thread) once the meter
+ * is first enabled, and it doesn't run while the meter is disabled.
+ */
+struct Accuracy_Meter : juce::Thread
+{
+    explicit Accuracy_Meter (Shared_Model_Store& store);
+    ~Accuracy_Meter() override;
+
+    static constexpr int averaging_samples = 1 << 16; // time constant of the running averages (~0.7 seconds at 96 kHz)
+    static constexpr int warm_up_samples = 1 << 13;
+
+    /** Allocates the space for blocks up to the given size (not real-time safe, and not while the audio thread is running). */
+    void prepare (int max_block_size);
+
+    /** Captures a block of the model's input (audio thread only, before the model processes the block). */
+    void capture_input (const float* input, int num_samples) noexcept;
+
+    /** Pushes the captured input along with the model's output to the background thread (audio thread only). */
+    void push_output (const float* output, int num_samples) noexcept;
+
+    /** Starts measuring again from scratch (safe to call from any thread). */
+    void reset() noexcept;
+
+    /** Turns the meter on or off, and starts measuring again from scratch (safe to call from any thread). */
+    void set_enabled (bool should_be_enabled) noexcept;
+
+    struct Stats
+    {
+        double mse {};
+        double esr {};
+        bool is_measuring {}; // false while the reference model is warming up
+    };
+    Stats get_stats() const noexcept;
+
+    void run() override;
+
+private:
+    struct Sample_Pair
+    {
+        float input {};
+        float output {};
+    };
+    Spsc_Queue<Sample_Pair, 1 << 15> queue {};
+    std::vector<Sample_Pair> block_pairs {};
+    int num_captured = 0;
+
+    Shared_Model_Store& model_store;
+    std::unique_ptr<LSTM_Model::Model_Variant> reference_model {}; // only touched by the background thread
+
+    std::atomic<bool> enabled { false };
+    std::atomic<bool> reset_requested { true };
+    std::atomic<bool> samples_dropped { false };
+    std::atomic<double> mse { 0.0 };
+    std::atomic<double> esr { 0.0 };
+    std::atomic<bool> is_measuring { false };
+};
@@ -2,17 +2,34 @@
 
 #include <chowdsp_logging/chowdsp_logging.h>
 #include <juce_gui_basics/juce_gui_basics.h>
+#include <deque>
 
-struct Console_Logger : chowdsp::BaseLogger
+#include "lock_free_queue.h"
+
+/**
+ * Log messages go into a lock-free ring buffer, so that any thread can log
+ * without blocking on the message thread. The ring buffer gets drained on
+ * a timer, and the new lines are appended to the console (if there is one).
+ *
+ * chowdsp::log formats each message into a juce::String before it reaches
+ * the ring buffer, so it's only used on the message thread. Other threads
+ * log through Console_Logger::push_message(), which formats into a fixed-size line.
+ */
+struct Console_Logger : chowdsp::BaseLogger,
+                        private juce::Timer
 {
+    static constexpr size_t max_line_length = 256;
+    static constexpr size_t max_pending_lines = 512;
+    static constexpr size_t max_history_lines = 2000;
+    static constexpr int max_console_chars = 256 * 1024;
+    using Log_Line = std::array<char, max_line_length>;
+
     Console_Logger()
     {
         onLogMessage.connect ([this] (const juce::String& message)
-        {
-            log_text += message.toStdString() + "\n";
-            update_console();
-        });
+                              { push_line (message.toRawUTF8()); });
         chowdsp::set_global_logger (this);
+        startTimer (50);
     }
 
     ~Console_Logger() override
@@ -20,22 +37,100 @@ struct Console_Logger : chowdsp::BaseLogger
         chowdsp::set_global_logger (nullptr);
     }
 
+    /** Adds a line to the log (real-time safe, and callable from any thread). Long lines get truncated. */
+    void push_line (std::string_view message) noexcept
+    {
+        Log_Line line {};
+        std::copy_n (message.data(), std::min (message.size(), line.size() - 1), line.data());
+        push_line (line);
+    }
+
+    /** Adds a (null-terminated) line to the log (real-time safe, and callable from any thread). */
+    void push_line (const Log_Line& line) noexcept
+    {
+        if (! pending_lines.try_push (line))
+            num_dropped_lines.fetch_add (1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Formats a message straight into a log line, and adds it to the log. Unlike
+     * chowdsp::log, this never allocates, so use it from the audio thread and the
+     * background workers. Long lines get truncated.
+     */
+    template <typename... Args>
+    void push_message (fmt::format_string<Args...> format, Args&&... args) noexcept
+    {
+        Log_Line line {};
+        fmt::format_to_n (line.data(), line.size() - 1, format, std::forward<Args> (args)...);
+        push_line (line);
+    }
+
     void set_console (juce::TextEditor* new_console)
     {
         console = new_console;
-        update_console();
+        if (console == nullptr)
+            return;
+
+        // fill in the console with the lines that we've already received
+        juce::String history_text {};
+        for (const auto& line : history)
+            history_text << line.c_str() << '\n';
+        console->setText (history_text, juce::dontSendNotification);
+        console->moveCaretToEnd();
     }
 
-    void update_console() const
+    void clear()
     {
-        const juce::MessageManagerLock mml {};
+        history.clear();
         if (console != nullptr)
+            console->clear();
+    }
+
+private:
+    void timerCallback() override
+    {
+        juce::String new_text {};
+        Log_Line line {};
+        while (pending_lines.try_pop (line))
+        {
+            history.emplace_back (line.data());
+            new_text << history.back().c_str() << '\n';
+        }
+
+        if (const auto num_dropped = num_dropped_lines.exchange (0, std::memory_order_relaxed); num_dropped > 0)
+        {
+            history.emplace_back ("[" + std::to_string (num_dropped) + " log messages dropped]");
+            new_text << history.back().c_str() << '\n';
+        }
+
+        if (new_text.isEmpty())
+            return;
+
+        auto history_trimmed = false;
+        while (history.size() > max_history_lines)
         {
-            console->setText (log_text, juce::sendNotification);
-            console->moveCaretToEnd();
+            history.pop_front();
+            history_trimmed = true;
         }
+
+        if (console == nullptr)
+            return;
+
+        // rebuilding the console text is expensive, so we only do it once the console has grown too large
+        if (history_trimmed && console->getTotalNumChars() > max_console_chars)
+        {
+            set_console (console);
+            return;
+        }
+
+        console->moveCaretToEnd();
+        console->insertTextAtCaret (new_text);
     }
 
-    std::string log_text {};
+    Lock_Free_Queue<Log_Line, max_pending_lines> pending_lines {};
+    std::atomic<int> num_dropped_lines { 0 };
+
+    // only touched on the message thread
+    std::deque<std::string> history {};
     juce::TextEditor* console { nullptr };
 };
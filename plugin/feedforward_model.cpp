@@ -0,0 +1,164 @@
+#include "feedforward_model.h"
+#include <chrono>
+#include <memory>
+
+Feedforward_Model::Model::Model (std::shared_ptr<const Feedforward_Weights> model_weights)
+    : weights { std::move (model_weights) }
+{
+    auto max_layer_size = 1;
+    for (auto& inputs : layer_inputs)
+    {
+        inputs.reserve (weights->layers.size());
+        for (const auto& layer : weights->layers)
+        {
+            inputs.push_back (Eigen::MatrixXf::Zero (layer.in_size, layer.get_history_size() + max_block_size));
+            max_layer_size = std::max (max_layer_size, layer.out_size);
+        }
+    }
+
+    static constexpr auto alignment = 64;
+    const auto scratch_size = (size_t) lstm_kernels::padded_size (max_layer_size * max_block_size);
+    activation_scratch.resize (scratch_size + alignment / sizeof (float));
+    void* scratch_data = activation_scratch.data();
+    auto space = activation_scratch.size() * sizeof (float);
+    aligned_scratch = static_cast<float*> (std::align (alignment, scratch_size * sizeof (float), scratch_data, space));
+}
+
+void Feedforward_Model::Model::apply_activation (Feedforward_Weights::Layer_Activation layer_activation, float* data, int size) noexcept
+{
+    auto x = Eigen::Map<Eigen::ArrayXf> { data, size };
+    if (layer_activation == Feedforward_Weights::Layer_Activation::ReLU)
+    {
+        x = x.max (0.0f);
+    }
+    else if (layer_activation == Feedforward_Weights::Layer_Activation::Tanh)
+    {
+        if (activation == Activation::Exact || simd_kernel == nullptr)
+        {
+            x = x.tanh();
+            return;
+        }
+
+        std::copy (data, data + size, aligned_scratch);
+        simd_kernel->apply_tanh (aligned_scratch, aligned_scratch, lstm_kernels::padded_size (size), activation);
+        std::copy (aligned_scratch, aligned_scratch + size, data);
+    }
+}
+
+void Feedforward_Model::Model::process_block (std::vector<Eigen::MatrixXf>& inputs, float* data, int block_size) noexcept
+{
+    const auto num_layers = weights->layers.size();
+
+    auto& first_input = inputs.front();
+    first_input.middleCols (weights->layers.front().get_history_size(), block_size) = Eigen::Map<const Eigen::RowVectorXf> { data, block_size };
+
+    for (size_t layer_idx = 0; layer_idx < num_layers; ++layer_idx)
+    {
+        const auto& layer = weights->layers[layer_idx];
+        auto& input = inputs[layer_idx];
+        const auto history_size = layer.get_history_size();
+
+        // the output goes straight into the next layer's input (or back out to the channel, for the last layer)
+        auto* out_data = data;
+        if (layer_idx + 1 < num_layers)
+        {
+            auto& next_input = inputs[layer_idx + 1];
+            out_data = next_input.data() + next_input.rows() * weights->layers[layer_idx + 1].get_history_size();
+        }
+
+        auto out = Eigen::Map<Eigen::MatrixXf> { out_data, layer.out_size, block_size };
+        out.colwise() = layer.bias;
+        for (int k = 0; k < layer.kernel_size; ++k)
+            out.noalias() += layer.taps[(size_t) k] * input.middleCols (history_size - k * layer.dilation, block_size);
+        apply_activation (layer.activation, out_data, layer.out_size * block_size);
+
+        // keep the most recent inputs around for the next block
+        if (history_size > 0)
+            std::copy (input.data() + input.rows() * block_size,
+                       input.data() + input.rows() * (block_size + history_size),
+                       input.data());
+    }
+}
+
+void Feedforward_Model::Model::process (std::span<float* const> channels, int num_samples) noexcept
+{
+    assert (! channels.empty() && channels.size() <= max_num_streams);
+    for (size_t stream = 0; stream < channels.size(); ++stream)
+    {
+        for (int start = 0; start < num_samples; start += max_block_size)
+            process_block (layer_inputs[stream], channels[stream] + start, std::min (num_samples - start, max_block_size));
+    }
+}
+
+Feedforward_Model::~Feedforward_Model()
+{
+    delete active_model;
+    delete pending_model.exchange (nullptr);
+    delete retired_model.exchange (nullptr);
+}
+
+Feedforward_Model::Model* Feedforward_Model::update_active_model() noexcept
+{
+    // same as LSTM_Model: the audio thread never frees anything, so if the
+    // previously retired model hasn't been freed yet, we hold off until the next block
+    if (retired_model.load (std::memory_order_acquire) == nullptr)
+    {
+        if (auto* next_model = pending_model.exchange (nullptr, std::memory_order_acq_rel))
+            retired_model.store (std::exchange (active_model, next_model), std::memory_order_release);
+    }
+
+    if (active_model != nullptr)
+        active_model->activation = activation;
+
+    return active_model;
+}
+
+void Feedforward_Model::process (std::span<float* const> channels, int num_samples) noexcept
+{
+    if (auto* model = update_active_model())
+        model->process (channels, num_samples);
+}
+
+double Feedforward_Model::measure_ns_per_sample (const std::shared_ptr<const Feedforward_Weights>& weights, int num_streams)
+{
+    static constexpr int block_size = 64;
+    static constexpr int num_blocks = 64;
+    static constexpr int num_trials = 3;
+
+    Model model { weights };
+
+    std::array<float, block_size> test_signal {};
+    for (size_t n = 0; n < block_size; ++n)
+        test_signal[n] = 0.5f * std::sin (0.1f * (float) n);
+
+    // take the fastest trial, since anything slower was probably interrupted
+    auto best_duration = std::numeric_limits<double>::max();
+    for (int trial = 0; trial <= num_trials; ++trial)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (int block = 0; block < num_blocks; ++block)
+        {
+            std::array<std::array<float, block_size>, max_num_streams> data { test_signal, test_signal };
+            float* const channels[] = { data[0].data(), data[1].data() };
+            model.process ({ channels, (size_t) num_streams }, block_size);
+        }
+        const auto duration = std::chrono::duration<double, std::nano> (std::chrono::steady_clock::now() - start).count();
+
+        // the first trial is just a warm-up
+        if (trial > 0)
+            best_duration = std::min (best_duration, duration);
+    }
+
+    return best_duration / (double) (block_size * num_blocks);
+}
+
+void Feedforward_Model::publish_model (std::unique_ptr<Model>&& new_model)
+{
+    // if the audio thread never picked up the previous pending model, we can free it here
+    delete pending_model.exchange (new_model.release(), std::memory_order_acq_rel);
+}
+
+void Feedforward_Model::free_retired_model()
+{
+    delete retired_model.exchange (nullptr, std::memory_order_acq_rel);
+}
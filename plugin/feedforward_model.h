@@ -0,0 +1,86 @@
+#pragma once
+
+#include "feedforward_weights.h"
+
+/** The network architectures that the plugin can run. */
+enum class Architecture
+{
+    LSTM = 1,
+    Dense = 2,
+    Conv = 4,
+};
+
+/**
+ * Runs a (pruned) Dense or Conv1D network. Since there's no recurrence, each
+ * layer processes a whole sub-block of samples at once, as a matrix product
+ * for each tap.
+ *
+ * Models are swapped the same way as in LSTM_Model: they're built off the
+ * audio thread and published via an atomic pointer, and the audio thread hands
+ * the previous model back to be freed on a non-audio thread.
+ */
+struct Feedforward_Model
+{
+    static constexpr int max_block_size = 64;
+    static constexpr int max_num_streams = LSTM_Model::max_num_streams;
+
+    struct Model
+    {
+        /** Allocates the layer buffers for a set of weights (not real-time safe). */
+        explicit Model (std::shared_ptr<const Feedforward_Weights> model_weights);
+
+        std::shared_ptr<const Feedforward_Weights> weights {};
+
+        /** How the tanh layers compute their activations. */
+        Activation activation = Activation::Exact;
+
+        /** Processes a block of samples in-place, running each channel as a separate stream. */
+        void process (std::span<float* const> channels, int num_samples) noexcept;
+
+    private:
+        void process_block (std::vector<Eigen::MatrixXf>& inputs, float* data, int block_size) noexcept;
+        void apply_activation (Feedforward_Weights::Layer_Activation layer_activation, float* data, int size) noexcept;
+
+        // the input to each layer (for each stream), with the past samples that the layer needs in the first columns
+        std::array<std::vector<Eigen::MatrixXf>, max_num_streams> layer_inputs {};
+
+        // the SIMD kernels need aligned, padded arrays for the tanh approximations
+        const lstm_kernels::Kernel* simd_kernel = lstm_kernels::get_kernel();
+        std::vector<float> activation_scratch {};
+        float* aligned_scratch {};
+    };
+
+    Feedforward_Model() = default;
+    ~Feedforward_Model();
+
+    Model* active_model {}; // only touched by the audio thread
+    std::atomic<Model*> pending_model {};
+    std::atomic<Model*> retired_model {};
+
+    /** How the active model computes its activations (picked up at the start of each block, audio thread only). */
+    Activation activation = Activation::Exact;
+
+    /**
+     * Swaps in the pending model (if there is one), and returns the active model (audio thread only).
+     * Returns nullptr if no model has been published yet.
+     */
+    Model* update_active_model() noexcept;
+
+    void process (std::span<float* const> channels, int num_samples) noexcept;
+
+    /**
+     * Measures how long it takes a model with the given weights to process
+     * one sample for all the streams (in nanoseconds) on the running machine
+     * (not real-time safe).
+     */
+    static double measure_ns_per_sample (const std::shared_ptr<const Feedforward_Weights>& weights, int num_streams = 1);
+
+    /** Hands a newly built model over to the audio thread. */
+    void publish_model (std::unique_ptr<Model>&& new_model);
+
+    /** Frees the model most recently retired by the audio thread (must not be called from the audio thread!) */
+    void free_retired_model();
+
+    Feedforward_Model (const Feedforward_Model&) = delete;
+    Feedforward_Model& operator= (const Feedforward_Model&) = delete;
+};
@@ -0,0 +1,281 @@
+#include "feedforward_weights.h"
+#include <cmath>
+#include <numbers>
+#include <numeric>
+#include <random>
+
+static Feedforward_Weights::Layer_Activation get_layer_activation (const std::string& name)
+{
+    if (name == "relu")
+        return Feedforward_Weights::Layer_Activation::ReLU;
+    if (name == "tanh")
+        return Feedforward_Weights::Layer_Activation::Tanh;
+    return Feedforward_Weights::Layer_Activation::None;
+}
+
+Feedforward_Weights Feedforward_Weights::from_json (const nlohmann::json& model_json)
+{
+    Feedforward_Weights weights {};
+
+    auto in_size = model_json["in_shape"].back().get<int>();
+    for (const auto& layer_json : model_json["layers"])
+    {
+        const auto type = layer_json["type"].get<std::string>();
+        if (type == "activation")
+        {
+            // a separate activation layer applies to the layer before it
+            assert (! weights.layers.empty());
+            weights.layers.back().activation = get_layer_activation (layer_json["activation"].get<std::string>());
+            continue;
+        }
+
+        auto& layer = weights.layers.emplace_back();
+        layer.in_size = in_size;
+        layer.out_size = layer_json["shape"].back().get<int>();
+        layer.activation = get_layer_activation (layer_json.value ("activation", std::string {}));
+
+        // Convention (same as Keras):
+        // dense:  weights[0][in][out]
+        // conv1d: weights[0][tap][in][out], with the last tap applied to the current input
+        // (so we reverse the taps, the same way that RTNeural does)
+        const auto& kernel_json = layer_json["weights"].at (0);
+        if (type == "conv1d")
+        {
+            layer.kernel_size = layer_json["kernel_size"].back().get<int>();
+            layer.dilation = layer_json["dilation"].back().get<int>();
+        }
+        else
+        {
+            assert (type == "dense");
+        }
+
+        for (int k = 0; k < layer.kernel_size; ++k)
+        {
+            const auto& tap_json = type == "conv1d" ? kernel_json.at ((size_t) (layer.kernel_size - 1 - k)) : kernel_json;
+            auto& tap = layer.taps.emplace_back (layer.out_size, layer.in_size);
+            for (int i = 0; i < layer.in_size; ++i)
+                for (int j = 0; j < layer.out_size; ++j)
+                    tap (j, i) = tap_json.at ((size_t) i).at ((size_t) j).get<float>();
+        }
+
+        const auto& bias_json = layer_json["weights"].at (1);
+        layer.bias.resize (layer.out_size);
+        for (int j = 0; j < layer.out_size; ++j)
+            layer.bias[j] = bias_json.at ((size_t) j).get<float>();
+
+        in_size = layer.out_size;
+    }
+
+    weights.units.resize ((size_t) weights.get_num_units());
+    std::iota (weights.units.begin(), weights.units.end(), 0);
+    return weights;
+}
+
+int Feedforward_Weights::get_num_units() const
+{
+    int num_units = 0;
+    for (size_t layer_idx = 0; layer_idx + 1 < layers.size(); ++layer_idx)
+        num_units += layers[layer_idx].out_size;
+    return num_units;
+}
+
+size_t Feedforward_Weights::get_num_params() const
+{
+    size_t num_params = 0;
+    for (const auto& layer : layers)
+        num_params += (size_t) ((layer.kernel_size * layer.in_size + 1) * layer.out_size);
+    return num_params;
+}
+
+Feedforward_Weights Feedforward_Weights::gather_units (std::span<const int> unit_positions) const
+{
+    // split the positions up by layer (the last layer's outputs are never pruned)
+    std::vector<std::vector<int>> kept_units (layers.size());
+    for (int layer_idx = 0, position_idx = 0, first_unit = 0; layer_idx < (int) layers.size(); ++layer_idx)
+    {
+        const auto out_size = layers[(size_t) layer_idx].out_size;
+        auto& layer_units = kept_units[(size_t) layer_idx];
+        if (layer_idx + 1 == (int) layers.size())
+        {
+            layer_units.resize ((size_t) out_size);
+            std::iota (layer_units.begin(), layer_units.end(), 0);
+            break;
+        }
+
+        for (; position_idx < (int) unit_positions.size() && unit_positions[(size_t) position_idx] < first_unit + out_size; ++position_idx)
+            layer_units.push_back (unit_positions[(size_t) position_idx] - first_unit);
+        assert (! layer_units.empty());
+        first_unit += out_size;
+    }
+
+    Feedforward_Weights gathered {};
+    gathered.layers.reserve (layers.size());
+    for (size_t layer_idx = 0; layer_idx < layers.size(); ++layer_idx)
+    {
+        const auto& layer = layers[layer_idx];
+        const auto& rows = kept_units[layer_idx];
+
+        auto& new_layer = gathered.layers.emplace_back();
+        new_layer.in_size = layer_idx == 0 ? layer.in_size : (int) kept_units[layer_idx - 1].size();
+        new_layer.out_size = (int) rows.size();
+        new_layer.kernel_size = layer.kernel_size;
+        new_layer.dilation = layer.dilation;
+        new_layer.activation = layer.activation;
+
+        new_layer.bias.resize (new_layer.out_size);
+        for (int j = 0; j < new_layer.out_size; ++j)
+            new_layer.bias[j] = layer.bias[rows[(size_t) j]];
+
+        for (const auto& tap : layer.taps)
+        {
+            auto& new_tap = new_layer.taps.emplace_back (new_layer.out_size, new_layer.in_size);
+            for (int i = 0; i < new_layer.in_size; ++i)
+            {
+                const auto col = layer_idx == 0 ? i : kept_units[layer_idx - 1][(size_t) i];
+                for (int j = 0; j < new_layer.out_size; ++j)
+                    new_tap (j, i) = tap (rows[(size_t) j], col);
+            }
+        }
+    }
+
+    gathered.units.reserve (unit_positions.size());
+    for (auto position : unit_positions)
+        gathered.units.push_back (units[(size_t) position]);
+
+    return gathered;
+}
+
+/** Runs a whole signal through one layer (starting from silence). */
+static Eigen::MatrixXf run_layer (const Feedforward_Weights::Layer& layer, const Eigen::MatrixXf& input)
+{
+    const auto num_samples = input.cols();
+    Eigen::MatrixXf output = layer.bias.replicate (1, num_samples);
+    for (int k = 0; k < layer.kernel_size; ++k)
+    {
+        const auto delay = std::min ((Eigen::Index) (k * layer.dilation), num_samples);
+        output.rightCols (num_samples - delay).noalias() += layer.taps[(size_t) k] * input.leftCols (num_samples - delay);
+    }
+
+    if (layer.activation == Feedforward_Weights::Layer_Activation::ReLU)
+        output = output.cwiseMax (0.0f);
+    else if (layer.activation == Feedforward_Weights::Layer_Activation::Tanh)
+        output = output.array().tanh();
+    return output;
+}
+
+/** A decaying tone, swept up through the guitar range, with a little bit of noise. */
+static Eigen::MatrixXf make_test_signal (int num_samples)
+{
+    static constexpr auto start_frequency = 80.0 / 48000.0;
+    static constexpr auto end_frequency = 1200.0 / 48000.0;
+
+    std::minstd_rand rng { 0x5eed };
+    std::normal_distribution noise { 0.0f, 0.01f };
+
+    Eigen::MatrixXf signal { 1, num_samples };
+    auto phase = 0.0;
+    for (int n = 0; n < num_samples; ++n)
+    {
+        const auto t = (double) n / (double) num_samples;
+        phase += start_frequency * std::pow (end_frequency / start_frequency, t);
+        const auto envelope = std::exp (-3.0 * std::fmod (4.0 * t, 1.0));
+        signal (0, n) = (float) (envelope * std::sin (2.0 * std::numbers::pi * phase)) + noise (rng);
+    }
+    return signal;
+}
+
+std::vector<Pruning_Candidate> Feedforward_Weights::rank_units (Ranking ranking, const std::function<bool()>& should_cancel) const
+{
+    static constexpr int test_signal_size = 2048;
+
+    // the outputs of each layer for the test signal
+    std::vector<Eigen::MatrixXf> layer_outputs {};
+    if (ranking != Ranking::Min_Weights)
+    {
+        layer_outputs.reserve (layers.size());
+        auto input = make_test_signal (test_signal_size);
+        for (const auto& layer : layers)
+            input = layer_outputs.emplace_back (run_layer (layer, input));
+    }
+
+    std::vector<Pruning_Candidate> candidates {};
+    candidates.reserve ((size_t) get_num_units());
+    for (size_t layer_idx = 0; layer_idx + 1 < layers.size(); ++layer_idx)
+    {
+        const auto& layer = layers[layer_idx];
+        for (int row = 0; row < layer.out_size; ++row)
+        {
+            if (should_cancel != nullptr && should_cancel())
+                return {};
+
+            float value {};
+            if (ranking == Ranking::Min_Weights)
+            {
+                for (const auto& tap : layer.taps)
+                    value += tap.row (row).squaredNorm();
+            }
+            else if (ranking == Ranking::Mean_Activations)
+            {
+                const auto activation_out = layer_outputs[layer_idx].row (row).array();
+                value = std::sqrt ((activation_out - activation_out.mean()).square().mean());
+            }
+            else if (ranking == Ranking::Minimization)
+            {
+                // remove the unit, and run the rest of the network
+                Eigen::MatrixXf output = layer_outputs[layer_idx];
+                output.row (row).setZero();
+                for (auto next_idx = layer_idx + 1; next_idx < layers.size(); ++next_idx)
+                    output = run_layer (layers[next_idx], output);
+                value = (output - layer_outputs.back()).squaredNorm() / (float) test_signal_size;
+            }
+
+            candidates.push_back ({ .idx = (int) candidates.size(), .value = value });
+        }
+    }
+
+    std::stable_sort (candidates.begin(),
+                      candidates.end(),
+                      [] (const Pruning_Candidate& a, const Pruning_Candidate& b)
+                      { return a.value < b.value; });
+    return candidates;
+}
+
+std::vector<int> Feedforward_Weights::get_surviving_units (int pruned_hidden_size, std::span<const Pruning_Candidate> pruning_candidates) const
+{
+    const auto num_units = get_num_units();
+    const auto num_to_prune = (int) std::lround ((double) (LSTM_Model::max_hidden_size - pruned_hidden_size)
+                                                 * (double) num_units / (double) LSTM_Model::max_hidden_size);
+
+    std::vector<int> unit_layers {};
+    std::vector<int> layer_sizes {};
+    unit_layers.reserve ((size_t) num_units);
+    for (size_t layer_idx = 0; layer_idx + 1 < layers.size(); ++layer_idx)
+    {
+        layer_sizes.push_back (layers[layer_idx].out_size);
+        unit_layers.insert (unit_layers.end(), (size_t) layers[layer_idx].out_size, (int) layer_idx);
+    }
+
+    std::vector<bool> is_pruned ((size_t) num_units);
+    int num_pruned = 0;
+    for (const auto& candidate : pruning_candidates)
+    {
+        if (num_pruned == num_to_prune)
+            break;
+
+        // every layer needs to keep at least one unit
+        auto& layer_size = layer_sizes[(size_t) unit_layers[(size_t) candidate.idx]];
+        if (layer_size == 1)
+            continue;
+
+        is_pruned[(size_t) candidate.idx] = true;
+        layer_size--;
+        num_pruned++;
+    }
+
+    std::vector<int> unit_positions {};
+    unit_positions.reserve ((size_t) (num_units - num_pruned));
+    for (int k = 0; k < num_units; ++k)
+        if (! is_pruned[(size_t) k])
+            unit_positions.push_back (k);
+    return unit_positions;
+}
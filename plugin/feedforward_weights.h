@@ -0,0 +1,76 @@
+#pragma once
+
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "lstm_model.h"
+
+/**
+ * Weights for a feed-forward network: a stack of causal (dilated) 1D convolutions,
+ * where a dense layer is just a convolution with a single tap. This covers both the
+ * Dense (8 x 64, ReLU) and Conv1D (4 x 32, tanh) models from the training scripts.
+ *
+ * The prunable units are the outputs of every layer except the last, and are indexed
+ * by counting through the layers in order (so unit 70 of the Dense model is unit 6 of
+ * the second layer).
+ */
+struct Feedforward_Weights
+{
+    enum class Layer_Activation
+    {
+        None,
+        ReLU,
+        Tanh,
+    };
+
+    struct Layer
+    {
+        int in_size {};
+        int out_size {};
+        int kernel_size { 1 };
+        int dilation { 1 };
+        Layer_Activation activation { Layer_Activation::None };
+
+        /** One (out_size x in_size) matrix per tap, where tap k is applied to the input from k * dilation samples ago. */
+        std::vector<Eigen::MatrixXf> taps {};
+        Eigen::VectorXf bias {};
+
+        /** Returns the number of past input samples that the layer needs to keep around. */
+        int get_history_size() const { return (kernel_size - 1) * dilation; }
+    };
+
+    std::vector<Layer> layers {};
+    std::vector<int> units {}; // indices of the surviving units in the un-pruned model
+
+    /** Loads an RTNeural model JSON with dense and conv1d layers (separate activation layers are folded in). */
+    static Feedforward_Weights from_json (const nlohmann::json& model_json);
+
+    /** Returns the number of prunable units. */
+    int get_num_units() const;
+
+    /** Returns the number of parameters in the network. */
+    size_t get_num_params() const;
+
+    /**
+     * Returns a copy of these weights, keeping only the units at the given positions
+     * (which must be in ascending order, and leave at least one unit in each layer).
+     */
+    Feedforward_Weights gather_units (std::span<const int> unit_positions) const;
+
+    /**
+     * Ranks every unit by how little it contributes to the network's output (not real-time safe).
+     *
+     * The training audio doesn't ship with the plugin, so the activation-based rankings run a
+     * fixed test signal through the network, and Minimization measures the error against the
+     * un-pruned network's output, rather than the training target. Returns an empty list if
+     * it was cancelled.
+     */
+    std::vector<Pruning_Candidate> rank_units (Ranking ranking, const std::function<bool()>& should_cancel = {}) const;
+
+    /**
+     * Returns the units that survive a prune, in ascending order. The hidden size is relative to the
+     * LSTM's, so the same pruning parameter removes the same fraction of units from each network.
+     */
+    std::vector<int> get_surviving_units (int pruned_hidden_size, std::span<const Pruning_Candidate> pruning_candidates) const;
+};
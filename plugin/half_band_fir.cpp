@@ -0,0 +1,90 @@
+#include "half_band_fir.h"
+#include <cmath>
+#include <numbers>
+
+/** Zeroth-order modified Bessel function of the first kind (for the Kaiser window) */
+static double bessel_i0 (double x)
+{
+    auto sum = 1.0;
+    auto term = 1.0;
+    for (int k = 1; k < 50; ++k)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < 1.0e-12 * sum)
+            break;
+    }
+    return sum;
+}
+
+Half_Band_FIR::Half_Band_FIR()
+{
+    // Kaiser window with ~80 dB of stop-band attenuation
+    static constexpr auto beta = 7.86;
+    static constexpr auto centre = (num_taps - 1) / 2;
+
+    // the non-zero taps (other than the centre) are the even taps
+    for (int i = 0; i < num_branch_taps; ++i)
+    {
+        const auto k = 2 * i;
+        const auto t = static_cast<double> (k - centre);
+        const auto sinc = std::sin (std::numbers::pi * t / 2.0) / (std::numbers::pi * t / 2.0);
+        const auto r = t / static_cast<double> (centre);
+        const auto window = bessel_i0 (beta * std::sqrt (1.0 - r * r)) / bessel_i0 (beta);
+        branch_coefs[(size_t) i] = static_cast<float> (0.5 * sinc * window);
+    }
+}
+
+void Half_Band_FIR::prepare (int num_channels)
+{
+    states.resize ((size_t) num_channels);
+    reset();
+}
+
+void Half_Band_FIR::reset()
+{
+    for (auto& state : states)
+        state = {};
+}
+
+float Half_Band_FIR::push_and_filter (Channel_State& state, float x) const noexcept
+{
+    state.history_pos = (state.history_pos + num_branch_taps - 1) % num_branch_taps;
+    state.history[(size_t) state.history_pos] = x;
+    state.history[(size_t) (state.history_pos + num_branch_taps)] = x;
+
+    const auto* window = state.history.data() + state.history_pos;
+    auto y = 0.0f;
+    for (int i = 0; i < num_branch_taps; ++i)
+        y += branch_coefs[(size_t) i] * window[i];
+    return y;
+}
+
+void Half_Band_FIR::upsample (const float* in, float* out, int num_samples, int channel) noexcept
+{
+    auto& state = states[(size_t) channel];
+    for (int n = 0; n < num_samples; ++n)
+    {
+        // the zero-stuffed samples have no energy, so we make up the gain here
+        out[2 * n] = 2.0f * push_and_filter (state, in[n]);
+
+        // centre tap: x[n - (half_length - 1)], which is still in the history window
+        out[2 * n + 1] = state.history[(size_t) (state.history_pos + half_length - 1)];
+    }
+}
+
+void Half_Band_FIR::downsample (const float* in, float* out, int num_samples, int channel) noexcept
+{
+    auto& state = states[(size_t) channel];
+    for (int n = 0; n < num_samples; ++n)
+    {
+        auto y = push_and_filter (state, in[2 * n]);
+
+        // centre tap: the odd input sample from half_length samples ago
+        y += 0.5f * state.centre_delay[(size_t) state.centre_pos];
+        state.centre_delay[(size_t) state.centre_pos] = in[2 * n + 1];
+        state.centre_pos = (state.centre_pos + 1) % half_length;
+
+        out[n] = y;
+    }
+}
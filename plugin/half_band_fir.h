@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+/**
+ * Linear-phase 2x resampler, using a Kaiser-windowed half-band FIR filter.
+ *
+ * Every other tap of a half-band filter is zero (except for the centre tap),
+ * so the filter is run in polyphase form: when upsampling, every other output
+ * sample is just a delayed copy of the input, and when downsampling, only
+ * the even input samples need to go through the full filter.
+ */
+struct Half_Band_FIR
+{
+    static constexpr int half_length = 16;
+    static constexpr int num_taps = 4 * half_length - 1;
+    static constexpr int num_branch_taps = 2 * half_length; // non-zero taps, excluding the centre tap
+
+    /** Group delay of the filter at the higher sample rate. */
+    static constexpr int latency_samples = (num_taps - 1) / 2;
+
+    Half_Band_FIR();
+
+    void prepare (int num_channels);
+    void reset();
+
+    /** Writes 2 * num_samples samples to out. */
+    void upsample (const float* in, float* out, int num_samples, int channel) noexcept;
+
+    /** Reads 2 * num_samples samples from in. */
+    void downsample (const float* in, float* out, int num_samples, int channel) noexcept;
+
+private:
+    std::array<float, num_branch_taps> branch_coefs {};
+
+    struct Channel_State
+    {
+        // circular buffer, stored twice, so that we always have a contiguous window
+        std::array<float, 2 * num_branch_taps> history {};
+        int history_pos = 0;
+
+        // delay line for the centre tap (only used when downsampling)
+        std::array<float, half_length> centre_delay {};
+        int centre_pos = 0;
+    };
+    std::vector<Channel_State> states {};
+
+    float push_and_filter (Channel_State& state, float x) const noexcept;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Bounded multi-producer/multi-consumer queue (based on Dmitry Vyukov's design).
+ * Pushing and popping never allocate or block, so any thread (including the
+ * audio thread) can use it. If the queue is full, try_push() returns false.
+ */
+template <typename T, size_t capacity>
+struct Lock_Free_Queue
+{
+    static_assert (capacity >= 2 && (capacity & (capacity - 1)) == 0, "Capacity must be a power of two");
+
+    Lock_Free_Queue()
+    {
+        for (size_t i = 0; i < capacity; ++i)
+            cells[i].sequence.store (i, std::memory_order_relaxed);
+    }
+
+    bool try_push (const T& value) noexcept
+    {
+        auto pos = enqueue_pos.load (std::memory_order_relaxed);
+        while (true)
+        {
+            auto& cell = cells[pos & (capacity - 1)];
+            const auto sequence = cell.sequence.load (std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t> (sequence) - static_cast<std::ptrdiff_t> (pos);
+            if (diff == 0)
+            {
+                if (enqueue_pos.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store (pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = enqueue_pos.load (std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop (T& value) noexcept
+    {
+        auto pos = dequeue_pos.load (std::memory_order_relaxed);
+        while (true)
+        {
+            auto& cell = cells[pos & (capacity - 1)];
+            const auto sequence = cell.sequence.load (std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t> (sequence) - static_cast<std::ptrdiff_t> (pos + 1);
+            if (diff == 0)
+            {
+                if (dequeue_pos.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store (pos + capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // empty
+            }
+            else
+            {
+                pos = dequeue_pos.load (std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence {};
+        T value {};
+    };
+    std::array<Cell, capacity> cells {};
+
+    alignas (64) std::atomic<size_t> enqueue_pos { 0 };
+    alignas (64) std::atomic<size_t> dequeue_pos { 0 };
+};
+
+/**
+ * Bounded single-producer/single-consumer queue, for streaming blocks of
+ * data from one thread to another (e.g. from the audio thread to a
+ * background thread). Pushing and popping never allocate or block, and
+ * move as many elements as they can at once.
+ */
+template <typename T, size_t capacity>
+struct Spsc_Queue
+{
+    static_assert (capacity >= 2 && (capacity & (capacity - 1)) == 0, "Capacity must be a power of two");
+
+    /** Pushes up to num_values values (producer thread only), and returns the number that fit in the queue. */
+    size_t push (const T* values, size_t num_values) noexcept
+    {
+        const auto write_pos = write_index.load (std::memory_order_relaxed);
+        const auto read_pos = read_index.load (std::memory_order_acquire);
+        const auto num_to_push = std::min (num_values, capacity - (write_pos - read_pos));
+        for (size_t i = 0; i < num_to_push; ++i)
+            buffer[(write_pos + i) & (capacity - 1)] = values[i];
+
+        write_index.store (write_pos + num_to_push, std::memory_order_release);
+        return num_to_push;
+    }
+
+    /** Pops up to max_num_values values (consumer thread only), and returns the number that were popped. */
+    size_t pop (T* values, size_t max_num_values) noexcept
+    {
+        const auto read_pos = read_index.load (std::memory_order_relaxed);
+        const auto write_pos = write_index.load (std::memory_order_acquire);
+        const auto num_to_pop = std::min (max_num_values, write_pos - read_pos);
+        for (size_t i = 0; i < num_to_pop; ++i)
+            values[i] = buffer[(read_pos + i) & (capacity - 1)];
+
+        read_index.store (read_pos + num_to_pop, std::memory_order_release);
+        return num_to_pop;
+    }
+
+private:
+    std::array<T, capacity> buffer {};
+
+    alignas (64) std::atomic<size_t> write_index { 0 };
+    alignas (64) std::atomic<size_t> read_index { 0 };
+};
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <numeric>
+
+#include "lstm_interleaved_weights.h"
+
+Interleaved_LSTM_Weights Interleaved_LSTM_Weights::from_rtneural (const LSTM_Weights& weights)
+{
+    std::vector<int> unit_positions (static_cast<size_t> (weights.hidden_size));
+    std::iota (unit_positions.begin(), unit_positions.end(), 0);
+    return from_rtneural (weights, unit_positions);
+}
+
+Interleaved_LSTM_Weights Interleaved_LSTM_Weights::from_rtneural (const LSTM_Weights& weights, std::span<const int> unit_positions)
+{
+    Interleaved_LSTM_Weights interleaved {};
+    interleaved.hidden_size = static_cast<int> (unit_positions.size());
+    interleaved.dense_bias = weights.dense_bias();
+
+    const auto H = static_cast<size_t> (weights.hidden_size);
+    const auto num_units = unit_positions.size();
+    const auto slab_size = interleaved.slab_size();
+    const auto kernel = weights.kernel();
+    const auto recurrent = weights.recurrent();
+    const auto bias = weights.bias();
+    const auto dense = weights.dense();
+
+    interleaved.slabs.resize (num_units * slab_size);
+    interleaved.dense.reserve (num_units);
+    interleaved.units.reserve (num_units);
+    for (size_t k = 0; k < num_units; ++k)
+    {
+        const auto unit = static_cast<size_t> (unit_positions[k]);
+        auto* slab = interleaved.slabs.data() + k * slab_size;
+        for (size_t gate = 0; gate < 4; ++gate)
+        {
+            slab[gate] = kernel[gate * H + unit];
+            slab[4 + gate] = bias[gate * H + unit];
+            for (size_t j = 0; j < num_units; ++j)
+                slab[4 * (j + 2) + gate] = recurrent[static_cast<size_t> (unit_positions[j]) * 4 * H + gate * H + unit];
+        }
+
+        interleaved.dense.push_back (dense[unit]);
+        interleaved.units.push_back (weights.units[unit]);
+    }
+
+    return interleaved;
+}
+
+LSTM_Weights Interleaved_LSTM_Weights::to_rtneural() const
+{
+    LSTM_Weights weights {};
+    weights.hidden_size = hidden_size;
+    weights.data.resize (LSTM_Weights::num_weights (hidden_size));
+    weights.units = units;
+
+    const auto H = static_cast<size_t> (hidden_size);
+    auto kernel = weights.kernel();
+    auto recurrent = weights.recurrent();
+    auto bias = weights.bias();
+    for (size_t unit = 0; unit < H; ++unit)
+    {
+        const auto* slab = slabs.data() + unit * slab_size();
+        for (size_t gate = 0; gate < 4; ++gate)
+        {
+            kernel[gate * H + unit] = slab[gate];
+            bias[gate * H + unit] = slab[4 + gate];
+            for (size_t j = 0; j < H; ++j)
+                recurrent[j * 4 * H + gate * H + unit] = slab[4 * (j + 2) + gate];
+        }
+    }
+
+    std::copy (dense.begin(), dense.end(), weights.dense().begin());
+    weights.dense_bias() = dense_bias;
+    return weights;
+}
+
+void Interleaved_LSTM_Weights::remove_unit (int original_unit)
+{
+    const auto removed_iter = std::find (units.begin(), units.end(), original_unit);
+    assert (removed_iter != units.end());
+    const auto removed_position = static_cast<size_t> (std::distance (units.begin(), removed_iter));
+
+    const auto old_size = static_cast<size_t> (hidden_size);
+    const auto old_slab_size = slab_size();
+    --hidden_size;
+    const auto new_slab_size = slab_size();
+
+    // Everything moves towards the front, so we can compact the slabs in place.
+    // Each slab keeps the inputs either side of the removed unit's hidden state,
+    // and the padding (which may have shrunk) gets zeroed.
+    const auto removed_input = 4 * (removed_position + 2);
+    const auto old_inputs_end = 4 * (old_size + 2);
+    auto* dest = slabs.data();
+    for (size_t position = 0; position < old_size; ++position)
+    {
+        if (position == removed_position)
+            continue;
+
+        const auto* src = slabs.data() + position * old_slab_size;
+        std::memmove (dest, src, removed_input * sizeof (float));
+        std::memmove (dest + removed_input, src + removed_input + 4, (old_inputs_end - removed_input - 4) * sizeof (float));
+        std::fill (dest + old_inputs_end - 4, dest + new_slab_size, 0.0f);
+        dest += new_slab_size;
+    }
+
+    slabs.resize (static_cast<size_t> (hidden_size) * new_slab_size);
+    dense.erase (dense.begin() + (std::ptrdiff_t) removed_position);
+    units.erase (removed_iter);
+}
+
+void Interleaved_LSTM_Weights::copy_slabs (std::span<float> dest, int model_size) const
+{
+    assert (model_size >= hidden_size);
+    const auto model_slab_size = static_cast<size_t> (lstm_kernels::interleaved_slab_size (model_size));
+    assert (dest.size() == static_cast<size_t> (model_size) * model_slab_size);
+
+    // the inputs for the extra units come after ours, so each slab only needs zero-padding at the end
+    std::fill (dest.begin(), dest.end(), 0.0f);
+    const auto num_inputs = 4 * (static_cast<size_t> (hidden_size) + 2);
+    for (size_t position = 0; position < static_cast<size_t> (hidden_size); ++position)
+        std::copy_n (slabs.data() + position * slab_size(), num_inputs, dest.data() + position * model_slab_size);
+}
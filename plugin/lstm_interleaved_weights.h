@@ -0,0 +1,54 @@
+#pragma once
+
+#include "lstm_kernels.h"
+#include "lstm_weights.h"
+
+/**
+ * LSTM and dense weights in the gate-interleaved, unit-contiguous layout
+ * used by the interleaved SIMD kernel (see lstm_kernels::Interleaved_Weights_View):
+ *
+ * slabs [H][num_inputs][4] | dense [H] | dense bias
+ *
+ * where each unit's slab holds its kernel, bias, and recurrent weights,
+ * with the i/f/g/o gates interleaved.
+ *
+ * In the Keras/RTNeural layout of LSTM_Weights, a unit's weights are spread
+ * over the four gate blocks of the kernel, recurrent, and bias tensors, so
+ * removing it means erasing from 4 * (H + 2) places. Here, removing a unit
+ * drops its slab, along with its 4 (contiguous) recurrent weights from each
+ * of the other slabs, in a single pass over the weights.
+ */
+struct Interleaved_LSTM_Weights
+{
+    int hidden_size {};
+    std::vector<float> slabs {};
+    std::vector<float> dense {};
+    float dense_bias {};
+    std::vector<int> units {}; // indices of the surviving hidden units in the un-pruned model
+
+    /** Converts from the Keras/RTNeural ordering. */
+    static Interleaved_LSTM_Weights from_rtneural (const LSTM_Weights& weights);
+
+    /** Converts from the Keras/RTNeural ordering, keeping only the hidden units at the given positions. */
+    static Interleaved_LSTM_Weights from_rtneural (const LSTM_Weights& weights, std::span<const int> unit_positions);
+
+    /** Converts back to the Keras/RTNeural ordering. */
+    LSTM_Weights to_rtneural() const;
+
+    static Interleaved_LSTM_Weights from_json (const nlohmann::json& model_json) { return from_rtneural (LSTM_Weights::from_json (model_json)); }
+    nlohmann::json to_json() const { return to_rtneural().to_json(); }
+
+    size_t slab_size() const { return static_cast<size_t> (lstm_kernels::interleaved_slab_size (hidden_size)); }
+
+    /** Returns the weights that feed the hidden unit at the given position. */
+    std::span<const float> slab (int position) const { return { slabs.data() + static_cast<size_t> (position) * slab_size(), slab_size() }; }
+
+    /** Removes one hidden unit (indexed in the un-pruned model), in place. */
+    void remove_unit (int original_unit);
+
+    /**
+     * Copies the slabs into a model with the given number of units (i.e. LSTM_Layer::Weights::interleaved_slabs),
+     * which may be larger than this hidden size, in which case the extra inputs and units are zero-padded.
+     */
+    void copy_slabs (std::span<float> dest, int model_size) const;
+};
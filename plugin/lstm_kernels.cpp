@@ -0,0 +1,347 @@
+#include <RTNeural/RTNeural.h>
+#include <bit>
+#include <memory>
+#include <random>
+
+#include "lstm_kernels.h"
+
+#if NEURAL_PRUNING_X86_KERNELS && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace lstm_kernels
+{
+#if NEURAL_PRUNING_X86_KERNELS
+#if defined(_MSC_VER)
+static bool os_saves_registers (unsigned long long mask)
+{
+    int info[4] {};
+    __cpuid (info, 1);
+    const auto has_osxsave = (info[2] & (1 << 27)) != 0;
+    return has_osxsave && (_xgetbv (0) & mask) == mask;
+}
+
+static bool cpu_has_avx2()
+{
+    int info[4] {};
+    __cpuid (info, 1);
+    const auto has_fma = (info[2] & (1 << 12)) != 0;
+    const auto has_f16c = (info[2] & (1 << 29)) != 0;
+    __cpuidex (info, 7, 0);
+    const auto has_avx2 = (info[1] & (1 << 5)) != 0;
+    return has_fma && has_f16c && has_avx2 && os_saves_registers (0x6);
+}
+
+static bool cpu_has_avx512()
+{
+    int info[4] {};
+    __cpuidex (info, 7, 0);
+    const auto has_avx512f = (info[1] & (1 << 16)) != 0;
+    const auto has_avx512bw = (info[1] & (1 << 30)) != 0;
+    return has_avx512f && has_avx512bw && os_saves_registers (0xe6);
+}
+#else
+static bool cpu_has_avx2()
+{
+    return __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma") && __builtin_cpu_supports ("f16c");
+}
+
+static bool cpu_has_avx512()
+{
+    return __builtin_cpu_supports ("avx512f") && __builtin_cpu_supports ("avx512bw");
+}
+#endif
+#endif
+
+/** exp() for building constant tables, since std::exp() isn't constexpr. */
+static constexpr double constexpr_exp (double x)
+{
+    // exp(x) = exp(x / 2^k)^(2^k), where |x / 2^k| <= 1/2, so the Taylor series converges quickly
+    int k = 0;
+    while (x > 0.5 || x < -0.5)
+    {
+        x *= 0.5;
+        ++k;
+    }
+
+    auto sum = 1.0;
+    auto term = 1.0;
+    for (int n = 1; n < 24; ++n)
+    {
+        term *= x / (double) n;
+        sum += term;
+    }
+
+    for (; k > 0; --k)
+        sum *= sum;
+    return sum;
+}
+
+static constexpr Tanh_Table make_tanh_table()
+{
+    Tanh_Table table {};
+    for (int i = 0; i <= Tanh_Table::size; ++i)
+    {
+        const auto exp_2x = constexpr_exp (2.0 * ((double) i / (double) Tanh_Table::scale - (double) Tanh_Table::range));
+        table.values[(size_t) i] = (float) ((exp_2x - 1.0) / (exp_2x + 1.0));
+    }
+    for (int i = 0; i < Tanh_Table::size; ++i)
+        table.slopes[(size_t) i] = table.values[(size_t) i + 1] - table.values[(size_t) i];
+    return table;
+}
+
+// constant-initialized, since the kernels can run while other translation units are being
+// statically initialized (e.g. the self-checks in get_kernel())
+constinit const Tanh_Table tanh_table = make_tanh_table();
+
+const Kernel* get_kernel()
+{
+    static const Kernel* best_kernel = []() -> const Kernel*
+    {
+#if NEURAL_PRUNING_X86_KERNELS
+        if (cpu_has_avx512() && self_check (avx512_kernel))
+            return &avx512_kernel;
+        if (cpu_has_avx2() && self_check (avx2_kernel))
+            return &avx2_kernel;
+        if (self_check (sse_kernel))
+            return &sse_kernel;
+#endif
+        return nullptr;
+    }();
+    return best_kernel;
+}
+
+bool self_check (const Kernel& kernel)
+{
+    // deliberately not a multiple of the padding, so we exercise the padded lanes
+    static constexpr int hidden_size = 53;
+    static constexpr int Hp = padded_size (hidden_size);
+    static constexpr int num_samples = 256;
+
+    struct Packed_Data
+    {
+        alignas (64) std::array<float, 4 * Hp> kernel {};
+        alignas (64) std::array<float, 4 * Hp> bias {};
+        alignas (64) std::array<float, 4 * Hp * hidden_size> recurrent {};
+        alignas (64) std::array<float, Hp> h {};
+        alignas (64) std::array<float, Hp> c {};
+        alignas (64) std::array<float, 4 * Hp> gates {};
+        alignas (64) std::array<float, Hp * num_samples> hidden_out {};
+        alignas (64) std::array<float, hidden_size * interleaved_slab_size (hidden_size)> slabs {};
+    };
+    auto packed = std::make_unique<Packed_Data>();
+
+    std::minstd_rand rng { 0x5eed };
+    std::uniform_real_distribution<float> dist { -0.5f, 0.5f };
+
+    std::vector<std::vector<float>> kernel_weights (1, std::vector<float> (4 * hidden_size));
+    std::vector<std::vector<float>> recurrent_weights (hidden_size, std::vector<float> (4 * hidden_size));
+    std::vector<float> bias_weights (4 * hidden_size);
+    for (int gate = 0; gate < 4; ++gate)
+    {
+        for (int k = 0; k < hidden_size; ++k)
+        {
+            // the same weights also go into the interleaved layout (see interleaved_slab_size())
+            auto* slab = packed->slabs.data() + k * interleaved_slab_size (hidden_size);
+            kernel_weights[0][(size_t) (gate * hidden_size + k)] = packed->kernel[(size_t) (gate * Hp + k)] = slab[gate] = dist (rng);
+            bias_weights[(size_t) (gate * hidden_size + k)] = packed->bias[(size_t) (gate * Hp + k)] = slab[4 + gate] = dist (rng);
+            for (int j = 0; j < hidden_size; ++j)
+                recurrent_weights[(size_t) j][(size_t) (gate * hidden_size + k)] = packed->recurrent[(size_t) (j * 4 * Hp + gate * Hp + k)] = slab[4 * (j + 2) + gate] = dist (rng) / 4.0f;
+        }
+    }
+
+    auto reference = std::make_unique<RTNeural::LSTMLayerT<float, 1, hidden_size>>();
+    reference->setWVals (kernel_weights);
+    reference->setUVals (recurrent_weights);
+    reference->setBVals (bias_weights);
+    reference->reset();
+
+    std::array<float, num_samples> x {};
+    for (size_t n = 0; n < x.size(); ++n)
+        x[n] = 2.0f * std::sin (0.05f * (float) n) + dist (rng);
+
+    const auto weights = Packed_Weights_View {
+        .kernel = packed->kernel.data(),
+        .bias = packed->bias.data(),
+        .recurrent = packed->recurrent.data(),
+        .hidden_size = hidden_size,
+        .padded_size = Hp,
+    };
+    kernel.forward (weights, x.data(), num_samples, packed->h.data(), packed->c.data(), packed->gates.data(), packed->hidden_out.data());
+
+    float max_error = 0.0f;
+    for (int n = 0; n < num_samples; ++n)
+    {
+        Eigen::Matrix<float, 1, 1> in { x[(size_t) n] };
+        reference->forward (in);
+        for (int k = 0; k < hidden_size; ++k)
+            max_error = std::max (max_error, std::abs (reference->outs (k) - packed->hidden_out[(size_t) (n * Hp + k)]));
+        for (int k = hidden_size; k < Hp; ++k)
+            max_error = std::max (max_error, std::abs (packed->hidden_out[(size_t) (n * Hp + k)]));
+    }
+
+    if (max_error >= 1.0e-4f)
+        return false;
+
+    // the quantized kernels are checked against the float kernel, with a tolerance to match their precision
+    const std::vector<float> float_hidden_out (packed->hidden_out.begin(), packed->hidden_out.end());
+    const auto check_quantized = [&] (auto quantized_type, Kernel::Forward_Quantized forward_quantized, float tolerance)
+    {
+        using T = decltype (quantized_type);
+        std::vector<T> quantized_recurrent ((size_t) quantized_size (Hp));
+        alignas (64) std::array<float, 4 * Hp> row_scales {};
+        std::array<int32_t, Hp / 2> h_pairs {};
+        quantize_recurrent (packed->recurrent.data(), hidden_size, Hp, quantized_recurrent.data(), row_scales.data());
+
+        std::fill (packed->h.begin(), packed->h.end(), 0.0f);
+        std::fill (packed->c.begin(), packed->c.end(), 0.0f);
+        const auto quantized_weights = Quantized_Weights_View {
+            .kernel = packed->kernel.data(),
+            .bias = packed->bias.data(),
+            .recurrent = quantized_recurrent.data(),
+            .row_scales = row_scales.data(),
+            .hidden_size = hidden_size,
+            .padded_size = Hp,
+        };
+        forward_quantized (quantized_weights, x.data(), num_samples, packed->h.data(), packed->c.data(), packed->gates.data(), packed->hidden_out.data(), h_pairs.data());
+
+        auto quantized_error = 0.0f;
+        for (size_t i = 0; i < float_hidden_out.size(); ++i)
+            quantized_error = std::max (quantized_error, std::abs (float_hidden_out[i] - packed->hidden_out[i]));
+        return quantized_error < tolerance;
+    };
+
+    const auto check_half = [&] (Weight_Format format, Kernel::Forward_Half forward_half, float tolerance)
+    {
+        std::vector<uint16_t> half_recurrent (packed->recurrent.size());
+        convert_to_half (packed->recurrent.data(), (int) packed->recurrent.size(), half_recurrent.data(), format);
+
+        std::fill (packed->h.begin(), packed->h.end(), 0.0f);
+        std::fill (packed->c.begin(), packed->c.end(), 0.0f);
+        const auto half_weights = Half_Weights_View {
+            .kernel = packed->kernel.data(),
+            .bias = packed->bias.data(),
+            .recurrent = half_recurrent.data(),
+            .hidden_size = hidden_size,
+            .padded_size = Hp,
+        };
+        forward_half (half_weights, x.data(), num_samples, packed->h.data(), packed->c.data(), packed->gates.data(), packed->hidden_out.data());
+
+        auto half_error = 0.0f;
+        for (size_t i = 0; i < float_hidden_out.size(); ++i)
+            half_error = std::max (half_error, std::abs (float_hidden_out[i] - packed->hidden_out[i]));
+        return half_error < tolerance;
+    };
+
+    const auto check_interleaved = [&] (float tolerance)
+    {
+        alignas (64) std::array<float, interleaved_slab_size (hidden_size)> inputs {};
+
+        std::fill (packed->h.begin(), packed->h.end(), 0.0f);
+        std::fill (packed->c.begin(), packed->c.end(), 0.0f);
+        const auto interleaved_weights = Interleaved_Weights_View {
+            .slabs = packed->slabs.data(),
+            .hidden_size = hidden_size,
+            .padded_size = Hp,
+        };
+        kernel.forward_interleaved (interleaved_weights, x.data(), num_samples, packed->h.data(), packed->c.data(), packed->gates.data(), packed->hidden_out.data(), inputs.data());
+
+        auto interleaved_error = 0.0f;
+        for (size_t i = 0; i < float_hidden_out.size(); ++i)
+            interleaved_error = std::max (interleaved_error, std::abs (float_hidden_out[i] - packed->hidden_out[i]));
+        return interleaved_error < tolerance;
+    };
+
+    // the activation approximations are checked against the exact kernel, and against std::tanh()
+    const auto check_activation = [&] (Activation activation, float tolerance)
+    {
+        std::fill (packed->h.begin(), packed->h.end(), 0.0f);
+        std::fill (packed->c.begin(), packed->c.end(), 0.0f);
+        auto approx_weights = weights;
+        approx_weights.activation = activation;
+        kernel.forward (approx_weights, x.data(), num_samples, packed->h.data(), packed->c.data(), packed->gates.data(), packed->hidden_out.data());
+
+        auto activation_error = 0.0f;
+        for (size_t i = 0; i < float_hidden_out.size(); ++i)
+            activation_error = std::max (activation_error, std::abs (float_hidden_out[i] - packed->hidden_out[i]));
+
+        // re-use the gates buffer to check tanh() over [-8, 8]
+        auto& tanh_in = packed->gates;
+        alignas (64) std::array<float, 4 * Hp> tanh_out {};
+        for (size_t i = 0; i < tanh_in.size(); ++i)
+            tanh_in[i] = 16.0f * (float) i / (float) tanh_in.size() - 8.0f;
+        kernel.apply_tanh (tanh_in.data(), tanh_out.data(), (int) tanh_in.size(), activation);
+        for (size_t i = 0; i < tanh_in.size(); ++i)
+            activation_error = std::max (activation_error, std::abs (tanh_out[i] - std::tanh (tanh_in[i])));
+
+        return activation_error < tolerance;
+    };
+
+    return check_quantized (int16_t {}, kernel.forward_int16, 1.0e-2f)
+           && check_quantized (int8_t {}, kernel.forward_int8, 5.0e-2f)
+           && check_half (Weight_Format::Float16, kernel.forward_float16, 1.0e-2f)
+           && check_half (Weight_Format::BFloat16, kernel.forward_bfloat16, 5.0e-2f)
+           && check_interleaved (1.0e-4f)
+           && check_activation (Activation::Exact, 1.0e-4f)
+           && check_activation (Activation::Rational, 1.0e-3f)
+           && check_activation (Activation::Polynomial, 1.0e-2f)
+           && check_activation (Activation::Table, 1.0e-2f);
+}
+
+template <typename T>
+void quantize_recurrent (const float* recurrent, int hidden_size, int padded_size, T* quantized, float* row_scales)
+{
+    const auto num_rows = 4 * padded_size;
+    std::fill (quantized, quantized + quantized_size (padded_size), T {});
+    for (int r = 0; r < num_rows; ++r)
+    {
+        auto max_weight = 0.0f;
+        for (int j = 0; j < hidden_size; ++j)
+            max_weight = std::max (max_weight, std::abs (recurrent[j * num_rows + r]));
+
+        row_scales[r] = max_weight / (float) (Quantization<T>::weight_max * Quantization<T>::state_max);
+        if (max_weight == 0.0f)
+            continue;
+
+        const auto weight_scale = (float) Quantization<T>::weight_max / max_weight;
+        for (int j = 0; j < hidden_size; ++j)
+            quantized[((j / 2) * num_rows + r) * 2 + (j % 2)] = static_cast<T> (std::lrint (recurrent[j * num_rows + r] * weight_scale));
+    }
+}
+
+template void quantize_recurrent<int16_t> (const float*, int, int, int16_t*, float*);
+template void quantize_recurrent<int8_t> (const float*, int, int, int8_t*, float*);
+
+static uint16_t float_to_float16 (float x)
+{
+    const auto bits = std::bit_cast<uint32_t> (x);
+    const auto sign = (uint16_t) ((bits >> 16) & 0x8000);
+    const auto magnitude = std::abs (x);
+
+    // the weights should never get this big, but let's saturate rather than overflow to infinity
+    if (! (magnitude < 65520.0f))
+        return sign | 0x7bff;
+
+    // below the smallest normal fp16, so round to a multiple of the denormal step (2^-24)
+    if (magnitude < 6.103515625e-5f)
+        return sign | (uint16_t) std::lrint (magnitude * 16777216.0f);
+
+    // re-bias the exponent, and round the mantissa to 10 bits (to nearest, ties to even)
+    const auto magnitude_bits = (bits & 0x7fffffff) - ((127 - 15) << 23);
+    const auto rounded = magnitude_bits + 0xfff + ((magnitude_bits >> 13) & 1);
+    return sign | (uint16_t) (rounded >> 13);
+}
+
+static uint16_t float_to_bfloat16 (float x)
+{
+    // round to the top 16 bits (to nearest, ties to even)
+    const auto bits = std::bit_cast<uint32_t> (x);
+    return (uint16_t) ((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+void convert_to_half (const float* recurrent, int size, uint16_t* half_recurrent, Weight_Format format)
+{
+    for (int i = 0; i < size; ++i)
+        half_recurrent[i] = format == Weight_Format::Float16 ? float_to_float16 (recurrent[i]) : float_to_bfloat16 (recurrent[i]);
+}
+} // namespace lstm_kernels
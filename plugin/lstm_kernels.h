@@ -0,0 +1,289 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/**
+ * Hand-specialized SIMD kernels for the LSTM recurrence.
+ *
+ * The kernels work on "packed" weights, where each i/f/g/o gate block is
+ * padded to a multiple of `padding` floats. The recurrent weights are
+ * stored column-major ([hidden_size][4 * padded_size]), so each step
+ * streams through them once in a single fused matvec for all four gates.
+ * All the packed arrays must be 64-byte aligned, and the padding rows
+ * must be zero, which keeps the padded units' state at zero as well.
+ *
+ * The recurrent weights can also be quantized to 12-bit (stored as int16)
+ * or int8 (see Quantized_Weights_View), in which case the recurrent matvec runs on
+ * integer dot products with int32 accumulation, and then gets scaled back
+ * to floating-point for the gate activations.
+ *
+ * Or, the recurrent weights can be stored as 16-bit floats (fp16 or bf16,
+ * see Half_Weights_View), which get widened to fp32 as they're loaded,
+ * so the state and the accumulation stay in fp32.
+ *
+ * Or, the fp32 weights can be stored unit-by-unit, with each unit's i/f/g/o
+ * gates interleaved (see Interleaved_Weights_View), so that the kernel
+ * streams through them strictly in order.
+ *
+ * The gate non-linearities can be computed exactly, or with one of the
+ * faster approximations (see Activation), which can be a significant
+ * share of the per-sample cost for the smaller (pruned) models.
+ *
+ * The best kernel for the running CPU is chosen at runtime, so a single
+ * binary can use AVX-512, AVX2/FMA, or SSE2 as appropriate.
+ */
+
+/** How the recurrent weights are stored for the SIMD kernels */
+enum class Weight_Format
+{
+    Float32 = 1,
+    Int12 = 2, // 12-bit weights, stored as int16 (see Quantization<int16_t>)
+    Int8 = 4,
+    Float16 = 8,
+    BFloat16 = 16,
+    Interleaved = 32, // fp32, with all the weights for each hidden unit stored contiguously
+};
+
+/** How the kernels compute the sigmoid and tanh activations */
+enum class Activation
+{
+    Exact = 1, // Cephes-style exp(), accurate to about 1 ulp
+    Rational = 2, // rational approximation of tanh (same as Eigen's), accurate to a few ulp
+    Polynomial = 4, // exp() with a cubic approximation of 2^x, accurate to about 1e-4
+    Table = 8, // lookup table of tanh, with linear interpolation, accurate to about 2e-5
+};
+
+namespace lstm_kernels
+{
+// (the helpers here are static, so that the kernels' translation units, which are
+// compiled for other instruction sets, can't emit a copy that's shared with the
+// rest of the program, see lstm_kernels_impl.h)
+static constexpr int padding = 16;
+
+static constexpr int padded_size (int hidden_size)
+{
+    return (hidden_size + padding - 1) / padding * padding;
+}
+
+/** Allocates 64-byte aligned memory, for packed arrays that are stored on the heap. */
+template <typename T>
+struct Aligned_Allocator
+{
+    using value_type = T;
+    static constexpr std::align_val_t alignment { 64 };
+
+    Aligned_Allocator() = default;
+    template <typename U>
+    Aligned_Allocator (const Aligned_Allocator<U>&) noexcept
+    {
+    }
+
+    T* allocate (size_t n) { return static_cast<T*> (::operator new (n * sizeof (T), alignment)); }
+    void deallocate (T* p, size_t) noexcept { ::operator delete (p, alignment); }
+
+    template <typename U>
+    bool operator== (const Aligned_Allocator<U>&) const noexcept
+    {
+        return true;
+    }
+};
+
+struct Packed_Weights_View
+{
+    const float* kernel {}; // [4 * padded_size]
+    const float* bias {}; // [4 * padded_size]
+    const float* recurrent {}; // [hidden_size][4 * padded_size]
+    int hidden_size {};
+    int padded_size {};
+    Activation activation = Activation::Exact;
+};
+
+/** Samples of tanh() for Activation::Table, along with the slope to the next sample (for the interpolation). */
+struct Tanh_Table
+{
+    static constexpr float range = 6.0f; // tanh(6) is within 2e-5 of 1
+    static constexpr int size = 1024;
+    static constexpr float scale = (float) size / (2.0f * range);
+
+    // (plain arrays, so the kernels can use them without calling any inline functions, see lstm_kernels_impl.h)
+    alignas (64) float values[size + 1] {};
+    alignas (64) float slopes[size + 1] {};
+};
+extern const Tanh_Table tanh_table;
+
+/**
+ * The quantized recurrent weights are stored in pairs of columns
+ * ([padded_size / 2][4 * padded_size][2]), so that the products for two
+ * hidden units can be summed into an int32 in one instruction (pmaddwd).
+ * Each row has its own scale, and the hidden state gets quantized with
+ * a fixed scale (since it's always in [-1, 1]).
+ *
+ * To make sure that the int32 accumulators can't overflow with up to 128
+ * hidden units, every product has to fit in 24 bits, so int8 weights go
+ * with a 15-bit hidden state, and int16 weights are limited to 12 bits
+ * (as is the hidden state).
+ */
+template <typename T>
+struct Quantization;
+
+template <>
+struct Quantization<int16_t>
+{
+    static constexpr int weight_max = 2047;
+    static constexpr int state_max = 2047;
+};
+
+template <>
+struct Quantization<int8_t>
+{
+    static constexpr int weight_max = 127;
+    static constexpr int state_max = 32767;
+};
+
+static constexpr int quantized_size (int padded_size)
+{
+    return 4 * padded_size * padded_size;
+}
+
+struct Quantized_Weights_View
+{
+    const float* kernel {}; // [4 * padded_size]
+    const float* bias {}; // [4 * padded_size]
+    const void* recurrent {}; // int16 or int8: [padded_size / 2][4 * padded_size][2]
+    const float* row_scales {}; // [4 * padded_size] (including the hidden state scale)
+    int hidden_size {};
+    int padded_size {};
+    Activation activation = Activation::Exact;
+};
+
+/** Quantizes a set of packed recurrent weights, and computes the scale for each row. */
+template <typename T>
+void quantize_recurrent (const float* recurrent, int hidden_size, int padded_size, T* quantized, float* row_scales);
+
+/**
+ * Same layout as Packed_Weights_View, but with the recurrent weights
+ * stored as fp16 or bf16 bit patterns.
+ */
+struct Half_Weights_View
+{
+    const float* kernel {}; // [4 * padded_size]
+    const float* bias {}; // [4 * padded_size]
+    const uint16_t* recurrent {}; // [hidden_size][4 * padded_size]
+    int hidden_size {};
+    int padded_size {};
+    Activation activation = Activation::Exact;
+};
+
+/** Converts a set of packed recurrent weights to fp16 or bf16, rounding to the nearest value. */
+void convert_to_half (const float* recurrent, int size, uint16_t* half_recurrent, Weight_Format format);
+
+/**
+ * In the interleaved layout, all the weights that feed one hidden unit are
+ * stored together in a "slab" ([num_inputs][4], with the gates ordered
+ * i/f/g/o), where the inputs are { x, 1, h[0], ..., h[hidden_size - 1] },
+ * zero-padded to a multiple of 4 inputs (so every slab is a multiple of
+ * 64 bytes). The first two rows of each slab are the unit's kernel and bias.
+ *
+ * Each unit's gates are then a single dot product between its slab and the
+ * inputs (with each input repeated for the 4 gates), so the kernel reads
+ * the slabs in order, and removing a unit removes one contiguous slab
+ * (see Interleaved_LSTM_Weights, which builds and prunes the slabs).
+ */
+static constexpr int interleaved_num_inputs (int hidden_size)
+{
+    return (hidden_size + 2 + 3) / 4 * 4;
+}
+
+static constexpr int interleaved_slab_size (int hidden_size)
+{
+    return 4 * interleaved_num_inputs (hidden_size);
+}
+
+struct Interleaved_Weights_View
+{
+    const float* slabs {}; // [hidden_size][interleaved_num_inputs (hidden_size)][4]
+    int hidden_size {};
+    int padded_size {};
+    Activation activation = Activation::Exact;
+};
+
+struct Kernel
+{
+    const char* name {};
+
+    /**
+     * Runs the LSTM over a block of samples, updating the hidden and cell
+     * states (h, c: [padded_size]) and writing each hidden state to
+     * hidden_out ([num_samples][padded_size]). The gates buffer is used as
+     * scratch space ([4 * padded_size]).
+     */
+    void (*forward) (const Packed_Weights_View& weights,
+                     const float* x,
+                     int num_samples,
+                     float* h,
+                     float* c,
+                     float* gates,
+                     float* hidden_out) noexcept {};
+
+    /**
+     * Same as forward(), but with quantized recurrent weights. The quantized
+     * hidden state is kept in h_pairs ([padded_size / 2]) as scratch space.
+     */
+    using Forward_Quantized = void (*) (const Quantized_Weights_View& weights,
+                                        const float* x,
+                                        int num_samples,
+                                        float* h,
+                                        float* c,
+                                        float* gates,
+                                        float* hidden_out,
+                                        int32_t* h_pairs) noexcept;
+    Forward_Quantized forward_int16 {};
+    Forward_Quantized forward_int8 {};
+
+    /** Same as forward(), but with fp16 or bf16 recurrent weights. */
+    using Forward_Half = void (*) (const Half_Weights_View& weights,
+                                   const float* x,
+                                   int num_samples,
+                                   float* h,
+                                   float* c,
+                                   float* gates,
+                                   float* hidden_out) noexcept;
+    Forward_Half forward_float16 {};
+    Forward_Half forward_bfloat16 {};
+
+    /**
+     * Same as forward(), but with the weights in the interleaved layout. The
+     * inputs (repeated for each gate) are kept in inputs ([interleaved_slab_size (hidden_size)])
+     * as scratch space.
+     */
+    void (*forward_interleaved) (const Interleaved_Weights_View& weights,
+                                 const float* x,
+                                 int num_samples,
+                                 float* h,
+                                 float* c,
+                                 float* gates,
+                                 float* hidden_out,
+                                 float* inputs) noexcept {};
+
+    /**
+     * Applies tanh() to an array, e.g. for the activations in a conv. network.
+     * The size must be a multiple of `padding`, and the arrays must be 64-byte aligned.
+     */
+    void (*apply_tanh) (const float* x, float* y, int size, Activation activation) noexcept {};
+};
+
+/** Returns the best kernel supported by this CPU (that passes the self-check), or nullptr if none are available. */
+const Kernel* get_kernel();
+
+/** Checks a kernel against RTNeural's reference LSTM implementation. */
+bool self_check (const Kernel& kernel);
+
+#if NEURAL_PRUNING_X86_KERNELS
+extern const Kernel sse_kernel;
+extern const Kernel avx2_kernel;
+extern const Kernel avx512_kernel;
+#endif
+} // namespace lstm_kernels
@@ -0,0 +1,75 @@
+#include "lstm_kernels_impl.h"
+
+#if NEURAL_PRUNING_X86_KERNELS
+#include <immintrin.h>
+
+namespace lstm_kernels
+{
+namespace
+{
+struct Vec_AVX2
+{
+    using V = __m256;
+    static constexpr int width = 8;
+
+    static V load (const float* p) noexcept { return _mm256_load_ps (p); }
+    static V loadu (const float* p) noexcept { return _mm256_loadu_ps (p); }
+    static void store (float* p, V x) noexcept { _mm256_store_ps (p, x); }
+    static V set1 (float x) noexcept { return _mm256_set1_ps (x); }
+    static V add (V a, V b) noexcept { return _mm256_add_ps (a, b); }
+    static V sub (V a, V b) noexcept { return _mm256_sub_ps (a, b); }
+    static V mul (V a, V b) noexcept { return _mm256_mul_ps (a, b); }
+    static V div (V a, V b) noexcept { return _mm256_div_ps (a, b); }
+    static V fmadd (V a, V b, V c) noexcept { return _mm256_fmadd_ps (a, b, c); }
+    static V min (V a, V b) noexcept { return _mm256_min_ps (a, b); }
+    static V max (V a, V b) noexcept { return _mm256_max_ps (a, b); }
+    static V floor (V x) noexcept { return _mm256_floor_ps (x); }
+
+    static void store_gate_sums (float* gates, int Hp, V u0, V u1, V u2, V u3) noexcept
+    {
+        const auto sum_lanes = [] (V x)
+        { return _mm_add_ps (_mm256_castps256_ps128 (x), _mm256_extractf128_ps (x, 1)); };
+        auto i = sum_lanes (u0), f = sum_lanes (u1), g = sum_lanes (u2), o = sum_lanes (u3);
+        _MM_TRANSPOSE4_PS (i, f, g, o);
+        _mm_storeu_ps (gates, i);
+        _mm_storeu_ps (gates + Hp, f);
+        _mm_storeu_ps (gates + 2 * Hp, g);
+        _mm_storeu_ps (gates + 3 * Hp, o);
+    }
+
+    static V pow2n (V n) noexcept
+    {
+        return _mm256_castsi256_ps (_mm256_slli_epi32 (_mm256_add_epi32 (_mm256_cvtps_epi32 (n), _mm256_set1_epi32 (127)), 23));
+    }
+
+    using VI = __m256i;
+    static VI zero_i() noexcept { return _mm256_setzero_si256(); }
+    static VI set1_i32 (int32_t x) noexcept { return _mm256_set1_epi32 (x); }
+    static VI load_pairs (const int16_t* p) noexcept { return _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (p)); }
+    static VI load_pairs (const int8_t* p) noexcept { return _mm256_cvtepi8_epi16 (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (p))); }
+    static VI madd_pairs (VI w, VI h_pair, VI acc) noexcept { return _mm256_add_epi32 (acc, _mm256_madd_epi16 (w, h_pair)); }
+    static V to_float (VI x) noexcept { return _mm256_cvtepi32_ps (x); }
+    static VI truncate (V x) noexcept { return _mm256_cvttps_epi32 (x); }
+    static V gather (const float* table, VI index) noexcept { return _mm256_i32gather_ps (table, index, 4); }
+
+    // fp16 conversions need F16C (which every CPU with AVX2 has), and bf16 is just the top half of an fp32
+    static V load_float16 (const uint16_t* p) noexcept { return _mm256_cvtph_ps (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (p))); }
+    static V load_bfloat16 (const uint16_t* p) noexcept
+    {
+        return _mm256_castsi256_ps (_mm256_slli_epi32 (_mm256_cvtepu16_epi32 (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (p))), 16));
+    }
+};
+} // namespace
+
+const Kernel avx2_kernel {
+    "AVX2",
+    &Kernel_Impl<Vec_AVX2>::forward,
+    &Kernel_Impl<Vec_AVX2>::forward_quantized<int16_t>,
+    &Kernel_Impl<Vec_AVX2>::forward_quantized<int8_t>,
+    &Kernel_Impl<Vec_AVX2>::forward_half<Weight_Format::Float16>,
+    &Kernel_Impl<Vec_AVX2>::forward_half<Weight_Format::BFloat16>,
+    &Kernel_Impl<Vec_AVX2>::forward_interleaved,
+    &Kernel_Impl<Vec_AVX2>::apply_tanh,
+};
+} // namespace lstm_kernels
+#endif
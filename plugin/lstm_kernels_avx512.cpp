@@ -0,0 +1,78 @@
+#include "lstm_kernels_impl.h"
+
+#if NEURAL_PRUNING_X86_KERNELS
+#include <immintrin.h>
+
+namespace lstm_kernels
+{
+namespace
+{
+struct Vec_AVX512
+{
+    using V = __m512;
+    static constexpr int width = 16;
+
+    static V load (const float* p) noexcept { return _mm512_load_ps (p); }
+    static V loadu (const float* p) noexcept { return _mm512_loadu_ps (p); }
+    static void store (float* p, V x) noexcept { _mm512_store_ps (p, x); }
+    static V set1 (float x) noexcept { return _mm512_set1_ps (x); }
+    static V add (V a, V b) noexcept { return _mm512_add_ps (a, b); }
+    static V sub (V a, V b) noexcept { return _mm512_sub_ps (a, b); }
+    static V mul (V a, V b) noexcept { return _mm512_mul_ps (a, b); }
+    static V div (V a, V b) noexcept { return _mm512_div_ps (a, b); }
+    static V fmadd (V a, V b, V c) noexcept { return _mm512_fmadd_ps (a, b, c); }
+    static V min (V a, V b) noexcept { return _mm512_min_ps (a, b); }
+    static V max (V a, V b) noexcept { return _mm512_max_ps (a, b); }
+    static V floor (V x) noexcept { return _mm512_roundscale_ps (x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+    static void store_gate_sums (float* gates, int Hp, V u0, V u1, V u2, V u3) noexcept
+    {
+        const auto sum_lanes = [] (V x)
+        {
+            const auto halves = _mm256_add_ps (_mm512_castps512_ps256 (x), _mm256_castpd_ps (_mm512_extractf64x4_pd (_mm512_castps_pd (x), 1)));
+            return _mm_add_ps (_mm256_castps256_ps128 (halves), _mm256_extractf128_ps (halves, 1));
+        };
+        auto i = sum_lanes (u0), f = sum_lanes (u1), g = sum_lanes (u2), o = sum_lanes (u3);
+        _MM_TRANSPOSE4_PS (i, f, g, o);
+        _mm_storeu_ps (gates, i);
+        _mm_storeu_ps (gates + Hp, f);
+        _mm_storeu_ps (gates + 2 * Hp, g);
+        _mm_storeu_ps (gates + 3 * Hp, o);
+    }
+
+    static V pow2n (V n) noexcept
+    {
+        return _mm512_castsi512_ps (_mm512_slli_epi32 (_mm512_add_epi32 (_mm512_cvtps_epi32 (n), _mm512_set1_epi32 (127)), 23));
+    }
+
+    // the 16-bit integer instructions need AVX-512BW
+    using VI = __m512i;
+    static VI zero_i() noexcept { return _mm512_setzero_si512(); }
+    static VI set1_i32 (int32_t x) noexcept { return _mm512_set1_epi32 (x); }
+    static VI load_pairs (const int16_t* p) noexcept { return _mm512_loadu_si512 (p); }
+    static VI load_pairs (const int8_t* p) noexcept { return _mm512_cvtepi8_epi16 (_mm256_loadu_si256 (reinterpret_cast<const __m256i*> (p))); }
+    static VI madd_pairs (VI w, VI h_pair, VI acc) noexcept { return _mm512_add_epi32 (acc, _mm512_madd_epi16 (w, h_pair)); }
+    static V to_float (VI x) noexcept { return _mm512_cvtepi32_ps (x); }
+    static VI truncate (V x) noexcept { return _mm512_cvttps_epi32 (x); }
+    static V gather (const float* table, VI index) noexcept { return _mm512_i32gather_ps (index, table, 4); }
+
+    static V load_float16 (const uint16_t* p) noexcept { return _mm512_cvtph_ps (_mm256_loadu_si256 (reinterpret_cast<const __m256i*> (p))); }
+    static V load_bfloat16 (const uint16_t* p) noexcept
+    {
+        return _mm512_castsi512_ps (_mm512_slli_epi32 (_mm512_cvtepu16_epi32 (_mm256_loadu_si256 (reinterpret_cast<const __m256i*> (p))), 16));
+    }
+};
+} // namespace
+
+const Kernel avx512_kernel {
+    "AVX-512",
+    &Kernel_Impl<Vec_AVX512>::forward,
+    &Kernel_Impl<Vec_AVX512>::forward_quantized<int16_t>,
+    &Kernel_Impl<Vec_AVX512>::forward_quantized<int8_t>,
+    &Kernel_Impl<Vec_AVX512>::forward_half<Weight_Format::Float16>,
+    &Kernel_Impl<Vec_AVX512>::forward_half<Weight_Format::BFloat16>,
+    &Kernel_Impl<Vec_AVX512>::forward_interleaved,
+    &Kernel_Impl<Vec_AVX512>::apply_tanh,
+};
+} // namespace lstm_kernels
+#endif
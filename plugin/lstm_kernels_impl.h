@@ -0,0 +1,453 @@
+#pragma once
+
+#include <math.h>
+#include <type_traits>
+
+#include "lstm_kernels.h"
+
+/**
+ * Generic implementation of the LSTM kernels. Each instruction set provides
+ * a `Vec` struct wrapping its intrinsics (float vectors `V`, int32
+ * vectors `VI` for the quantized kernels and the table lookups, loads
+ * that widen fp16/bf16 weights to `V`, and a reduction of the interleaved
+ * gates), and the translation unit for that instruction set is compiled
+ * with the matching compiler flags.
+ *
+ * Everything here has internal linkage. Any inline function that one of the
+ * instruction set translation units emits (e.g. in a debug or LTO build)
+ * would otherwise be a weak symbol that the linker could pick for the whole
+ * binary, so an AVX-512 copy of, say, std::fill() could end up running on a
+ * CPU without AVX-512. For the same reason, the kernels don't call into the
+ * standard library's templates, and use the helpers below instead.
+ */
+namespace lstm_kernels
+{
+namespace
+{
+    void fill (float* begin, float* end, float value) noexcept
+    {
+        for (auto* p = begin; p < end; ++p)
+            *p = value;
+    }
+
+    int min (int a, int b) noexcept
+    {
+        return a < b ? a : b;
+    }
+
+    // (lrintf() is the C library's, so it's not compiled with our flags)
+    int round_to_int (float x) noexcept
+    {
+        return (int) lrintf (x);
+    }
+} // namespace
+
+namespace
+{
+template <typename Vec>
+struct Kernel_Impl
+{
+    using V = typename Vec::V;
+
+    // Cephes-style exp(), accurate to about 1 ulp over the clamped range
+    static V exp (V x) noexcept
+    {
+        x = Vec::min (Vec::max (x, Vec::set1 (-88.3762626647949f)), Vec::set1 (88.3762626647949f));
+        const auto n = Vec::floor (Vec::fmadd (x, Vec::set1 (1.44269504088896341f), Vec::set1 (0.5f)));
+        x = Vec::fmadd (n, Vec::set1 (-0.693359375f), x);
+        x = Vec::fmadd (n, Vec::set1 (2.12194440e-4f), x);
+
+        auto p = Vec::set1 (1.9875691500e-4f);
+        p = Vec::fmadd (p, x, Vec::set1 (1.3981999507e-3f));
+        p = Vec::fmadd (p, x, Vec::set1 (8.3334519073e-3f));
+        p = Vec::fmadd (p, x, Vec::set1 (4.1665795894e-2f));
+        p = Vec::fmadd (p, x, Vec::set1 (1.6666665459e-1f));
+        p = Vec::fmadd (p, x, Vec::set1 (5.0000001201e-1f));
+        p = Vec::fmadd (p, Vec::mul (x, x), Vec::add (x, Vec::set1 (1.0f)));
+
+        return Vec::mul (p, Vec::pow2n (n));
+    }
+
+    // exp() with a cubic (minimax) approximation of 2^x, accurate to about 1e-4
+    static V exp_polynomial (V x) noexcept
+    {
+        x = Vec::min (Vec::max (x, Vec::set1 (-87.0f)), Vec::set1 (87.0f));
+        const auto y = Vec::mul (x, Vec::set1 (1.44269504088896341f));
+        const auto n = Vec::floor (y);
+        const auto f = Vec::sub (y, n);
+
+        auto p = Vec::set1 (7.80246616e-2f);
+        p = Vec::fmadd (p, f, Vec::set1 (2.26067593e-1f));
+        p = Vec::fmadd (p, f, Vec::set1 (6.95833032e-1f));
+        p = Vec::fmadd (p, f, Vec::set1 (9.99925308e-1f));
+
+        return Vec::mul (p, Vec::pow2n (n));
+    }
+
+    // rational (13/6) approximation of tanh(), from Eigen's generic_fast_tanh_float()
+    static V tanh_rational (V x) noexcept
+    {
+        x = Vec::min (Vec::max (x, Vec::set1 (-7.90531110763549805f)), Vec::set1 (7.90531110763549805f));
+        const auto x2 = Vec::mul (x, x);
+
+        auto p = Vec::set1 (-2.76076847742355e-16f);
+        p = Vec::fmadd (p, x2, Vec::set1 (2.00018790482477e-13f));
+        p = Vec::fmadd (p, x2, Vec::set1 (-8.60467152213735e-11f));
+        p = Vec::fmadd (p, x2, Vec::set1 (5.12229709037114e-08f));
+        p = Vec::fmadd (p, x2, Vec::set1 (1.48572235717979e-05f));
+        p = Vec::fmadd (p, x2, Vec::set1 (6.37261928875436e-04f));
+        p = Vec::fmadd (p, x2, Vec::set1 (4.89352455891786e-03f));
+
+        auto q = Vec::set1 (1.19825839466702e-06f);
+        q = Vec::fmadd (q, x2, Vec::set1 (1.18534705686654e-04f));
+        q = Vec::fmadd (q, x2, Vec::set1 (2.26843463243900e-03f));
+        q = Vec::fmadd (q, x2, Vec::set1 (4.89352518554385e-03f));
+
+        return Vec::div (Vec::mul (x, p), q);
+    }
+
+    // tanh() from the lookup table, with linear interpolation
+    static V tanh_lookup (V x) noexcept
+    {
+        const auto range = Vec::set1 (Tanh_Table::range);
+        x = Vec::min (Vec::max (x, Vec::sub (Vec::set1 (0.0f), range)), range);
+        const auto position = Vec::mul (Vec::add (x, range), Vec::set1 (Tanh_Table::scale));
+        const auto index = Vec::truncate (position);
+        const auto fraction = Vec::sub (position, Vec::to_float (index));
+        return Vec::fmadd (Vec::gather (tanh_table.slopes, index), fraction, Vec::gather (tanh_table.values, index));
+    }
+
+    template <Activation activation = Activation::Exact>
+    static V sigmoid (V x) noexcept
+    {
+        if constexpr (activation == Activation::Exact || activation == Activation::Polynomial)
+        {
+            const auto one = Vec::set1 (1.0f);
+            const auto minus_x = Vec::sub (Vec::set1 (0.0f), x);
+            const auto exp_minus_x = activation == Activation::Exact ? exp (minus_x) : exp_polynomial (minus_x);
+            return Vec::div (one, Vec::add (one, exp_minus_x));
+        }
+        else
+        {
+            // sigmoid(x) = (tanh(x / 2) + 1) / 2
+            const auto half = Vec::set1 (0.5f);
+            return Vec::fmadd (tanh<activation> (Vec::mul (half, x)), half, half);
+        }
+    }
+
+    template <Activation activation = Activation::Exact>
+    static V tanh (V x) noexcept
+    {
+        if constexpr (activation == Activation::Rational)
+        {
+            return tanh_rational (x);
+        }
+        else if constexpr (activation == Activation::Table)
+        {
+            return tanh_lookup (x);
+        }
+        else
+        {
+            // tanh(x) = 2 * sigmoid(2x) - 1
+            const auto two = Vec::set1 (2.0f);
+            return Vec::sub (Vec::mul (two, sigmoid<activation> (Vec::mul (two, x))), Vec::set1 (1.0f));
+        }
+    }
+
+    /** Calls the callback with the activation as a compile-time constant (i.e. a std::integral_constant) */
+    template <typename Callback>
+    static void with_activation (Activation activation, Callback&& callback) noexcept
+    {
+        switch (activation)
+        {
+            case Activation::Rational:
+                return callback (std::integral_constant<Activation, Activation::Rational> {});
+            case Activation::Polynomial:
+                return callback (std::integral_constant<Activation, Activation::Polynomial> {});
+            case Activation::Table:
+                return callback (std::integral_constant<Activation, Activation::Table> {});
+            case Activation::Exact:
+            default:
+                return callback (std::integral_constant<Activation, Activation::Exact> {});
+        }
+    }
+
+    static void apply_tanh (const float* x, float* y, int size, Activation activation) noexcept
+    {
+        with_activation (activation,
+                         [=] (auto activation_constant)
+                         {
+                             for (int k = 0; k < size; k += Vec::width)
+                                 Vec::store (y + k, tanh<decltype (activation_constant)::value> (Vec::load (x + k)));
+                         });
+    }
+
+    static void forward (const Packed_Weights_View& weights,
+                         const float* x,
+                         int num_samples,
+                         float* h,
+                         float* c,
+                         float* gates,
+                         float* hidden_out) noexcept
+    {
+        forward_impl (weights, x, num_samples, h, c, gates, hidden_out, [] (const float* p)
+                      { return Vec::load (p); });
+    }
+
+    template <Weight_Format format>
+    static void forward_half (const Half_Weights_View& weights,
+                              const float* x,
+                              int num_samples,
+                              float* h,
+                              float* c,
+                              float* gates,
+                              float* hidden_out) noexcept
+    {
+        static_assert (format == Weight_Format::Float16 || format == Weight_Format::BFloat16);
+        forward_impl (weights, x, num_samples, h, c, gates, hidden_out, [] (const uint16_t* p)
+                      {
+                          if constexpr (format == Weight_Format::Float16)
+                              return Vec::load_float16 (p);
+                          else
+                              return Vec::load_bfloat16 (p);
+                      });
+    }
+
+    template <typename T>
+    static void forward_quantized (const Quantized_Weights_View& weights,
+                                   const float* x,
+                                   int num_samples,
+                                   float* h,
+                                   float* c,
+                                   float* gates,
+                                   float* hidden_out,
+                                   int32_t* h_pairs) noexcept
+    {
+        static constexpr int W = Vec::width;
+        const auto Hp = weights.padded_size;
+        const auto num_rows = 4 * Hp;
+        const auto num_pairs = (weights.hidden_size + 1) / 2;
+        const auto* recurrent = static_cast<const T*> (weights.recurrent);
+
+        quantize_state<T> (h, h_pairs, num_pairs);
+        for (int n = 0; n < num_samples; ++n)
+        {
+            // Same as the float kernel, except that the recurrent matvec is an
+            // integer dot product over pairs of columns, which then gets scaled
+            // back to float and added to the input projection.
+            const auto x_n = Vec::set1 (x[n]);
+            for (int r = 0; r < num_rows; r += 4 * W)
+            {
+                auto acc0 = Vec::zero_i();
+                auto acc1 = Vec::zero_i();
+                auto acc2 = Vec::zero_i();
+                auto acc3 = Vec::zero_i();
+
+                const auto* column_pair = recurrent + 2 * r;
+                for (int p = 0; p < num_pairs; ++p, column_pair += 2 * num_rows)
+                {
+                    const auto h_pair = Vec::set1_i32 (h_pairs[p]);
+                    acc0 = Vec::madd_pairs (Vec::load_pairs (column_pair), h_pair, acc0);
+                    acc1 = Vec::madd_pairs (Vec::load_pairs (column_pair + 2 * W), h_pair, acc1);
+                    acc2 = Vec::madd_pairs (Vec::load_pairs (column_pair + 4 * W), h_pair, acc2);
+                    acc3 = Vec::madd_pairs (Vec::load_pairs (column_pair + 6 * W), h_pair, acc3);
+                }
+
+                const auto dequantize = [&] (auto acc, int row)
+                {
+                    const auto input_projection = Vec::fmadd (Vec::load (weights.kernel + row), x_n, Vec::load (weights.bias + row));
+                    Vec::store (gates + row, Vec::fmadd (Vec::to_float (acc), Vec::load (weights.row_scales + row), input_projection));
+                };
+                dequantize (acc0, r);
+                dequantize (acc1, r + W);
+                dequantize (acc2, r + 2 * W);
+                dequantize (acc3, r + 3 * W);
+            }
+
+            update_state (weights.activation, gates, h, c, hidden_out + n * Hp, Hp);
+            quantize_state<T> (h, h_pairs, num_pairs);
+        }
+    }
+
+    static void forward_interleaved (const Interleaved_Weights_View& weights,
+                                     const float* x,
+                                     int num_samples,
+                                     float* h,
+                                     float* c,
+                                     float* gates,
+                                     float* hidden_out,
+                                     float* inputs) noexcept
+    {
+        const auto H = weights.hidden_size;
+        const auto Hp = weights.padded_size;
+        const auto slab_size = interleaved_slab_size (H);
+
+        // the inputs are { x, 1, h[0], ..., h[H - 1] }, with each one repeated for the 4 gates
+        fill (inputs + 4, inputs + 8, 1.0f);
+        fill (inputs + 8, inputs + slab_size, 0.0f);
+        const auto load_hidden_inputs = [h, inputs, H]
+        {
+            for (int j = 0; j < H; ++j)
+                fill (inputs + 4 * (j + 2), inputs + 4 * (j + 3), h[j]);
+        };
+        load_hidden_inputs();
+
+        // the padded units have no slabs, so their gates stay at zero
+        for (int gate = 0; gate < 4; ++gate)
+            fill (gates + gate * Hp + H, gates + (gate + 1) * Hp, 0.0f);
+
+        for (int n = 0; n < num_samples; ++n)
+        {
+            fill (inputs, inputs + 4, x[n]);
+
+            // eight units at a time, so that each vector of inputs is loaded once for all of them
+            auto unit = 0;
+            for (; unit + 8 <= H; unit += 8)
+                accumulate_interleaved (weights.slabs + unit * slab_size, slab_size, inputs, gates + unit, Hp);
+            for (; unit < H; unit += 4)
+                accumulate_interleaved_tail (weights.slabs + unit * slab_size, slab_size, min (H - unit, 4), inputs, gates + unit, Hp);
+
+            update_state (weights.activation, gates, h, c, hidden_out + n * Hp, Hp);
+            load_hidden_inputs();
+        }
+    }
+
+private:
+    /**
+     * Computes the gates for eight consecutive units in the interleaved layout.
+     * Lane l of each accumulator only ever sees the weights for gate (l % 4), so the
+     * lanes get summed down to the 4 gates at the end, and transposed back into
+     * the (gate-major) gates buffer.
+     */
+    static void accumulate_interleaved (const float* slab, int slab_size, const float* inputs, float* unit_gates, int Hp) noexcept
+    {
+        static constexpr int W = Vec::width;
+        auto acc0 = Vec::mul (Vec::loadu (slab), Vec::load (inputs));
+        auto acc1 = Vec::mul (Vec::loadu (slab + slab_size), Vec::load (inputs));
+        auto acc2 = Vec::mul (Vec::loadu (slab + 2 * slab_size), Vec::load (inputs));
+        auto acc3 = Vec::mul (Vec::loadu (slab + 3 * slab_size), Vec::load (inputs));
+        auto acc4 = Vec::mul (Vec::loadu (slab + 4 * slab_size), Vec::load (inputs));
+        auto acc5 = Vec::mul (Vec::loadu (slab + 5 * slab_size), Vec::load (inputs));
+        auto acc6 = Vec::mul (Vec::loadu (slab + 6 * slab_size), Vec::load (inputs));
+        auto acc7 = Vec::mul (Vec::loadu (slab + 7 * slab_size), Vec::load (inputs));
+        for (int k = W; k < slab_size; k += W)
+        {
+            const auto in = Vec::load (inputs + k);
+            acc0 = Vec::fmadd (Vec::loadu (slab + k), in, acc0);
+            acc1 = Vec::fmadd (Vec::loadu (slab + slab_size + k), in, acc1);
+            acc2 = Vec::fmadd (Vec::loadu (slab + 2 * slab_size + k), in, acc2);
+            acc3 = Vec::fmadd (Vec::loadu (slab + 3 * slab_size + k), in, acc3);
+            acc4 = Vec::fmadd (Vec::loadu (slab + 4 * slab_size + k), in, acc4);
+            acc5 = Vec::fmadd (Vec::loadu (slab + 5 * slab_size + k), in, acc5);
+            acc6 = Vec::fmadd (Vec::loadu (slab + 6 * slab_size + k), in, acc6);
+            acc7 = Vec::fmadd (Vec::loadu (slab + 7 * slab_size + k), in, acc7);
+        }
+
+        Vec::store_gate_sums (unit_gates, Hp, acc0, acc1, acc2, acc3);
+        Vec::store_gate_sums (unit_gates + 4, Hp, acc4, acc5, acc6, acc7);
+    }
+
+    /** Same as accumulate_interleaved(), for the last (up to 4) units. The gates for any missing units are zeroed, since they must be padding. */
+    static void accumulate_interleaved_tail (const float* slab, int slab_size, int num_units, const float* inputs, float* unit_gates, int Hp) noexcept
+    {
+        const auto accumulate_unit = [=] (int u)
+        {
+            auto acc = Vec::set1 (0.0f);
+            if (u < num_units)
+            {
+                for (int k = 0; k < slab_size; k += Vec::width)
+                    acc = Vec::fmadd (Vec::loadu (slab + u * slab_size + k), Vec::load (inputs + k), acc);
+            }
+            return acc;
+        };
+        Vec::store_gate_sums (unit_gates, Hp, accumulate_unit (0), accumulate_unit (1), accumulate_unit (2), accumulate_unit (3));
+    }
+
+    template <typename Weights_View, typename Load_Recurrent>
+    static void forward_impl (const Weights_View& weights,
+                              const float* x,
+                              int num_samples,
+                              float* h,
+                              float* c,
+                              float* gates,
+                              float* hidden_out,
+                              Load_Recurrent&& load_recurrent) noexcept
+    {
+        static constexpr int W = Vec::width;
+        const auto H = weights.hidden_size;
+        const auto Hp = weights.padded_size;
+        const auto num_rows = 4 * Hp;
+
+        for (int n = 0; n < num_samples; ++n)
+        {
+            // Fused i/f/g/o matvec: gates = W_x * x + b + U * h.
+            // The rows are processed four vectors at a time, so the accumulators
+            // stay in registers while we stream through the recurrent columns
+            // (widening them to fp32 as they're loaded, if they're stored as fp16 or bf16).
+            const auto x_n = Vec::set1 (x[n]);
+            for (int r = 0; r < num_rows; r += 4 * W)
+            {
+                auto acc0 = Vec::fmadd (Vec::load (weights.kernel + r), x_n, Vec::load (weights.bias + r));
+                auto acc1 = Vec::fmadd (Vec::load (weights.kernel + r + W), x_n, Vec::load (weights.bias + r + W));
+                auto acc2 = Vec::fmadd (Vec::load (weights.kernel + r + 2 * W), x_n, Vec::load (weights.bias + r + 2 * W));
+                auto acc3 = Vec::fmadd (Vec::load (weights.kernel + r + 3 * W), x_n, Vec::load (weights.bias + r + 3 * W));
+
+                const auto* column = weights.recurrent + r;
+                for (int j = 0; j < H; ++j, column += num_rows)
+                {
+                    const auto h_j = Vec::set1 (h[j]);
+                    acc0 = Vec::fmadd (load_recurrent (column), h_j, acc0);
+                    acc1 = Vec::fmadd (load_recurrent (column + W), h_j, acc1);
+                    acc2 = Vec::fmadd (load_recurrent (column + 2 * W), h_j, acc2);
+                    acc3 = Vec::fmadd (load_recurrent (column + 3 * W), h_j, acc3);
+                }
+
+                Vec::store (gates + r, acc0);
+                Vec::store (gates + r + W, acc1);
+                Vec::store (gates + r + 2 * W, acc2);
+                Vec::store (gates + r + 3 * W, acc3);
+            }
+
+            update_state (weights.activation, gates, h, c, hidden_out + n * Hp, Hp);
+        }
+    }
+
+    /** Gate activations and state update */
+    static void update_state (Activation activation, const float* gates, float* h, float* c, float* h_out, int Hp) noexcept
+    {
+        with_activation (activation,
+                         [=] (auto activation_constant)
+                         {
+                             static constexpr auto A = decltype (activation_constant)::value;
+                             static constexpr int W = Vec::width;
+                             for (int k = 0; k < Hp; k += W)
+                             {
+                                 const auto i = sigmoid<A> (Vec::load (gates + k));
+                                 const auto f = sigmoid<A> (Vec::load (gates + Hp + k));
+                                 const auto g = tanh<A> (Vec::load (gates + 2 * Hp + k));
+                                 const auto o = sigmoid<A> (Vec::load (gates + 3 * Hp + k));
+
+                                 const auto c_k = Vec::fmadd (f, Vec::load (c + k), Vec::mul (i, g));
+                                 const auto h_k = Vec::mul (o, tanh<A> (c_k));
+                                 Vec::store (c + k, c_k);
+                                 Vec::store (h + k, h_k);
+                                 Vec::store (h_out + k, h_k);
+                             }
+                         });
+    }
+
+    /** Quantizes the hidden state, packing pairs of units into int32s to match the weights layout */
+    template <typename T>
+    static void quantize_state (const float* h, int32_t* h_pairs, int num_pairs) noexcept
+    {
+        static constexpr auto state_scale = (float) Quantization<T>::state_max;
+        for (int p = 0; p < num_pairs; ++p)
+        {
+            const auto h_0 = (uint16_t) (int16_t) round_to_int (h[2 * p] * state_scale);
+            const auto h_1 = (uint16_t) (int16_t) round_to_int (h[2 * p + 1] * state_scale);
+            h_pairs[p] = (int32_t) ((uint32_t) h_0 | ((uint32_t) h_1 << 16));
+        }
+    }
+};
+} // namespace
+} // namespace lstm_kernels
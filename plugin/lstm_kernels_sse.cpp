@@ -0,0 +1,102 @@
+#include "lstm_kernels_impl.h"
+
+#if NEURAL_PRUNING_X86_KERNELS
+#include <emmintrin.h>
+
+namespace lstm_kernels
+{
+namespace
+{
+struct Vec_SSE
+{
+    using V = __m128;
+    static constexpr int width = 4;
+
+    static V load (const float* p) noexcept { return _mm_load_ps (p); }
+    static V loadu (const float* p) noexcept { return _mm_loadu_ps (p); }
+    static void store (float* p, V x) noexcept { _mm_store_ps (p, x); }
+    static V set1 (float x) noexcept { return _mm_set1_ps (x); }
+    static V add (V a, V b) noexcept { return _mm_add_ps (a, b); }
+    static V sub (V a, V b) noexcept { return _mm_sub_ps (a, b); }
+    static V mul (V a, V b) noexcept { return _mm_mul_ps (a, b); }
+    static V div (V a, V b) noexcept { return _mm_div_ps (a, b); }
+    static V fmadd (V a, V b, V c) noexcept { return _mm_add_ps (_mm_mul_ps (a, b), c); } // no FMA in SSE2
+    static V min (V a, V b) noexcept { return _mm_min_ps (a, b); }
+    static V max (V a, V b) noexcept { return _mm_max_ps (a, b); }
+
+    static void store_gate_sums (float* gates, int Hp, V u0, V u1, V u2, V u3) noexcept
+    {
+        // already one lane per gate, so we just need to transpose them
+        _MM_TRANSPOSE4_PS (u0, u1, u2, u3);
+        _mm_storeu_ps (gates, u0);
+        _mm_storeu_ps (gates + Hp, u1);
+        _mm_storeu_ps (gates + 2 * Hp, u2);
+        _mm_storeu_ps (gates + 3 * Hp, u3);
+    }
+
+    static V floor (V x) noexcept
+    {
+        // SSE2 has no floor instruction, so truncate and then correct for negative values
+        const auto truncated = _mm_cvtepi32_ps (_mm_cvttps_epi32 (x));
+        return _mm_sub_ps (truncated, _mm_and_ps (_mm_cmpgt_ps (truncated, x), _mm_set1_ps (1.0f)));
+    }
+
+    static V pow2n (V n) noexcept
+    {
+        return _mm_castsi128_ps (_mm_slli_epi32 (_mm_add_epi32 (_mm_cvtps_epi32 (n), _mm_set1_epi32 (127)), 23));
+    }
+
+    using VI = __m128i;
+    static VI zero_i() noexcept { return _mm_setzero_si128(); }
+    static VI set1_i32 (int32_t x) noexcept { return _mm_set1_epi32 (x); }
+    static VI load_pairs (const int16_t* p) noexcept { return _mm_loadu_si128 (reinterpret_cast<const __m128i*> (p)); }
+    static VI madd_pairs (VI w, VI h_pair, VI acc) noexcept { return _mm_add_epi32 (acc, _mm_madd_epi16 (w, h_pair)); }
+    static V to_float (VI x) noexcept { return _mm_cvtepi32_ps (x); }
+    static VI truncate (V x) noexcept { return _mm_cvttps_epi32 (x); }
+
+    static V gather (const float* table, VI index) noexcept
+    {
+        // no gather instruction in SSE2, so we do the lookups one at a time
+        alignas (16) int32_t indices[4];
+        _mm_store_si128 (reinterpret_cast<__m128i*> (indices), index);
+        return _mm_setr_ps (table[indices[0]], table[indices[1]], table[indices[2]], table[indices[3]]);
+    }
+
+    static VI load_pairs (const int8_t* p) noexcept
+    {
+        // no sign-extension instruction in SSE2, so duplicate each byte into the high half, and shift it back down
+        const auto bytes = _mm_loadl_epi64 (reinterpret_cast<const __m128i*> (p));
+        return _mm_srai_epi16 (_mm_unpacklo_epi8 (bytes, bytes), 8);
+    }
+
+    static V load_float16 (const uint16_t* p) noexcept
+    {
+        // no F16C, so shift the exponent and mantissa into place, and then re-bias
+        // the exponent by multiplying with 2^112 (which also handles the denormals)
+        const auto halves = _mm_unpacklo_epi16 (_mm_loadl_epi64 (reinterpret_cast<const __m128i*> (p)), _mm_setzero_si128());
+        const auto magnitude = _mm_slli_epi32 (_mm_and_si128 (halves, _mm_set1_epi32 (0x7fff)), 13);
+        const auto sign = _mm_slli_epi32 (_mm_and_si128 (halves, _mm_set1_epi32 (0x8000)), 16);
+        const auto value = _mm_mul_ps (_mm_castsi128_ps (magnitude), _mm_castsi128_ps (_mm_set1_epi32 (0x77800000)));
+        return _mm_or_ps (value, _mm_castsi128_ps (sign));
+    }
+
+    static V load_bfloat16 (const uint16_t* p) noexcept
+    {
+        // interleaving with zeros puts each bf16 in the top half of an fp32
+        return _mm_castsi128_ps (_mm_unpacklo_epi16 (_mm_setzero_si128(), _mm_loadl_epi64 (reinterpret_cast<const __m128i*> (p))));
+    }
+};
+} // namespace
+
+const Kernel sse_kernel {
+    "SSE2",
+    &Kernel_Impl<Vec_SSE>::forward,
+    &Kernel_Impl<Vec_SSE>::forward_quantized<int16_t>,
+    &Kernel_Impl<Vec_SSE>::forward_quantized<int8_t>,
+    &Kernel_Impl<Vec_SSE>::forward_half<Weight_Format::Float16>,
+    &Kernel_Impl<Vec_SSE>::forward_half<Weight_Format::BFloat16>,
+    &Kernel_Impl<Vec_SSE>::forward_interleaved,
+    &Kernel_Impl<Vec_SSE>::apply_tanh,
+};
+} // namespace lstm_kernels
+#endif
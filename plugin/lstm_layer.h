@@ -0,0 +1,343 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <array>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#include "lstm_kernels.h"
+
+/**
+ * Single-input LSTM layer, with the weights stored in the same
+ * (Keras/RTNeural) i/f/g/o gate ordering as LSTM_Weights.
+ *
+ * The recurrent matrix is only stored in the padded layout that the SIMD
+ * kernels use ([hidden_size][4 * padded_size], see lstm_kernels.h), so
+ * column j holds the weights applied to h[j], like the row-major layout
+ * of the Keras recurrent kernel. The Eigen paths read the same copy.
+ *
+ * Since the layer only has a single input, the input projection for a
+ * whole block (W_x * x[n] + b) is an outer product, so forward_block()
+ * computes it up-front, leaving only the recurrent matvec and the gate
+ * non-linearities in the per-sample loop.
+ *
+ * The layer can also run several independent streams (e.g. stereo
+ * channels) as a batch. Each stream has its own state, but the recurrent
+ * weights are only streamed through once per sample for all of them.
+ *
+ * For a single stream, the recurrence runs through the best SIMD kernel
+ * for the running CPU (see lstm_kernels.h) if one is available.
+ *
+ * The recurrent weights can also be quantized, stored as fp16/bf16, or
+ * re-arranged into the interleaved (unit-by-unit) layout (see Weights::quantize() and
+ * Weights::set_interleaved_slabs()), which releases the float weights. The
+ * multi-stream path then runs each stream through the SIMD kernel in turn.
+ * Without a SIMD kernel, the weights always stay in float.
+ *
+ * The SIMD kernels can also use faster approximations of the gate
+ * activations (see Activation), which are chosen per layer.
+ *
+ * The weights are read-only once they've been built, so layers (e.g. in
+ * different plugin instances) can share them, and each layer only owns
+ * its state and scratch buffers. A layer must be given some weights
+ * before it can process anything.
+ */
+template <int hidden_size>
+struct LSTM_Layer
+{
+    static constexpr int max_block_size = 64;
+    static constexpr int max_num_streams = 2;
+    static constexpr int padded_size = lstm_kernels::padded_size (hidden_size);
+
+    using Gates_Vector = Eigen::Matrix<float, 4 * hidden_size, 1>;
+    using Packed_Recurrent_Matrix = Eigen::Matrix<float, 4 * padded_size, hidden_size>;
+    using State_Matrix = Eigen::Matrix<float, hidden_size, max_num_streams>;
+
+    struct Weights
+    {
+        Gates_Vector kernel = Gates_Vector::Zero();
+        Gates_Vector bias = Gates_Vector::Zero();
+
+        // padded copy of the kernel and bias for the SIMD kernels, and the (only) float copy of the recurrent weights
+        // (the recurrent weights are released by quantize() and set_interleaved_slabs(), unless the format is Float32)
+        alignas (64) std::array<float, 4 * padded_size> packed_kernel {};
+        alignas (64) std::array<float, 4 * padded_size> packed_bias {};
+        std::vector<float, lstm_kernels::Aligned_Allocator<float>> packed_recurrent =
+            std::vector<float, lstm_kernels::Aligned_Allocator<float>> ((size_t) (4 * padded_size * hidden_size), 0.0f);
+
+        /** The recurrent weight from h[column] to the given row of the gates (i/f/g/o). */
+        float& recurrent (int row, int column) noexcept
+        {
+            return packed_recurrent[(size_t) (column * 4 * padded_size + (row / hidden_size) * padded_size + row % hidden_size)];
+        }
+
+        /** Copies the kernel and bias into the padded layout used by the SIMD kernels. Call this after changing them! */
+        void pack()
+        {
+            for (int gate = 0; gate < 4; ++gate)
+            {
+                for (int k = 0; k < hidden_size; ++k)
+                {
+                    packed_kernel[(size_t) (gate * padded_size + k)] = kernel (gate * hidden_size + k);
+                    packed_bias[(size_t) (gate * padded_size + k)] = bias (gate * hidden_size + k);
+                }
+            }
+        }
+
+        // quantized (or fp16/bf16, or interleaved) copy of the packed weights (only used by the SIMD kernels)
+        Weight_Format format = Weight_Format::Float32;
+        std::vector<int16_t> quantized_recurrent_int16 {};
+        std::vector<int8_t> quantized_recurrent_int8 {};
+        std::vector<uint16_t> half_recurrent {};
+        std::vector<float> interleaved_slabs {};
+        alignas (64) std::array<float, 4 * padded_size> row_scales {};
+
+        /** Converts the packed weights to the given format (except Interleaved, see set_interleaved_slabs()). Call this after pack()! */
+        void quantize (Weight_Format new_format)
+        {
+            assert (new_format != Weight_Format::Interleaved);
+            assert (! packed_recurrent.empty());
+
+            // without a SIMD kernel, the layer can only run the float weights
+            format = lstm_kernels::get_kernel() != nullptr ? new_format : Weight_Format::Float32;
+            quantized_recurrent_int16.clear();
+            quantized_recurrent_int8.clear();
+            half_recurrent.clear();
+            interleaved_slabs.clear();
+            if (format == Weight_Format::Float16 || format == Weight_Format::BFloat16)
+            {
+                half_recurrent.resize (packed_recurrent.size());
+                lstm_kernels::convert_to_half (packed_recurrent.data(), (int) packed_recurrent.size(), half_recurrent.data(), format);
+            }
+            else if (format == Weight_Format::Int12)
+            {
+                quantized_recurrent_int16.resize ((size_t) lstm_kernels::quantized_size (padded_size));
+                lstm_kernels::quantize_recurrent (packed_recurrent.data(), hidden_size, padded_size, quantized_recurrent_int16.data(), row_scales.data());
+            }
+            else if (format == Weight_Format::Int8)
+            {
+                quantized_recurrent_int8.resize ((size_t) lstm_kernels::quantized_size (padded_size));
+                lstm_kernels::quantize_recurrent (packed_recurrent.data(), hidden_size, padded_size, quantized_recurrent_int8.data(), row_scales.data());
+            }
+
+            // the SIMD kernels only need the converted copy (and they run every stream in the other formats)
+            if (format != Weight_Format::Float32)
+                decltype (packed_recurrent) {}.swap (packed_recurrent);
+        }
+
+        /**
+         * Switches to the interleaved format, using slabs from Interleaved_LSTM_Weights::copy_slabs()
+         * ([hidden_size][interleaved_slab_size (hidden_size)]). Call this after pack()!
+         */
+        void set_interleaved_slabs (std::vector<float>&& slabs)
+        {
+            assert (slabs.size() == (size_t) (hidden_size * lstm_kernels::interleaved_slab_size (hidden_size)));
+            quantize (Weight_Format::Float32);
+            if (lstm_kernels::get_kernel() == nullptr)
+                return;
+
+            format = Weight_Format::Interleaved;
+            interleaved_slabs = std::move (slabs);
+            decltype (packed_recurrent) {}.swap (packed_recurrent);
+        }
+
+        /** Returns the memory used by these weights, including the converted copies. */
+        size_t size_bytes() const
+        {
+            return sizeof (Weights)
+                   + packed_recurrent.capacity() * sizeof (float)
+                   + quantized_recurrent_int16.capacity() * sizeof (int16_t)
+                   + quantized_recurrent_int8.capacity() * sizeof (int8_t)
+                   + half_recurrent.capacity() * sizeof (uint16_t)
+                   + interleaved_slabs.capacity() * sizeof (float);
+        }
+    };
+
+    std::shared_ptr<const Weights> weights {};
+
+    State_Matrix outs = State_Matrix::Zero(); // hidden state (one column per stream)
+    State_Matrix cell = State_Matrix::Zero(); // cell state (one column per stream)
+
+    // hidden states from the most recent call to forward_block()
+    std::array<Eigen::Matrix<float, hidden_size, max_block_size>, max_num_streams> hidden_states {};
+
+    const lstm_kernels::Kernel* simd_kernel = lstm_kernels::get_kernel();
+
+    /** How the SIMD kernels compute the gate activations (the Eigen path always uses Eigen's own implementations). */
+    Activation activation = Activation::Exact;
+
+    void reset()
+    {
+        outs.setZero();
+        cell.setZero();
+    }
+
+    void forward (float x) noexcept
+    {
+        forward_block<1> ({ &x }, 1);
+    }
+
+    template <int num_streams = 1>
+    void forward_block (const std::array<const float*, num_streams>& x, int num_samples) noexcept
+    {
+        static_assert (num_streams <= max_num_streams);
+
+        // the other formats only have weights for the SIMD kernels, so each stream runs separately
+        if (simd_kernel != nullptr && (num_streams == 1 || weights->format != Weight_Format::Float32))
+        {
+            for (int stream = 0; stream < num_streams; ++stream)
+                forward_block_simd (stream, x[(size_t) stream], num_samples);
+            return;
+        }
+
+        for (size_t stream = 0; stream < num_streams; ++stream)
+        {
+            const auto x_row = Eigen::Map<const Eigen::Matrix<float, 1, Eigen::Dynamic>> { x[stream], num_samples };
+            auto block_projection = input_projection[stream].leftCols (num_samples);
+            block_projection.noalias() = weights->kernel * x_row;
+            block_projection.colwise() += weights->bias;
+        }
+
+        for (int n = 0; n < num_samples; ++n)
+        {
+            for (size_t stream = 0; stream < num_streams; ++stream)
+                gates.col ((int) stream) = input_projection[stream].col (n);
+
+            recurrent_gemm<num_streams>();
+            apply_gates<num_streams>();
+
+            for (size_t stream = 0; stream < num_streams; ++stream)
+                hidden_states[stream].col (n) = outs.col ((int) stream);
+        }
+    }
+
+private:
+    void forward_block_simd (int stream, const float* x, int num_samples) noexcept
+    {
+        // the Eigen state is the source of truth, so that we can switch between implementations
+        Eigen::Map<Eigen::Matrix<float, hidden_size, 1>> { packed.h.data() } = outs.col (stream);
+        Eigen::Map<Eigen::Matrix<float, hidden_size, 1>> { packed.c.data() } = cell.col (stream);
+
+        if (weights->format == Weight_Format::Float32)
+        {
+            const auto packed_weights = lstm_kernels::Packed_Weights_View {
+                .kernel = weights->packed_kernel.data(),
+                .bias = weights->packed_bias.data(),
+                .recurrent = weights->packed_recurrent.data(),
+                .hidden_size = hidden_size,
+                .padded_size = padded_size,
+                .activation = activation,
+            };
+            simd_kernel->forward (packed_weights, x, num_samples, packed.h.data(), packed.c.data(), packed.gates.data(), packed.hidden_out.data());
+        }
+        else if (weights->format == Weight_Format::Float16 || weights->format == Weight_Format::BFloat16)
+        {
+            const auto half_weights = lstm_kernels::Half_Weights_View {
+                .kernel = weights->packed_kernel.data(),
+                .bias = weights->packed_bias.data(),
+                .recurrent = weights->half_recurrent.data(),
+                .hidden_size = hidden_size,
+                .padded_size = padded_size,
+                .activation = activation,
+            };
+            const auto forward_half = weights->format == Weight_Format::Float16 ? simd_kernel->forward_float16 : simd_kernel->forward_bfloat16;
+            forward_half (half_weights, x, num_samples, packed.h.data(), packed.c.data(), packed.gates.data(), packed.hidden_out.data());
+        }
+        else if (weights->format == Weight_Format::Interleaved)
+        {
+            const auto interleaved_weights = lstm_kernels::Interleaved_Weights_View {
+                .slabs = weights->interleaved_slabs.data(),
+                .hidden_size = hidden_size,
+                .padded_size = padded_size,
+                .activation = activation,
+            };
+            simd_kernel->forward_interleaved (interleaved_weights, x, num_samples, packed.h.data(), packed.c.data(), packed.gates.data(), packed.hidden_out.data(), packed.interleaved_inputs.data());
+        }
+        else
+        {
+            const auto is_int16 = weights->format == Weight_Format::Int12;
+            const auto quantized_weights = lstm_kernels::Quantized_Weights_View {
+                .kernel = weights->packed_kernel.data(),
+                .bias = weights->packed_bias.data(),
+                .recurrent = is_int16 ? (const void*) weights->quantized_recurrent_int16.data() : (const void*) weights->quantized_recurrent_int8.data(),
+                .row_scales = weights->row_scales.data(),
+                .hidden_size = hidden_size,
+                .padded_size = padded_size,
+                .activation = activation,
+            };
+            const auto forward_quantized = is_int16 ? simd_kernel->forward_int16 : simd_kernel->forward_int8;
+            forward_quantized (quantized_weights, x, num_samples, packed.h.data(), packed.c.data(), packed.gates.data(), packed.hidden_out.data(), packed.h_pairs.data());
+        }
+
+        outs.col (stream) = Eigen::Map<Eigen::Matrix<float, hidden_size, 1>> { packed.h.data() };
+        cell.col (stream) = Eigen::Map<Eigen::Matrix<float, hidden_size, 1>> { packed.c.data() };
+        hidden_states[(size_t) stream].leftCols (num_samples) = Eigen::Map<const Eigen::Matrix<float, hidden_size, Eigen::Dynamic>, 0, Eigen::OuterStride<>> {
+            packed.hidden_out.data(),
+            hidden_size,
+            num_samples,
+            Eigen::OuterStride<> { padded_size },
+        };
+    }
+
+    /**
+     * gates += recurrent * outs, for several streams at once. Eigen's GEMM re-packs the
+     * whole recurrent matrix on every call, which costs more than the product itself at
+     * this size, so instead we work through the (padded) gates in tiles of rows, keeping
+     * each tile's accumulators (for all the streams) in registers while we run through the
+     * hidden units. This way the recurrent weights and the gates are only read once per
+     * sample, for all the streams.
+     */
+    template <int num_streams>
+    void recurrent_gemm() noexcept
+    {
+        static constexpr int tile_size = lstm_kernels::padding;
+        static_assert (padded_size % tile_size == 0);
+
+        for (int gate = 0; gate < 4; ++gate)
+            padded_gates.template block<hidden_size, num_streams> (gate * padded_size, 0) = gates.template block<hidden_size, num_streams> (gate * hidden_size, 0);
+
+        // (the padding rows of the weights are zero, so the padding rows of the gates stay at zero)
+        const auto recurrent = Eigen::Map<const Packed_Recurrent_Matrix, Eigen::Aligned64> { weights->packed_recurrent.data() };
+        for (int row_start = 0; row_start < 4 * padded_size; row_start += tile_size)
+        {
+            Eigen::Matrix<float, tile_size, num_streams> tile = padded_gates.template block<tile_size, num_streams> (row_start, 0);
+            for (int j = 0; j < hidden_size; ++j)
+                tile.noalias() += recurrent.template block<tile_size, 1> (row_start, j) * outs.template block<1, num_streams> (j, 0);
+            padded_gates.template block<tile_size, num_streams> (row_start, 0) = tile;
+        }
+
+        for (int gate = 0; gate < 4; ++gate)
+            gates.template block<hidden_size, num_streams> (gate * hidden_size, 0) = padded_gates.template block<hidden_size, num_streams> (gate * padded_size, 0);
+    }
+
+    template <int num_streams>
+    void apply_gates() noexcept
+    {
+        auto input_forget_gates = gates.template block<2 * hidden_size, num_streams> (0, 0).array();
+        input_forget_gates = (1.0f + (-input_forget_gates).exp()).inverse();
+        auto candidate_gate = gates.template block<hidden_size, num_streams> (2 * hidden_size, 0).array();
+        candidate_gate = candidate_gate.tanh();
+        auto output_gate = gates.template block<hidden_size, num_streams> (3 * hidden_size, 0).array();
+        output_gate = (1.0f + (-output_gate).exp()).inverse();
+
+        auto cell_state = cell.template leftCols<num_streams>().array();
+        cell_state = input_forget_gates.template bottomRows<hidden_size>() * cell_state
+                     + input_forget_gates.template topRows<hidden_size>() * candidate_gate;
+        outs.template leftCols<num_streams>().array() = output_gate * cell_state.tanh();
+    }
+
+    Eigen::Matrix<float, 4 * hidden_size, max_num_streams> gates = Eigen::Matrix<float, 4 * hidden_size, max_num_streams>::Zero();
+    Eigen::Matrix<float, 4 * padded_size, max_num_streams> padded_gates = Eigen::Matrix<float, 4 * padded_size, max_num_streams>::Zero();
+    std::array<Eigen::Matrix<float, 4 * hidden_size, max_block_size>, max_num_streams> input_projection {};
+
+    struct Packed_State
+    {
+        alignas (64) std::array<float, padded_size> h {};
+        alignas (64) std::array<float, padded_size> c {};
+        alignas (64) std::array<int32_t, padded_size / 2> h_pairs {};
+        alignas (64) std::array<float, 4 * padded_size> gates {};
+        alignas (64) std::array<float, padded_size * max_block_size> hidden_out {};
+        alignas (64) std::array<float, lstm_kernels::interleaved_slab_size (hidden_size)> interleaved_inputs {};
+    } packed {};
+};
@@ -1,4 +1,8 @@
 #include "lstm_model.h"
+#include "lstm_interleaved_weights.h"
+#include "masked_lstm_model.h"
+#include <chrono>
+#include <numeric>
 
 template <typename Fn, size_t... Ix>
 constexpr void for_each_index (Fn&& fn, std::index_sequence<Ix...>) noexcept
@@ -21,137 +25,411 @@ using offset_sequence_t = typename offset_sequence<N, Seq>::type;
 template <std::size_t start, std::size_t end_inclusive>
 using range_sequence = offset_sequence_t<start, std::make_index_sequence<end_inclusive - start + 1>>;
 
-void LSTM_Model::load (const nlohmann::json& model_json)
+LSTM_Model::~LSTM_Model()
 {
-    juce::SpinLock::ScopedLockType model_loading_lock { model_loading_mutex };
-
-    const auto current_hidden_size = model_json["layers"][0]["shape"].back().get<int>();
+    delete active_model;
+    delete pending_model.exchange (nullptr);
+    delete retired_model.exchange (nullptr);
+}
 
+/** Calls fn with the model size as an integral constant */
+template <typename Fn>
+static void visit_model_size (int model_size, Fn&& fn)
+{
     for_each_index (
-        [this, current_hidden_size] (auto i)
+        [&fn, model_size] (auto i)
         {
-            if (i == current_hidden_size)
+            if constexpr (i % LSTM_Model::model_grid == 0)
             {
-                chowdsp::log ("Loading model with hidden size: {}", current_hidden_size);
-                model_variant.emplace<Model<i>>();
+                if (i == model_size)
+                    fn (std::integral_constant<int, (int) i>());
             }
         },
-        range_sequence<min_hidden_size, max_hidden_size> {});
+        range_sequence<LSTM_Model::min_hidden_size, LSTM_Model::max_model_size> {});
+}
 
-    std::visit (
-        [&model_json] (auto& model)
+static auto make_model_variant (int hidden_size)
+{
+    auto new_model = std::make_unique<LSTM_Model::Model_Variant>();
+    visit_model_size (LSTM_Model::get_model_size (hidden_size),
+                      [&new_model] (auto model_size)
+                      { new_model->emplace<LSTM_Model::Model<model_size>>(); });
+    return new_model;
+}
+
+template <int hidden_size>
+void LSTM_Model::Model<hidden_size>::load (const LSTM_Weights& weights)
+{
+    std::vector<int> unit_positions ((size_t) weights.hidden_size);
+    std::iota (unit_positions.begin(), unit_positions.end(), 0);
+    load (weights, unit_positions);
+}
+
+template <int hidden_size>
+void LSTM_Model::Model<hidden_size>::load (const LSTM_Weights& weights, std::span<const int> unit_positions)
+{
+    set_weights (make_weights (weights, unit_positions));
+}
+
+/** Gathers the hidden units at the given positions into a model's (packed, Float32) weights. */
+template <int hidden_size>
+static std::shared_ptr<typename LSTM_Model::Model<hidden_size>::Weights> gather_weights (const LSTM_Weights& weights,
+                                                                                        std::span<const int> unit_positions)
+{
+    using Weights = typename LSTM_Model::Model<hidden_size>::Weights;
+    assert (unit_positions.size() <= (size_t) hidden_size);
+    const auto H = weights.hidden_size;
+    const auto num_units = (int) unit_positions.size();
+
+    // the new weights start out zeroed, so any extra units are masked out
+    auto new_weights = std::make_shared<Weights>();
+    auto& lstm_weights = new_weights->lstm;
+
+    const auto kernel = weights.kernel();
+    const auto recurrent = weights.recurrent();
+    const auto bias = weights.bias();
+    const auto dense = weights.dense();
+
+    for (int k = 0; k < num_units; ++k)
+    {
+        const auto src_k = unit_positions[(size_t) k];
+        for (int gate = 0; gate < 4; ++gate)
         {
-            auto& lstm_weights = model_json["layers"][0]["weights"];
-            auto& dense_weights = model_json["layers"][1]["weights"];
-            RTNeural::json_parser::loadLSTM<float> (model.lstm, lstm_weights);
-            RTNeural::json_parser::loadDense<float> (model.dense, dense_weights);
-        },
-        model_variant);
+            lstm_weights.kernel (gate * hidden_size + k) = kernel[(size_t) (gate * H + src_k)];
+            lstm_weights.bias (gate * hidden_size + k) = bias[(size_t) (gate * H + src_k)];
+        }
+        new_weights->dense (k) = dense[(size_t) src_k];
+    }
+
+    new_weights->units.fill (-1);
+    for (int k = 0; k < num_units; ++k)
+        new_weights->units[(size_t) k] = weights.units[(size_t) unit_positions[(size_t) k]];
+
+    for (int j = 0; j < num_units; ++j)
+    {
+        const auto* src_column = recurrent.data() + (size_t) unit_positions[(size_t) j] * 4 * (size_t) H;
+        for (int gate = 0; gate < 4; ++gate)
+            for (int k = 0; k < num_units; ++k)
+                lstm_weights.recurrent (gate * hidden_size + k, j) = src_column[gate * H + unit_positions[(size_t) k]];
+    }
+
+    new_weights->dense_bias = weights.dense_bias();
+    lstm_weights.pack();
+    return new_weights;
+}
+
+template <int hidden_size>
+std::shared_ptr<const typename LSTM_Model::Model<hidden_size>::Weights>
+    LSTM_Model::Model<hidden_size>::make_weights (const LSTM_Weights& weights,
+                                                  std::span<const int> unit_positions,
+                                                  Weight_Format format)
+{
+    if (format == Weight_Format::Interleaved)
+        return make_weights (Interleaved_LSTM_Weights::from_rtneural (weights, unit_positions));
+
+    auto new_weights = gather_weights<hidden_size> (weights, unit_positions);
+    new_weights->lstm.quantize (format);
+    return new_weights;
+}
+
+template <int hidden_size>
+std::shared_ptr<const typename LSTM_Model::Model<hidden_size>::Weights>
+    LSTM_Model::Model<hidden_size>::make_weights (const Interleaved_LSTM_Weights& weights)
+{
+    // the float weights are still needed if there's no SIMD kernel
+    std::vector<int> unit_positions ((size_t) weights.hidden_size);
+    std::iota (unit_positions.begin(), unit_positions.end(), 0);
+    auto new_weights = gather_weights<hidden_size> (weights.to_rtneural(), unit_positions);
+
+    std::vector<float> slabs ((size_t) (hidden_size * lstm_kernels::interleaved_slab_size (hidden_size)));
+    weights.copy_slabs (slabs, hidden_size);
+    new_weights->lstm.set_interleaved_slabs (std::move (slabs));
+    return new_weights;
+}
+
+void LSTM_Model::load (const LSTM_Weights& weights)
+{
+    free_retired_model();
+
+    auto new_model = make_model_variant (weights.hidden_size);
+    std::visit ([&weights] (auto& model)
+                { model.load (weights); },
+                *new_model);
+
+    publish_model (std::move (new_model));
+}
+
+double LSTM_Model::measure_ns_per_sample (int hidden_size, const LSTM_Weights& weights, int num_streams, Weight_Format format, Activation activation)
+{
+    static constexpr int block_size = 64;
+    static constexpr int num_blocks = 64;
+    static constexpr int num_trials = 3;
+
+    // the cost doesn't depend on which units we keep
+    std::vector<int> unit_positions ((size_t) hidden_size);
+    std::iota (unit_positions.begin(), unit_positions.end(), 0);
+
+    auto model = make_model (hidden_size, make_shared_weights (weights, unit_positions, format));
+    std::visit ([activation] (auto& m)
+                { m.lstm.activation = activation; },
+                *model);
+
+    std::array<float, block_size> test_signal {};
+    for (size_t n = 0; n < block_size; ++n)
+        test_signal[n] = 0.5f * std::sin (0.1f * (float) n);
+
+    // take the fastest trial, since anything slower was probably interrupted
+    auto best_duration = std::numeric_limits<double>::max();
+    for (int trial = 0; trial <= num_trials; ++trial)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (int block = 0; block < num_blocks; ++block)
+        {
+            std::array<std::array<float, block_size>, max_num_streams> data { test_signal, test_signal };
+            float* const channels[] = { data[0].data(), data[1].data() };
+            std::visit ([&channels, num_streams] (auto& m)
+                        { m.process ({ channels, (size_t) num_streams }, block_size); },
+                        *model);
+        }
+        const auto duration = std::chrono::duration<double, std::nano> (std::chrono::steady_clock::now() - start).count();
+
+        // the first trial is just a warm-up
+        if (trial > 0)
+            best_duration = std::min (best_duration, duration);
+    }
+
+    return best_duration / (double) (block_size * num_blocks);
+}
+
+void LSTM_Model::publish_model (std::unique_ptr<Model_Variant>&& new_model)
+{
+    // if the audio thread never picked up the previous pending model, we can free it here
+    delete pending_model.exchange (new_model.release(), std::memory_order_acq_rel);
+}
+
+void LSTM_Model::free_retired_model()
+{
+    delete retired_model.exchange (nullptr, std::memory_order_acq_rel);
 }
 
 void LSTM_Model::process (std::span<float> data)
 {
-    juce::SpinLock::ScopedTryLockType model_loading_lock { model_loading_mutex };
-    if (! model_loading_lock.isLocked())
-        return;
+    float* const channels[] = { data.data() };
+    process (channels, static_cast<int> (data.size()));
+}
 
-    std::visit (
-        [data] (auto& model)
+static void get_unit_state (const LSTM_Model::Model_Variant& model, LSTM_Model::Unit_State& state) noexcept
+{
+    std::visit ([&state] (const auto& m)
+                { m.get_unit_state (state); },
+                model);
+}
+
+static void set_unit_state (LSTM_Model::Model_Variant& model, const LSTM_Model::Unit_State& state) noexcept
+{
+    std::visit ([&state] (auto& m)
+                { m.set_unit_state (state); },
+                model);
+}
+
+/**
+ * Copies the recurrent state over to a new model, using the original unit indices,
+ * so that the units which survive the prune carry on from where they were. Any
+ * units that weren't in the previous model start from zero.
+ */
+static void transplant_state (const LSTM_Model::Model_Variant& from, LSTM_Model::Model_Variant& to) noexcept
+{
+    LSTM_Model::Unit_State state {};
+    get_unit_state (from, state);
+    set_unit_state (to, state);
+}
+
+LSTM_Model::Model_Variant* LSTM_Model::update_active_model() noexcept
+{
+    // Swap in the pending model at the block boundary. If the previously
+    // retired model hasn't been freed yet, we hold off until the next block,
+    // so that the audio thread never needs to free anything.
+    if (retired_model.load (std::memory_order_acquire) == nullptr)
+    {
+        if (auto* next_model = pending_model.exchange (nullptr, std::memory_order_acq_rel))
         {
-            for (size_t n = 0; n < data.size(); ++n)
-            {
-                Eigen::Matrix<float, 1, 1> in { data[n] };
-                model.lstm.forward (in);
-                model.dense.forward (model.lstm.outs);
-                data[n] = model.dense.outs (0);
-            }
-        },
-        model_variant);
+            if (active_model != nullptr)
+                transplant_state (*active_model, *next_model);
+            retired_model.store (std::exchange (active_model, next_model), std::memory_order_release);
+
+            active_hidden_size = std::visit ([] (const auto& model)
+                                             { return model.get_num_units(); },
+                                             *active_model);
+        }
+    }
+
+    if (active_model != nullptr)
+        std::visit ([this] (auto& model)
+                    { model.lstm.activation = activation; },
+                    *active_model);
+
+    return active_model;
 }
 
-struct Pruning_Candidate
+void LSTM_Model::prepare_masked_model()
 {
-    int idx {};
-    float value { 0.0f };
-};
+    masked_model = std::make_unique<Masked_LSTM_Model> (*original_weights);
+}
+
+void LSTM_Model::request_masked_hidden_size (int hidden_size, Ranking ranking) noexcept
+{
+    masked_request.store ((static_cast<uint32_t> (static_cast<uint8_t> (ranking)) << 8) | static_cast<uint32_t> (hidden_size & 0xff),
+                          std::memory_order_release);
+}
+
+bool LSTM_Model::update_masking() noexcept
+{
+    const auto request = masked_request.load (std::memory_order_acquire);
+    const auto masked_hidden_size = static_cast<int> (request & 0xff);
+    const auto masked_ranking = static_cast<Ranking> ((request >> 8) & 0xff);
+
+    const auto should_mask = masked_model != nullptr
+                             && masked_hidden_size > 0
+                             && (active_model == nullptr || masked_hidden_size != active_hidden_size);
+    if (should_mask)
+    {
+        if (! is_masked_model_running && active_model != nullptr)
+        {
+            Unit_State state {};
+            get_unit_state (*active_model, state);
+            masked_model->model.set_unit_state (state);
+        }
+
+        masked_model->set_mask (masked_hidden_size, masked_ranking);
+        masked_model->model.lstm.activation = activation;
+    }
+    else if (is_masked_model_running && active_model != nullptr)
+    {
+        // the active model has caught up, so it takes over from here
+        Unit_State state {};
+        masked_model->model.get_unit_state (state);
+        set_unit_state (*active_model, state);
+    }
+
+    is_masked_model_running = should_mask;
+    return should_mask;
+}
+
+LSTM_Model::Block_Model LSTM_Model::prepare_block() noexcept
+{
+    auto* model = update_active_model();
+    return { .active_model = model, .is_masked = update_masking() };
+}
+
+void LSTM_Model::process (std::span<float* const> channels, int num_samples)
+{
+    process (prepare_block(), channels, num_samples);
+}
+
+void LSTM_Model::process (const Block_Model& block_model, std::span<float* const> channels, int num_samples) noexcept
+{
+    assert (! channels.empty() && channels.size() <= max_num_streams);
+
+    if (block_model.is_masked)
+    {
+        masked_model->model.process (channels, num_samples);
+        return;
+    }
+
+    if (block_model.active_model == nullptr)
+        return;
+
+    std::visit ([channels, num_samples] (auto& m)
+                { m.process (channels, num_samples); },
+                *block_model.active_model);
+}
 
 // clang-format off
-std::array<Pruning_Candidate, 84> min_weights_pruning_candidates {
+static const std::array<Pruning_Candidate, 84> min_weights_pruning_candidates {
     Pruning_Candidate { 72, 2.13087 }, { 43, 2.16598 }, { 50, 2.21253 }, { 26, 2.24956 }, { 30, 2.28832 }, { 29, 2.29673 }, { 0, 2.34003 }, { 22, 2.341 }, { 46, 2.35479 }, { 35, 2.356 }, { 41, 2.37336 }, { 3, 2.37712 }, { 56, 2.38788 }, { 24, 2.39144 }, { 5, 2.40586 }, { 21, 2.41391 }, { 59, 2.41807 }, { 57, 2.42462 }, { 53, 2.4294 }, { 31, 2.42972 }, { 1, 2.44275 }, { 52, 2.45693 }, { 70, 2.46812 }, { 82, 2.47018 }, { 55, 2.48423 }, { 73, 2.48888 }, { 14, 2.49051 }, { 40, 2.53333 }, { 16, 2.53497 }, { 28, 2.54347 }, { 69, 2.55042 }, { 74, 2.55634 }, { 44, 2.59142 }, { 78, 2.60429 }, { 54, 2.65403 }, { 6, 2.65591 }, { 18, 2.67383 }, { 61, 2.67644 }, { 38, 2.69066 }, { 23, 2.71 }, { 7, 2.72789 }, { 81, 2.75511 }, { 8, 2.762 }, { 67, 2.76214 }, { 33, 2.77666 }, { 60, 2.80929 }, { 37, 2.81476 }, { 77, 2.8367 }, { 17, 2.85831 }, { 34, 2.91079 }, { 76, 2.93731 }, { 25, 3.01386 }, { 32, 3.01935 }, { 20, 3.03626 }, { 10, 3.03828 }, { 13, 3.06551 }, { 11, 3.08843 }, { 75, 3.11159 }, { 36, 3.19877 }, { 42, 3.46591 }, { 51, 3.47466 }, { 79, 3.48881 }, { 71, 3.49033 }, { 83, 3.5835 }, { 68, 3.59203 }, { 62, 3.59366 }, { 27, 3.66916 }, { 64, 3.70499 }, { 45, 3.73703 }, { 63, 3.74909 }, { 48, 4.02339 }, { 2, 4.03817 }, { 58, 5.0306 }, { 9, 5.33691 }, { 12, 5.35558 }, { 39, 5.43005 }, { 49, 5.57972 }, { 80, 5.9916 }, { 15, 6.3741 }, { 66, 6.5782 }, { 19, 6.59422 }, { 4, 7.28951 }, { 47, 10.3351 }, { 65, 14.7341 }
 };
 
-std::array<Pruning_Candidate, 84> mean_activations_pruning_candidates {
+static const std::array<Pruning_Candidate, 84> mean_activations_pruning_candidates {
         Pruning_Candidate { 29, 0.0132998 }, { 64, 0.0133761 }, { 27, 0.0135199 }, { 79, 0.0165395 }, { 8, 0.0179986 }, { 9, 0.0191356 }, { 82, 0.0210732 }, { 43, 0.0235517 }, { 80, 0.0359793 }, { 6, 0.0373224 }, { 25, 0.0378705 }, { 50, 0.0381939 }, { 73, 0.0400595 }, { 83, 0.0403435 }, { 58, 0.0424952 }, { 55, 0.0431771 }, { 20, 0.044029 }, { 45, 0.044879 }, { 3, 0.0451507 }, { 17, 0.0471593 }, { 63, 0.0485305 }, { 61, 0.0490895 }, { 69, 0.0518686 }, { 26, 0.0538845 }, { 11, 0.0543172 }, { 74, 0.0547031 }, { 31, 0.0562666 }, { 33, 0.0562711 }, { 0, 0.0571548 }, { 14, 0.0586037 }, { 68, 0.0586206 }, { 71, 0.0587797 }, { 1, 0.0594811 }, { 24, 0.0596107 }, { 38, 0.0618862 }, { 22, 0.0649005 }, { 72, 0.0663892 }, { 41, 0.0688667 }, { 53, 0.069353 }, { 77, 0.0696635 }, { 15, 0.073035 }, { 57, 0.0735088 }, { 23, 0.0746521 }, { 16, 0.0750336 }, { 37, 0.0808879 }, { 32, 0.0828361 }, { 48, 0.0832864 }, { 35, 0.0839906 }, { 42, 0.0842802 }, { 51, 0.0850634 }, { 62, 0.0858261 }, { 40, 0.0859704 }, { 21, 0.0868093 }, { 70, 0.0872767 }, { 34, 0.0903506 }, { 44, 0.0920573 }, { 18, 0.0922123 }, { 59, 0.0924761 }, { 10, 0.0930473 }, { 7, 0.0960455 }, { 46, 0.0964477 }, { 81, 0.0971485 }, { 2, 0.0972837 }, { 60, 0.0988093 }, { 78, 0.103287 }, { 30, 0.105419 }, { 4, 0.106479 }, { 28, 0.108821 }, { 36, 0.108999 }, { 76, 0.109056 }, { 75, 0.119486 }, { 5, 0.122386 }, { 54, 0.122934 }, { 13, 0.123083 }, { 56, 0.125901 }, { 52, 0.128307 }, { 67, 0.130226 }, { 65, 0.161434 }, { 19, 0.162559 }, { 39, 0.170058 }, { 47, 0.191377 }, { 66, 0.197024 }, { 12, 0.210609 }, { 49, 0.243554 }
 };
 
-std::array<Pruning_Candidate, 84> minimization_pruning_candidates {
+static const std::array<Pruning_Candidate, 84> minimization_pruning_candidates {
     Pruning_Candidate { 19, 0.00606051 }, { 4, 0.00620896 }, { 66, 0.0062759 }, { 70, 0.00639654 }, { 71, 0.00643949 }, { 58, 0.00650497 }, { 65, 0.00652915 }, { 63, 0.00657849 }, { 51, 0.00686096 }, { 36, 0.00688572 }, { 73, 0.00691499 }, { 27, 0.00697249 }, { 76, 0.00698026 }, { 33, 0.00698058 }, { 67, 0.00701391 }, { 79, 0.00701659 }, { 43, 0.00705165 }, { 0, 0.00705538 }, { 46, 0.00705574 }, { 17, 0.00706225 }, { 48, 0.00707649 }, { 82, 0.00708469 }, { 25, 0.00709425 }, { 64, 0.00709634 }, { 24, 0.00710677 }, { 45, 0.00710999 }, { 75, 0.00711259 }, { 38, 0.00714537 }, { 54, 0.00716586 }, { 23, 0.00719438 }, { 3, 0.00719887 }, { 78, 0.00720026 }, { 29, 0.00720928 }, { 50, 0.00721218 }, { 7, 0.00721311 }, { 8, 0.00722475 }, { 80, 0.00723986 }, { 22, 0.00724129 }, { 30, 0.0072538 }, { 5, 0.007261 }, { 11, 0.00727795 }, { 9, 0.00728314 }, { 74, 0.00732124 }, { 10, 0.00733704 }, { 83, 0.00737063 }, { 55, 0.00737387 }, { 69, 0.00738152 }, { 72, 0.00738244 }, { 20, 0.00740705 }, { 41, 0.00746363 }, { 61, 0.00756913 }, { 57, 0.00772047 }, { 6, 0.00772506 }, { 77, 0.00777376 }, { 15, 0.0079304 }, { 16, 0.00801656 }, { 62, 0.00804156 }, { 68, 0.00804431 }, { 18, 0.0080775 }, { 26, 0.00812511 }, { 81, 0.00815514 }, { 2, 0.00841405 }, { 1, 0.00842687 }, { 14, 0.00852634 }, { 31, 0.00859142 }, { 60, 0.00860939 }, { 35, 0.00864655 }, { 13, 0.00867723 }, { 34, 0.00872107 }, { 47, 0.00874136 }, { 37, 0.00882984 }, { 32, 0.0088991 }, { 49, 0.00906185 }, { 59, 0.00915053 }, { 40, 0.00918585 }, { 56, 0.00924993 }, { 21, 0.00936529 }, { 53, 0.00968861 }, { 44, 0.00991494 }, { 42, 0.0100489 }, { 52, 0.0101871 }, { 12, 0.0113176 }, { 39, 0.0123618 }, { 28, 0.0158604 }
 };
 // clang-format on
 
-static nlohmann::json prune (nlohmann::json model_json,
-                             std::span<Pruning_Candidate> candidates_to_prune,
-                             int start,
-                             int num)
+std::span<const Pruning_Candidate, LSTM_Model::max_hidden_size> LSTM_Model::get_pruning_candidates (Ranking ranking)
 {
-    for (int prune_idx = start; prune_idx < start + num; ++prune_idx)
-    {
-        const auto& to_prune = candidates_to_prune[prune_idx];
-        const auto hidden_size = model_json["layers"][0]["shape"].back().get<int>();
-        auto& lstm_weights = model_json["layers"][0]["weights"];
-        auto& kernel_weights = lstm_weights.at (0);
-        auto& recurrent_weights = lstm_weights.at (1);
-        auto& biases = lstm_weights.at (2);
-        auto& dense_weights = model_json["layers"][1]["weights"][0];
-
-        kernel_weights[0].erase (to_prune.idx + 3 * hidden_size);
-        kernel_weights[0].erase (to_prune.idx + 2 * hidden_size);
-        kernel_weights[0].erase (to_prune.idx + 1 * hidden_size);
-        kernel_weights[0].erase (to_prune.idx + 0 * hidden_size);
-
-        for (int i = 0; i < hidden_size; ++i)
-        {
-            recurrent_weights[i].erase (to_prune.idx + 3 * hidden_size);
-            recurrent_weights[i].erase (to_prune.idx + 2 * hidden_size);
-            recurrent_weights[i].erase (to_prune.idx + 1 * hidden_size);
-            recurrent_weights[i].erase (to_prune.idx + 0 * hidden_size);
-        }
-        recurrent_weights.erase (to_prune.idx);
+    if (ranking == Ranking::Min_Weights)
+        return min_weights_pruning_candidates;
+    if (ranking == Ranking::Mean_Activations)
+        return mean_activations_pruning_candidates;
+    return minimization_pruning_candidates;
+}
 
-        biases.erase (to_prune.idx + 3 * hidden_size);
-        biases.erase (to_prune.idx + 2 * hidden_size);
-        biases.erase (to_prune.idx + 1 * hidden_size);
-        biases.erase (to_prune.idx + 0 * hidden_size);
+std::vector<int> LSTM_Model::get_surviving_units (int pruned_hidden_size, Ranking ranking)
+{
+    std::array<bool, max_hidden_size> is_pruned {};
+    const auto pruning_candidates = get_pruning_candidates (ranking);
+    for (int prune_idx = 0; prune_idx < max_hidden_size - pruned_hidden_size; ++prune_idx)
+        is_pruned[(size_t) pruning_candidates[(size_t) prune_idx].idx] = true;
 
-        dense_weights.erase (to_prune.idx);
+    std::vector<int> unit_positions {};
+    unit_positions.reserve ((size_t) pruned_hidden_size);
+    for (int k = 0; k < max_hidden_size; ++k)
+        if (! is_pruned[(size_t) k])
+            unit_positions.push_back (k);
+    return unit_positions;
+}
 
-        model_json["layers"][0]["shape"].back() = hidden_size - 1;
+LSTM_Model::Shared_Weights LSTM_Model::make_shared_weights (const LSTM_Weights& weights,
+                                                             std::span<const int> unit_positions,
+                                                             Weight_Format format)
+{
+    Shared_Weights shared_weights {};
+    visit_model_size (get_model_size ((int) unit_positions.size()),
+                      [&] (auto model_size)
+                      { shared_weights = Model<model_size>::make_weights (weights, unit_positions, format); });
+    return shared_weights;
+}
 
-        for (int fix_idx = prune_idx; fix_idx < candidates_to_prune.size(); ++fix_idx)
-        {
-            auto& to_fix = candidates_to_prune[fix_idx];
-            if (to_fix.idx > to_prune.idx)
-                to_fix.idx--;
-        }
-    }
+LSTM_Model::Shared_Weights LSTM_Model::make_shared_weights (const Interleaved_LSTM_Weights& weights)
+{
+    Shared_Weights shared_weights {};
+    visit_model_size (get_model_size (weights.hidden_size),
+                      [&] (auto model_size)
+                      { shared_weights = Model<model_size>::make_weights (weights); });
+    return shared_weights;
+}
 
-    return model_json;
+std::unique_ptr<LSTM_Model::Model_Variant> LSTM_Model::make_model (int hidden_size, const Shared_Weights& weights)
+{
+    auto new_model = make_model_variant (hidden_size);
+    std::visit (
+        [&weights] (auto& model)
+        {
+            // the weights were built for the same model size, so we know their type
+            using Weights = typename std::decay_t<decltype (model)>::Weights;
+            model.set_weights (std::static_pointer_cast<const Weights> (weights));
+        },
+        *new_model);
+    return new_model;
 }
 
-void LSTM_Model::prune (int pruned_hidden_size, Ranking ranking)
+bool LSTM_Model::prune (int pruned_hidden_size, Ranking ranking, const std::function<bool()>& should_cancel)
 {
-    chowdsp::log ("Pruning to hidden size {} with ranking {}",
-                  pruned_hidden_size,
-                  magic_enum::enum_name (ranking));
+    // gather the surviving units once, and then copy their weights straight into the new model
+    const auto unit_positions = get_surviving_units (pruned_hidden_size, ranking);
 
-    std::span<Pruning_Candidate> pruning_candidates {};
-    if (ranking == Ranking::Min_Weights)
-        pruning_candidates = min_weights_pruning_candidates;
-    else if (ranking == Ranking::Mean_Activations)
-        pruning_candidates = mean_activations_pruning_candidates;
-    else if (ranking == Ranking::Minimization)
-        pruning_candidates = minimization_pruning_candidates;
-
-    const auto pruned_model = ::prune (original_model_json, pruning_candidates, 0, max_hidden_size - pruned_hidden_size);
-    load (pruned_model);
+    if (should_cancel != nullptr && should_cancel())
+        return false;
+
+    free_retired_model();
+    auto new_model = make_model_variant (pruned_hidden_size);
+    std::visit ([this, &unit_positions] (auto& model)
+                { model.load (*original_weights, unit_positions); },
+                *new_model);
+
+    publish_model (std::move (new_model));
+    return true;
 }
@@ -1,8 +1,18 @@
 #pragma once
 
-#include <juce_core/juce_core.h>
 #include <RTNeural/RTNeural.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <memory>
 #include <span>
+#include <variant>
+
+#include "lstm_layer.h"
+#include "lstm_weights.h"
+
+struct Interleaved_LSTM_Weights;
 
 enum class Ranking
 {
@@ -11,17 +21,187 @@ enum class Ranking
     Minimization = 4,
 };
 
+struct Pruning_Candidate
+{
+    int idx {};
+    float value { 0.0f };
+};
+
+struct Masked_LSTM_Model;
+
 struct LSTM_Model
 {
     static constexpr int input_size = 1;
     static constexpr int max_hidden_size = 84;
     static constexpr int min_hidden_size = 48;
+    static constexpr int max_num_streams = LSTM_Layer<max_hidden_size>::max_num_streams;
+
+#ifndef LSTM_MODEL_GRID
+#define LSTM_MODEL_GRID 1
+#endif
+    /**
+     * Only hidden sizes that are a multiple of the model grid get their own
+     * Model<> instantiation. Other sizes run in the next model up the grid,
+     * with the extra units zero-padded. A unit with all-zero weights has its
+     * cell and hidden state stuck at zero, so it's effectively masked out.
+     *
+     * A grid of 1 instantiates every hidden size (the most efficient at
+     * run-time), whereas a grid of 4 or 8 cuts down the compile time and
+     * binary size, while keeping the model sizes SIMD-friendly.
+     */
+    static constexpr int model_grid = LSTM_MODEL_GRID;
+    static_assert (model_grid == 1 || model_grid == 2 || model_grid == 4 || model_grid == 8,
+                   "Larger grids would push the padded model above Eigen's fixed-size allocation limit");
+    static_assert (min_hidden_size % model_grid == 0);
+
+    /** Returns the size of the model that a given hidden size will run in. */
+    static constexpr int get_model_size (int hidden_size)
+    {
+        return ((hidden_size + model_grid - 1) / model_grid) * model_grid;
+    }
+    static constexpr int max_model_size = ((max_hidden_size + model_grid - 1) / model_grid) * model_grid;
+
+    /** The recurrent state of every stream, indexed by the original (un-pruned) hidden unit. */
+    struct Unit_State
+    {
+        std::array<std::array<float, max_hidden_size>, max_num_streams> h {};
+        std::array<std::array<float, max_hidden_size>, max_num_streams> c {};
+    };
 
     template <int hidden_size>
     struct Model
     {
-        RTNeural::LSTMLayerT<float, 1, hidden_size> lstm {};
-        RTNeural::DenseT<float, hidden_size, 1> dense {};
+        /** Read-only weights, which are shared between every model that runs the same pruned network. */
+        struct Weights
+        {
+            typename LSTM_Layer<hidden_size>::Weights lstm {};
+            Eigen::Matrix<float, hidden_size, 1> dense = Eigen::Matrix<float, hidden_size, 1>::Zero();
+            float dense_bias {};
+
+            /** The original index of each unit in the model (or -1 for the zero-padded units). */
+            std::array<int, hidden_size> units {};
+        };
+
+        std::shared_ptr<const Weights> weights {};
+        LSTM_Layer<hidden_size> lstm {};
+
+        float forward (float x) noexcept
+        {
+            lstm.forward (x);
+            return weights->dense.dot (lstm.outs.col (0)) + weights->dense_bias;
+        }
+
+        /** Processes a block of samples in-place, running each channel as a separate stream. */
+        void process (std::span<float* const> channels, int num_samples) noexcept
+        {
+            if (channels.size() == 1)
+                process_streams<1> ({ channels[0] }, num_samples);
+            else
+                process_streams<2> ({ channels[0], channels[1] }, num_samples);
+        }
+
+        template <int num_streams>
+        void process_streams (const std::array<float*, num_streams>& channels, int num_samples) noexcept
+        {
+            static constexpr auto max_block_size = LSTM_Layer<hidden_size>::max_block_size;
+            for (int start = 0; start < num_samples; start += max_block_size)
+            {
+                const auto block_size = std::min (num_samples - start, max_block_size);
+
+                std::array<const float*, num_streams> block_in {};
+                for (size_t stream = 0; stream < num_streams; ++stream)
+                    block_in[stream] = channels[stream] + start;
+                lstm.template forward_block<num_streams> (block_in, block_size);
+
+                // apply the dense head to the whole sub-block at once
+                for (size_t stream = 0; stream < num_streams; ++stream)
+                {
+                    auto out = Eigen::Map<Eigen::Matrix<float, 1, Eigen::Dynamic>> { channels[stream] + start, block_size };
+                    out.noalias() = weights->dense.transpose() * lstm.hidden_states[stream].leftCols (block_size);
+                    out.array() += weights->dense_bias;
+                }
+            }
+        }
+
+        /** Returns the number of units that the model is running (i.e. not counting any zero-padded units). */
+        int get_num_units() const noexcept
+        {
+            return (int) std::count_if (weights->units.begin(), weights->units.end(), [] (int unit)
+                                        { return unit >= 0; });
+        }
+
+        static constexpr int state_size = 2 * hidden_size;
+
+        /** Copies out the recurrent state (hidden state, then cell state) of the first stream. */
+        void get_state (std::span<float> state) const noexcept
+        {
+            Eigen::Map<Eigen::Matrix<float, hidden_size, 1>> { state.data() } = lstm.outs.col (0);
+            Eigen::Map<Eigen::Matrix<float, hidden_size, 1>> { state.data() + hidden_size } = lstm.cell.col (0);
+        }
+
+        /** Sets the recurrent state of the first stream (in the same layout as get_state()). */
+        void set_state (std::span<const float> state) noexcept
+        {
+            lstm.outs.col (0) = Eigen::Map<const Eigen::Matrix<float, hidden_size, 1>> { state.data() };
+            lstm.cell.col (0) = Eigen::Map<const Eigen::Matrix<float, hidden_size, 1>> { state.data() + hidden_size };
+        }
+
+        /** Copies out the state of every stream, for each of the model's (original) units. */
+        void get_unit_state (Unit_State& state) const noexcept
+        {
+            for (int k = 0; k < hidden_size; ++k)
+            {
+                const auto unit = weights->units[(size_t) k];
+                if (unit < 0)
+                    continue;
+
+                for (size_t stream = 0; stream < (size_t) max_num_streams; ++stream)
+                {
+                    state.h[stream][(size_t) unit] = lstm.outs (k, (int) stream);
+                    state.c[stream][(size_t) unit] = lstm.cell (k, (int) stream);
+                }
+            }
+        }
+
+        /** Sets the state of every stream from get_unit_state(), for each of the model's (original) units. */
+        void set_unit_state (const Unit_State& state) noexcept
+        {
+            for (int k = 0; k < hidden_size; ++k)
+            {
+                const auto unit = weights->units[(size_t) k];
+                for (size_t stream = 0; stream < (size_t) max_num_streams; ++stream)
+                {
+                    lstm.outs (k, (int) stream) = unit < 0 ? 0.0f : state.h[stream][(size_t) unit];
+                    lstm.cell (k, (int) stream) = unit < 0 ? 0.0f : state.c[stream][(size_t) unit];
+                }
+            }
+        }
+
+        /**
+         * Builds a set of weights by gathering the hidden units at the given positions from
+         * a larger set of weights. If there are fewer positions than units in the model,
+         * the rest are zero-padded. The recurrent weights are then quantized to the given format
+         * (for the Interleaved format, the units are gathered straight into Interleaved_LSTM_Weights).
+         */
+        static std::shared_ptr<const Weights> make_weights (const LSTM_Weights& weights,
+                                                            std::span<const int> unit_positions,
+                                                            Weight_Format format = Weight_Format::Float32);
+
+        /** Builds a set of Interleaved weights, zero-padding any units that the weights don't have. */
+        static std::shared_ptr<const Weights> make_weights (const Interleaved_LSTM_Weights& weights);
+
+        /** Shares a set of weights (which may also be used by other models). */
+        void set_weights (std::shared_ptr<const Weights> new_weights)
+        {
+            lstm.weights = { new_weights, &new_weights->lstm };
+            weights = std::move (new_weights);
+        }
+
+        /** Copies in a set of weights, zero-padding any units that the weights don't have. */
+        void load (const LSTM_Weights& weights);
+
+        /** Gathers the hidden units at the given positions from a larger set of weights (see make_weights()). */
+        void load (const LSTM_Weights& weights, std::span<const int> unit_positions);
     };
 
     template <typename T, typename... Args>
@@ -41,7 +221,7 @@ struct LSTM_Model
     template <int hidden_size>
     struct Model_Variant_Builder
     {
-        using type = typename concatenator<typename Model_Variant_Builder<hidden_size - 1>::type, Model<hidden_size>>::type;
+        using type = typename concatenator<typename Model_Variant_Builder<hidden_size - model_grid>::type, Model<hidden_size>>::type;
     };
 
     template <>
@@ -49,13 +229,135 @@ struct LSTM_Model
     {
         using type = std::variant<Model<min_hidden_size>>;
     };
-    using Model_Variant = Model_Variant_Builder<max_hidden_size>::type;
+    using Model_Variant = Model_Variant_Builder<max_model_size>::type;
+
+    LSTM_Model() = default;
+    ~LSTM_Model();
+
+    /**
+     * Models are built off the audio thread and published via an atomic pointer.
+     * The audio thread picks up the pending model at the start of a block, and
+     * hands the previous model back to be freed on a non-audio thread.
+     */
+    Model_Variant* active_model {}; // only touched by the audio thread
+    std::atomic<Model_Variant*> pending_model {};
+    std::atomic<Model_Variant*> retired_model {};
+
+    std::shared_ptr<const LSTM_Weights> original_weights {};
+
+    /**
+     * The full-size model with per-unit masking (see Masked_LSTM_Model), which runs in
+     * place of the active model whenever the requested masked hidden size doesn't match
+     * the active model's, e.g. while the hidden size is being automated. It takes over
+     * the state of the active model and hands it back, just like a model swap.
+     */
+    std::unique_ptr<Masked_LSTM_Model> masked_model {};
+
+    /** Builds the masked model from the original weights (not real-time safe, call this before processing starts). */
+    void prepare_masked_model();
+
+    /**
+     * Sets the hidden size (and ranking) for the masked model to run with, until a model with
+     * that hidden size becomes active. A hidden size of zero turns the masked model off.
+     * Safe to call from any thread.
+     */
+    void request_masked_hidden_size (int hidden_size, Ranking ranking) noexcept;
+
+    /**
+     * Switches over to (or back from) the masked model, and returns true if the masked
+     * model should run for the next block (audio thread only). Call this after update_active_model().
+     */
+    bool update_masking() noexcept;
+
+    /** How the active model computes its activations (picked up at the start of each block, audio thread only). */
+    Activation activation = Activation::Exact;
+
+    /** The model that runs for a block (see prepare_block()). */
+    struct Block_Model
+    {
+        Model_Variant* active_model {}; // nullptr if no model has been published yet
+        bool is_masked = false; // if true, the masked model runs instead of the active model
+    };
 
-    Model_Variant model_variant {};
-    nlohmann::json original_model_json {};
-    juce::SpinLock model_loading_mutex {};
+    /**
+     * Swaps in the pending model and updates the masking, once per block, and returns
+     * the model to run for the block (audio thread only). Use this when the caller needs
+     * to know which model is running (e.g. for profiling), and then process the block
+     * with that same model.
+     */
+    Block_Model prepare_block() noexcept;
 
-    void load (const nlohmann::json& model_json);
+    void load (const LSTM_Weights& weights);
     void process (std::span<float> data);
-    void prune (int pruned_hidden_size, Ranking ranking);
+    void process (std::span<float* const> channels, int num_samples);
+
+    /** Processes a block with the model from prepare_block(), without swapping models (audio thread only). */
+    void process (const Block_Model& block_model, std::span<float* const> channels, int num_samples) noexcept;
+
+    /**
+     * Swaps in the pending model (if there is one), and returns the active model (audio thread only).
+     * The new model takes over the hidden and cell states of any units that it shares with the
+     * previous model, so it picks up right where the previous model left off, without needing
+     * any warm-up. The active model is also updated to use the current activation.
+     */
+    Model_Variant* update_active_model() noexcept;
+
+    /**
+     * Prunes the original model and loads the result (not real-time safe).
+     * Returns false if the prune was cancelled via should_cancel before the
+     * pruned model could be published.
+     */
+    bool prune (int pruned_hidden_size, Ranking ranking, const std::function<bool()>& should_cancel = {});
+
+    /** Returns the hidden units in the order that they should be pruned for a given ranking. */
+    static std::span<const Pruning_Candidate, max_hidden_size> get_pruning_candidates (Ranking ranking);
+
+    /** Returns the (original) indices of the hidden units that survive a prune, in ascending order. */
+    static std::vector<int> get_surviving_units (int pruned_hidden_size, Ranking ranking);
+
+    /**
+     * Model weights with the type erased (i.e. a Model<N>::Weights, where N is the
+     * model size for the number of units), so that they can be stored and shared
+     * between models without knowing the model size at compile-time.
+     */
+    using Shared_Weights = std::shared_ptr<const void>;
+
+    /** Builds the weights for a model that runs the hidden units at the given positions (not real-time safe). */
+    static Shared_Weights make_shared_weights (const LSTM_Weights& weights,
+                                               std::span<const int> unit_positions,
+                                               Weight_Format format = Weight_Format::Float32);
+
+    /** Builds the Interleaved weights for a model that runs all of the given units (not real-time safe). */
+    static Shared_Weights make_shared_weights (const Interleaved_LSTM_Weights& weights);
+
+    /** Creates a model that shares weights from make_shared_weights() with the same hidden size (not real-time safe). */
+    static std::unique_ptr<Model_Variant> make_model (int hidden_size, const Shared_Weights& weights);
+
+    /**
+     * Measures how long it takes a model with the given hidden size to process
+     * one sample for all the streams (in nanoseconds) on the running machine
+     * (not real-time safe).
+     */
+    static double measure_ns_per_sample (int hidden_size,
+                                         const LSTM_Weights& weights,
+                                         int num_streams = 1,
+                                         Weight_Format format = Weight_Format::Float32,
+                                         Activation activation = Activation::Exact);
+
+    /** Hands a newly built model over to the audio thread. */
+    void publish_model (std::unique_ptr<Model_Variant>&& new_model);
+
+    /** Frees the model most recently retired by the audio thread (must not be called from the audio thread!) */
+    void free_retired_model();
+
+    LSTM_Model (const LSTM_Model&) = delete;
+    LSTM_Model& operator= (const LSTM_Model&) = delete;
+
+private:
+    // [ranking (8 bits) | hidden size (8 bits)]
+    std::atomic<uint32_t> masked_request {};
+
+    // audio thread only
+    int active_hidden_size {};
+    bool is_masked_model_running = false;
 };
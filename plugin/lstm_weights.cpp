@@ -0,0 +1,218 @@
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+
+#include "lstm_weights.h"
+
+LSTM_Weights LSTM_Weights::from_json (const nlohmann::json& model_json)
+{
+    LSTM_Weights weights {};
+    weights.hidden_size = model_json["layers"][0]["shape"].back().get<int>();
+    weights.data.resize (num_weights (weights.hidden_size));
+    weights.units.resize (weights.size());
+    std::iota (weights.units.begin(), weights.units.end(), 0);
+
+    const auto& lstm_weights = model_json["layers"][0]["weights"];
+    const auto& dense_weights = model_json["layers"][1]["weights"];
+    const auto H = weights.size();
+
+    auto kernel = weights.kernel();
+    for (size_t k = 0; k < 4 * H; ++k)
+        kernel[k] = lstm_weights[0][0][k].get<float>();
+
+    auto recurrent = weights.recurrent();
+    for (size_t j = 0; j < H; ++j)
+        for (size_t k = 0; k < 4 * H; ++k)
+            recurrent[j * 4 * H + k] = lstm_weights[1][j][k].get<float>();
+
+    auto bias = weights.bias();
+    for (size_t k = 0; k < 4 * H; ++k)
+        bias[k] = lstm_weights[2][k].get<float>();
+
+    auto dense = weights.dense();
+    for (size_t j = 0; j < H; ++j)
+        dense[j] = dense_weights[0][j][0].get<float>();
+    weights.dense_bias() = dense_weights[1][0].get<float>();
+
+    return weights;
+}
+
+nlohmann::json LSTM_Weights::to_json() const
+{
+    const auto H = size();
+    const auto kernel_weights = kernel();
+    const auto recurrent_weights = recurrent();
+    const auto dense_weights = dense();
+
+    auto recurrent_json = nlohmann::json::array();
+    for (size_t j = 0; j < H; ++j)
+        recurrent_json.push_back (std::vector<float> (recurrent_weights.begin() + (std::ptrdiff_t) (j * 4 * H),
+                                                      recurrent_weights.begin() + (std::ptrdiff_t) ((j + 1) * 4 * H)));
+
+    auto dense_json = nlohmann::json::array();
+    for (const auto w : dense_weights)
+        dense_json.push_back ({ w });
+
+    return {
+        { "in_shape", { nullptr, nullptr, 1 } },
+        { "layers",
+          {
+              {
+                  { "type", "lstm" },
+                  { "activation", "tanh" },
+                  { "shape", { nullptr, nullptr, hidden_size } },
+                  { "weights",
+                    {
+                        { std::vector<float> (kernel_weights.begin(), kernel_weights.end()) },
+                        recurrent_json,
+                        std::vector<float> (bias().begin(), bias().end()),
+                    } },
+              },
+              {
+                  { "type", "dense" },
+                  { "activation", "" },
+                  { "shape", { nullptr, nullptr, 1 } },
+                  { "weights", { dense_json, { dense_bias() } } },
+              },
+          } },
+    };
+}
+
+LSTM_Weights LSTM_Weights::gather_units (std::span<const int> unit_positions) const
+{
+    const auto H = size();
+    LSTM_Weights gathered {};
+    gathered.hidden_size = static_cast<int> (unit_positions.size());
+    gathered.data.resize (num_weights (gathered.hidden_size));
+    gathered.units.reserve (unit_positions.size());
+    for (const auto position : unit_positions)
+        gathered.units.push_back (units[static_cast<size_t> (position)]);
+
+    const auto new_H = gathered.size();
+    const auto gather_gates = [new_H, H, unit_positions] (const float* src, float* dest)
+    {
+        for (size_t gate = 0; gate < 4; ++gate)
+            for (size_t k = 0; k < new_H; ++k)
+                dest[gate * new_H + k] = src[gate * H + static_cast<size_t> (unit_positions[k])];
+    };
+
+    gather_gates (kernel().data(), gathered.kernel().data());
+    for (size_t j = 0; j < new_H; ++j)
+        gather_gates (recurrent().data() + static_cast<size_t> (unit_positions[j]) * 4 * H, gathered.recurrent().data() + j * 4 * new_H);
+    gather_gates (bias().data(), gathered.bias().data());
+    for (size_t j = 0; j < new_H; ++j)
+        gathered.dense()[j] = dense()[static_cast<size_t> (unit_positions[j])];
+    gathered.dense_bias() = dense_bias();
+
+    return gathered;
+}
+
+LSTM_Weights LSTM_Weights::without_unit (int original_unit) const
+{
+    assert (std::find (units.begin(), units.end(), original_unit) != units.end());
+
+    std::vector<int> unit_positions {};
+    unit_positions.reserve (units.size());
+    for (size_t position = 0; position < units.size(); ++position)
+        if (units[position] != original_unit)
+            unit_positions.push_back (static_cast<int> (position));
+
+    return gather_units (unit_positions);
+}
+
+struct Binary_Header
+{
+    std::array<char, 4> magic { 'N', 'P', 'L', 'W' };
+    uint32_t version {};
+    uint32_t input_size {};
+    uint32_t hidden_size {};
+    uint32_t num_weights {};
+    uint32_t data_offset {};
+    std::array<uint32_t, 10> reserved {};
+};
+static_assert (sizeof (Binary_Header) == 64);
+
+static uint32_t to_little_endian (uint32_t x)
+{
+    if constexpr (std::endian::native == std::endian::little)
+        return x;
+    return ((x & 0xff) << 24) | ((x & 0xff00) << 8) | ((x >> 8) & 0xff00) | (x >> 24);
+}
+
+static uint32_t from_little_endian (uint32_t x)
+{
+    return to_little_endian (x); // byte-swapping is its own inverse
+}
+
+std::optional<LSTM_Weights> LSTM_Weights::from_binary (std::span<const std::byte> blob, std::shared_ptr<const void> storage)
+{
+    Binary_Header header {};
+    if (blob.size() < sizeof (Binary_Header))
+        return std::nullopt;
+    std::memcpy (&header, blob.data(), sizeof (Binary_Header));
+
+    if (header.magic != Binary_Header {}.magic
+        || from_little_endian (header.version) != binary_format_version
+        || from_little_endian (header.input_size) != 1)
+        return std::nullopt;
+
+    LSTM_Weights weights {};
+    weights.hidden_size = static_cast<int> (from_little_endian (header.hidden_size));
+    const auto num_floats = static_cast<size_t> (from_little_endian (header.num_weights));
+    const auto data_offset = static_cast<size_t> (from_little_endian (header.data_offset));
+    if (weights.hidden_size <= 0
+        || num_floats != num_weights (weights.hidden_size)
+        || data_offset < sizeof (Binary_Header)
+        || blob.size() < data_offset + num_floats * sizeof (float))
+        return std::nullopt;
+
+    const auto* weights_data = blob.data() + data_offset;
+    if (storage != nullptr
+        && std::endian::native == std::endian::little
+        && reinterpret_cast<uintptr_t> (weights_data) % alignof (float) == 0)
+    {
+        weights.borrowed = { reinterpret_cast<const float*> (weights_data), num_floats };
+        weights.borrowed_storage = std::move (storage);
+    }
+    else
+    {
+        weights.data.resize (num_floats);
+        std::memcpy (weights.data.data(), weights_data, num_floats * sizeof (float));
+        if constexpr (std::endian::native != std::endian::little)
+        {
+            for (auto& x : weights.data)
+                x = std::bit_cast<float> (from_little_endian (std::bit_cast<uint32_t> (x)));
+        }
+    }
+
+    weights.units.resize (weights.size());
+    std::iota (weights.units.begin(), weights.units.end(), 0);
+
+    return weights;
+}
+
+std::vector<std::byte> LSTM_Weights::to_binary() const
+{
+    Binary_Header header {};
+    header.version = to_little_endian (binary_format_version);
+    header.input_size = to_little_endian (1);
+    header.hidden_size = to_little_endian (static_cast<uint32_t> (hidden_size));
+    const auto weights_values = values();
+    header.num_weights = to_little_endian (static_cast<uint32_t> (weights_values.size()));
+    header.data_offset = to_little_endian (static_cast<uint32_t> (sizeof (Binary_Header)));
+
+    std::vector<std::byte> blob (sizeof (Binary_Header) + weights_values.size() * sizeof (float));
+    std::memcpy (blob.data(), &header, sizeof (Binary_Header));
+
+    auto* weights_data = blob.data() + sizeof (Binary_Header);
+    for (const auto x : weights_values)
+    {
+        const auto x_le = to_little_endian (std::bit_cast<uint32_t> (x));
+        std::memcpy (weights_data, &x_le, sizeof (float));
+        weights_data += sizeof (float);
+    }
+
+    return blob;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <RTNeural/RTNeural.h>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+/**
+ * LSTM and dense weights stored in a single flat array, using the same
+ * (Keras/RTNeural) ordering as the model JSON:
+ *
+ * kernel [4 * H] | recurrent [H][4 * H] | bias [4 * H] | dense [H] | dense bias [1]
+ *
+ * where the gate blocks are ordered i/f/g/o.
+ *
+ * The weights are normally owned (`data`), but weights loaded with from_binary()
+ * can borrow the blob instead (see values()). The mutable accessors copy borrowed
+ * weights into `data` first, and pruning them returns owned weights.
+ */
+struct LSTM_Weights
+{
+    int hidden_size {};
+    std::vector<float> data {}; // empty if the weights are borrowed
+    std::vector<int> units {}; // indices of the surviving hidden units in the un-pruned model
+
+    /** Returns the weights, whether they're owned or borrowed. */
+    std::span<const float> values() const { return borrowed.empty() ? std::span<const float> { data } : borrowed; }
+
+    static constexpr size_t num_weights (int hidden_size)
+    {
+        const auto H = static_cast<size_t> (hidden_size);
+        return 4 * H + 4 * H * H + 4 * H + H + 1;
+    }
+
+    static LSTM_Weights from_json (const nlohmann::json& model_json);
+
+    /** Writes the weights out as an RTNeural model JSON (the inverse of from_json()). */
+    nlohmann::json to_json() const;
+
+    /**
+     * Binary weights format (all values little-endian):
+     *
+     * [0, 64): header { char magic[4] = "NPLW", u32 version, u32 input_size, u32 hidden_size,
+     *                   u32 num_weights, u32 data_offset, u32 reserved[10] }
+     * [data_offset, data_offset + 4 * num_weights): f32 weights, in the same layout as `data`
+     *
+     * The weights start 64 bytes in, so they stay aligned if the blob is mapped. If `storage`
+     * keeps the blob alive (e.g. a memory-mapped file, or an aliasing pointer with no owner for
+     * static data), the weights borrow the blob instead of copying it, as long as it's aligned
+     * and the host is little-endian. Otherwise they're copied into `data`.
+     */
+    static constexpr uint32_t binary_format_version = 1;
+    static std::optional<LSTM_Weights> from_binary (std::span<const std::byte> blob, std::shared_ptr<const void> storage = {});
+    std::vector<std::byte> to_binary() const;
+
+    std::span<float> kernel() { return { owned_data(), 4 * size() }; }
+    std::span<float> recurrent() { return { owned_data() + 4 * size(), 4 * size() * size() }; }
+    std::span<float> bias() { return { owned_data() + 4 * size() * (size() + 1), 4 * size() }; }
+    std::span<float> dense() { return { owned_data() + 4 * size() * (size() + 2), size() }; }
+    float& dense_bias() { return owned_data()[data.size() - 1]; }
+
+    std::span<const float> kernel() const { return { values().data(), 4 * size() }; }
+    std::span<const float> recurrent() const { return { values().data() + 4 * size(), 4 * size() * size() }; }
+    std::span<const float> bias() const { return { values().data() + 4 * size() * (size() + 1), 4 * size() }; }
+    std::span<const float> dense() const { return { values().data() + 4 * size() * (size() + 2), size() }; }
+    float dense_bias() const { return values().back(); }
+
+    /** Returns the memory used by these weights (including borrowed weights, which are still mapped). */
+    size_t size_bytes() const { return values().size() * sizeof (float) + units.size() * sizeof (int); }
+
+    /** Returns a copy of these weights, keeping only the hidden units at the given positions. */
+    LSTM_Weights gather_units (std::span<const int> unit_positions) const;
+
+    /** Returns a copy of these weights with one hidden unit (indexed in the un-pruned model) removed. */
+    LSTM_Weights without_unit (int original_unit) const;
+
+private:
+    size_t size() const { return static_cast<size_t> (hidden_size); }
+
+    float* owned_data()
+    {
+        if (! borrowed.empty())
+        {
+            data.assign (borrowed.begin(), borrowed.end());
+            borrowed = {};
+            borrowed_storage.reset();
+        }
+        return data.data();
+    }
+
+    std::span<const float> borrowed {};
+    std::shared_ptr<const void> borrowed_storage {};
+};
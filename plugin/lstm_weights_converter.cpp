@@ -0,0 +1,48 @@
+#include <fstream>
+#include <iostream>
+
+#include "lstm_weights.h"
+
+/** Converts an RTNeural LSTM model JSON file into the binary weights format. */
+int main (int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: lstm_weights_converter <model.json> <weights.bin>\n";
+        return 1;
+    }
+
+    std::ifstream json_file { argv[1], std::ifstream::binary };
+    if (! json_file)
+    {
+        std::cerr << "Unable to open model file: " << argv[1] << '\n';
+        return 1;
+    }
+
+    LSTM_Weights weights {};
+    try
+    {
+        nlohmann::json model_json {};
+        json_file >> model_json;
+        weights = LSTM_Weights::from_json (model_json);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Unable to load model file: " << argv[1] << " (" << e.what() << ")\n";
+        return 1;
+    }
+
+    const auto blob = weights.to_binary();
+    std::ofstream binary_file { argv[2], std::ofstream::binary };
+    binary_file.write (reinterpret_cast<const char*> (blob.data()), static_cast<std::streamsize> (blob.size()));
+    binary_file.close();
+    if (! binary_file)
+    {
+        std::cerr << "Unable to write weights file: " << argv[2] << '\n';
+        return 1;
+    }
+
+    std::cout << "Converted model with hidden size " << weights.hidden_size
+              << " (" << blob.size() << " bytes)\n";
+    return 0;
+}
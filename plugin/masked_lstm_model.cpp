@@ -0,0 +1,65 @@
+#include "masked_lstm_model.h"
+#include <numeric>
+
+// gate ordering is i/f/g/o (see LSTM_Layer)
+static constexpr int cell_gate = 2;
+
+Masked_LSTM_Model::Masked_LSTM_Model (const LSTM_Weights& original_weights)
+{
+    assert (original_weights.hidden_size == LSTM_Model::max_hidden_size);
+
+    std::vector<int> unit_positions ((size_t) LSTM_Model::max_hidden_size);
+    std::iota (unit_positions.begin(), unit_positions.end(), 0);
+    full_weights = std::static_pointer_cast<const Model::Weights> (LSTM_Model::make_shared_weights (original_weights, unit_positions));
+
+    masked_weights = std::make_shared<Model::Weights> (*full_weights);
+    model.set_weights (masked_weights);
+}
+
+void Masked_LSTM_Model::set_unit_masked (int unit, bool should_mask) noexcept
+{
+    static constexpr auto model_size = LSTM_Model::max_model_size;
+    static constexpr auto padded_size = LSTM_Layer<model_size>::padded_size;
+
+    const auto& full_lstm = full_weights->lstm;
+    auto& masked_lstm = masked_weights->lstm;
+
+    const auto row = cell_gate * model_size + unit;
+    masked_lstm.kernel (row) = should_mask ? 0.0f : full_lstm.kernel (row);
+    masked_lstm.bias (row) = should_mask ? 0.0f : full_lstm.bias (row);
+
+    // and the same again for the padded copies (the recurrent weights are only stored in the padded layout)
+    const auto packed_row = (size_t) (cell_gate * padded_size + unit);
+    masked_lstm.packed_kernel[packed_row] = should_mask ? 0.0f : full_lstm.packed_kernel[packed_row];
+    masked_lstm.packed_bias[packed_row] = should_mask ? 0.0f : full_lstm.packed_bias[packed_row];
+    for (size_t j = 0; j < (size_t) model_size; ++j)
+    {
+        const auto idx = j * 4 * padded_size + packed_row;
+        masked_lstm.packed_recurrent[idx] = should_mask ? 0.0f : full_lstm.packed_recurrent[idx];
+    }
+
+    is_masked[(size_t) unit] = should_mask;
+}
+
+void Masked_LSTM_Model::set_mask (int hidden_size, Ranking ranking) noexcept
+{
+    assert (hidden_size >= LSTM_Model::min_hidden_size && hidden_size <= LSTM_Model::max_hidden_size);
+
+    // the same units that get_surviving_units() would prune (the model's units are in their original order)
+    std::array<bool, LSTM_Model::max_hidden_size> should_mask {};
+    const auto pruning_candidates = LSTM_Model::get_pruning_candidates (ranking);
+    for (int prune_idx = 0; prune_idx < LSTM_Model::max_hidden_size - hidden_size; ++prune_idx)
+        should_mask[(size_t) pruning_candidates[(size_t) prune_idx].idx] = true;
+
+    for (int unit = 0; unit < LSTM_Model::max_hidden_size; ++unit)
+    {
+        if (should_mask[(size_t) unit] != is_masked[(size_t) unit])
+            set_unit_masked (unit, should_mask[(size_t) unit]);
+
+        if (should_mask[(size_t) unit])
+        {
+            model.lstm.outs.row (unit).setZero();
+            model.lstm.cell.row (unit).setZero();
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "lstm_model.h"
+
+/**
+ * The full-size LSTM, with a mask that can switch off any of the hidden units
+ * from the audio thread.
+ *
+ * If a unit's cell-gate (g) weights are zeroed, and its state starts out at zero,
+ * then its cell and hidden state stay at zero, so the network runs exactly like the
+ * pruned network without that unit. Changing the mask only touches the weights of
+ * the units that change, so the hidden size can follow automation instantly, and
+ * the other units carry on with their state. The catch is that every unit still
+ * gets computed, so this always costs the same as the full-size model.
+ *
+ * The model owns its weights (since the mask writes into them), which are always
+ * stored as Float32.
+ */
+struct Masked_LSTM_Model
+{
+    using Model = LSTM_Model::Model<LSTM_Model::max_model_size>;
+
+    /** Builds the model from the un-pruned weights, with every unit switched on (not real-time safe). */
+    explicit Masked_LSTM_Model (const LSTM_Weights& original_weights);
+
+    /**
+     * Masks out the units that a prune to the given hidden size would remove, and
+     * zeros their state (audio thread only).
+     */
+    void set_mask (int hidden_size, Ranking ranking) noexcept;
+
+    Model model {};
+
+private:
+    void set_unit_masked (int unit, bool should_mask) noexcept;
+
+    std::shared_ptr<const Model::Weights> full_weights {};
+    std::shared_ptr<Model::Weights> masked_weights {};
+    std::array<bool, LSTM_Model::max_hidden_size> is_masked {};
+};
@@ -0,0 +1,46 @@
+#include "model_cost_table.h"
+
+bool Model_Cost_Table::measure (const LSTM_Weights& weights, Weight_Format format, Activation activation, const std::function<bool()>& should_cancel)
+{
+    measured_config.store (0, std::memory_order_release);
+    for (int num_streams = 1; num_streams <= LSTM_Model::max_num_streams; ++num_streams)
+    {
+        for (int hidden_size = LSTM_Model::min_hidden_size; hidden_size <= LSTM_Model::max_hidden_size; ++hidden_size)
+        {
+            if (should_cancel != nullptr && should_cancel())
+                return false;
+
+            // hidden sizes that share a model (see LSTM_Model::model_grid) only need to be measured once
+            const auto shares_model = hidden_size > LSTM_Model::min_hidden_size
+                                      && LSTM_Model::get_model_size (hidden_size) == LSTM_Model::get_model_size (hidden_size - 1);
+            const auto cost = shares_model
+                                  ? get_ns_per_sample (hidden_size - 1, num_streams)
+                                  : LSTM_Model::measure_ns_per_sample (hidden_size, weights, num_streams, format, activation);
+            ns_per_sample[(size_t) num_streams - 1][(size_t) (hidden_size - LSTM_Model::min_hidden_size)].store (cost, std::memory_order_relaxed);
+        }
+    }
+
+    measured_config.store (get_config (format, activation), std::memory_order_release);
+    return true;
+}
+
+double Model_Cost_Table::get_ns_per_sample (int hidden_size, int num_streams) const noexcept
+{
+    return ns_per_sample[(size_t) num_streams - 1][(size_t) (hidden_size - LSTM_Model::min_hidden_size)].load (std::memory_order_relaxed);
+}
+
+int Model_Cost_Table::get_largest_hidden_size (double cpu_budget, double network_sample_rate, int num_streams) const noexcept
+{
+    if (measured_config.load (std::memory_order_acquire) == 0)
+        return LSTM_Model::max_hidden_size;
+
+    // the cost isn't strictly monotonic in the hidden size (e.g. some sizes vectorize better), so check them all
+    auto best_hidden_size = LSTM_Model::min_hidden_size;
+    for (int hidden_size = LSTM_Model::min_hidden_size; hidden_size <= LSTM_Model::max_hidden_size; ++hidden_size)
+    {
+        const auto core_fraction = get_ns_per_sample (hidden_size, num_streams) * 1.0e-9 * network_sample_rate;
+        if (core_fraction <= cpu_budget)
+            best_hidden_size = hidden_size;
+    }
+    return best_hidden_size;
+}
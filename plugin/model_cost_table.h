@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+
+#include "lstm_model.h"
+
+/**
+ * Measured per-sample cost of each model size on the running machine,
+ * used to pick the largest model that fits within a CPU budget.
+ *
+ * The cost depends on the weight format and the activations, so the table
+ * holds the costs for one (format, activation) pair at a time, and has to
+ * be measured again when they change.
+ *
+ * measure() should be called from a background thread, after which the
+ * table can be read from any thread.
+ */
+struct Model_Cost_Table
+{
+    /** Benchmarks every model size, for every number of streams, with the given weight format and activations. Returns false if cancelled. */
+    bool measure (const LSTM_Weights& weights, Weight_Format format, Activation activation, const std::function<bool()>& should_cancel = {});
+
+    /** Returns true if the table holds the costs for the given weight format and activations. */
+    bool is_ready (Weight_Format format, Activation activation) const noexcept
+    {
+        return measured_config.load (std::memory_order_acquire) == get_config (format, activation);
+    }
+
+    /** Packs a weight format and activation into a single (non-zero) value. */
+    static uint32_t get_config (Weight_Format format, Activation activation) noexcept
+    {
+        return (static_cast<uint32_t> (static_cast<uint8_t> (format)) << 8) | static_cast<uint32_t> (static_cast<uint8_t> (activation));
+    }
+
+    double get_ns_per_sample (int hidden_size, int num_streams) const noexcept;
+
+    /**
+     * Returns the largest hidden size whose network cost stays below the given
+     * fraction of a CPU core (e.g. 0.02 for 2%, or 1 / RTF). If even the smallest
+     * model doesn't fit, then the smallest model is returned.
+     */
+    int get_largest_hidden_size (double cpu_budget, double network_sample_rate, int num_streams) const noexcept;
+
+private:
+    static constexpr size_t num_sizes = LSTM_Model::max_hidden_size - LSTM_Model::min_hidden_size + 1;
+    std::array<std::array<std::atomic<double>, num_sizes>, LSTM_Model::max_num_streams> ns_per_sample {};
+    std::atomic<uint32_t> measured_config { 0 }; // zero until the first measurement is done
+};
@@ -4,48 +4,381 @@
 #include "neural_pruning_plugin.h"
 #include "plugin_editor.h"
 
-Neural_Pruning_Plugin::Neural_Pruning_Plugin()
+#include <BinaryData.h>
+
+#if ! NEURAL_PRUNING_EMBED_WEIGHTS
+/**
+ * Finds the binary weights that the build installs with the plugin (see plugin/CMakeLists.txt):
+ * in the bundle's Resources folder on macOS, or next to the plugin binary everywhere else.
+ */
+static juce::File find_model_weights_file()
+{
+    // for a plugin, this is the plugin binary rather than the host
+    const auto plugin_binary = juce::File::getSpecialLocation (juce::File::currentExecutableFile);
+    for (const auto& weights_file : { plugin_binary.getParentDirectory().getSiblingFile ("Resources").getChildFile ("lstm_weights.bin"),
+                                      plugin_binary.getSiblingFile ("lstm_weights.bin") })
+    {
+        if (weights_file.existsAsFile())
+            return weights_file;
+    }
+    return {};
+}
+#endif
+
+static LSTM_Weights load_model_weights()
 {
+#if NEURAL_PRUNING_EMBED_WEIGHTS
+    // the embedded data lives as long as the plugin, so the weights can borrow it without an owner
+    const auto weights_blob = std::as_bytes (std::span { BinaryData::lstm_weights_bin, static_cast<size_t> (BinaryData::lstm_weights_binSize) });
+    if (auto weights = LSTM_Weights::from_binary (weights_blob, std::shared_ptr<const void> { std::shared_ptr<const void> {}, weights_blob.data() }))
+        return std::move (*weights);
+#else
+    if (const auto weights_file = find_model_weights_file(); weights_file != juce::File {})
+    {
+        // the weights borrow the mapped file, which stays mapped for as long as they're around
+        auto mapped_file = std::make_shared<const juce::MemoryMappedFile> (weights_file, juce::MemoryMappedFile::readOnly);
+        if (mapped_file->getData() != nullptr)
+        {
+            const auto weights_blob = std::span { static_cast<const std::byte*> (mapped_file->getData()), mapped_file->getSize() };
+            if (auto weights = LSTM_Weights::from_binary (weights_blob, std::move (mapped_file)))
+                return std::move (*weights);
+        }
+    }
+#endif
+    // the JSON fallback reads from the source tree, so it only helps development builds
+    chowdsp::log ("Unable to load binary model weights, falling back to JSON...");
     const auto model_path { std::string { MODELS_DIR } + "/lstm.json" };
-    std::ifstream { model_path, std::ifstream::binary } >> lstm_model.original_model_json;
-    lstm_model.load (lstm_model.original_model_json);
+    nlohmann::json model_json {};
+    std::ifstream { model_path, std::ifstream::binary } >> model_json;
+    return LSTM_Weights::from_json (model_json);
+}
+
+static Feedforward_Weights load_feedforward_weights (const std::string& model_name)
+{
+    // the model JSON files are embedded as binary data (e.g. BinaryData::dense_json)
+    int model_size = 0;
+    const auto* model_data = BinaryData::getNamedResource ((model_name + "_json").c_str(), model_size);
+    const auto model_json = model_data == nullptr
+                                ? nlohmann::json {}
+                                : nlohmann::json::parse (model_data, model_data + model_size, nullptr, false);
+    if (model_json.is_discarded() || ! model_json.contains ("layers"))
+    {
+        chowdsp::log ("Unable to load model weights for the {} network", model_name);
+        return {};
+    }
 
-    for (auto* param : std::initializer_list<juce::RangedAudioParameter*> { state.params.hidden_size.get(), state.params.ranking.get() })
+    return Feedforward_Weights::from_json (model_json);
+}
+
+Neural_Pruning_Plugin::Neural_Pruning_Plugin()
+    : model_store { Shared_Model_Store::get ("lstm", &load_model_weights) },
+      dense_store { Shared_Feedforward_Store::get ("dense", []
+                                                   { return load_feedforward_weights ("dense"); }) },
+      conv_store { Shared_Feedforward_Store::get ("conv", []
+                                                  { return load_feedforward_weights ("conv"); }) }
+{
+    const auto* simd_kernel = lstm_kernels::get_kernel();
+    chowdsp::log ("Using {} LSTM kernels", simd_kernel != nullptr ? simd_kernel->name : "Eigen");
+
+    lstm_model.original_weights = model_store->original_weights;
+    lstm_model.prepare_masked_model();
+    lstm_model.publish_model (model_store->make_model (LSTM_Model::max_hidden_size,
+                                                       state.params.ranking->get(),
+                                                       state.params.weight_format->get()));
+
+    for (auto* param : std::initializer_list<juce::RangedAudioParameter*> {
+             state.params.architecture.get(),
+             state.params.ranking.get(),
+             state.params.weight_format.get(),
+             state.params.cpu_budget_mode.get(),
+             state.params.cpu_budget.get(),
+             state.params.true_stereo.get(),
+             state.params.instant_switching.get(),
+         })
     {
         callbacks += {
             state.addParameterListener (*param,
                                         chowdsp::ParameterListenerThread::MessageThread,
                                         [this]
+                                        { update_pruning(); }),
+        };
+    }
+
+    callbacks += {
+        state.addParameterListener (*state.params.hidden_size,
+                                    chowdsp::ParameterListenerThread::MessageThread,
+                                    [this]
+                                    {
+                                        if (! should_use_instant_switching())
                                         {
-                                            const auto hidden_size = static_cast<int> (state.params.hidden_size->get());
-                                            const auto ranking = state.params.ranking->get();
-                                            lstm_model.prune (hidden_size, ranking);
-                                        }),
+                                            update_pruning();
+                                            return;
+                                        }
+
+                                        // the masked model follows the hidden size straight away,
+                                        // and we only prune once it stops moving
+                                        lstm_model.request_masked_hidden_size (static_cast<int> (state.params.hidden_size->get()),
+                                                                               state.params.ranking->get());
+                                        startTimer (juce::roundToInt (state.params.settle_time->get()));
+                                    }),
+    };
+
+    callbacks += {
+        prune_worker.on_prune_complete.connect (
+            [this] (Architecture architecture, int hidden_size, Ranking ranking)
+            {
+                logger.push_message ("Finished pruning {} network to hidden size {} with ranking {} ({} LSTM model(s) shared between instances)",
+                                     magic_enum::enum_name (architecture),
+                                     hidden_size,
+                                     magic_enum::enum_name (ranking),
+                                     model_store->get_num_shared_weights());
+            }),
+    };
+
+    callbacks += {
+        state.addParameterListener (*state.params.oversampling,
+                                    chowdsp::ParameterListenerThread::MessageThread,
+                                    [this]
+                                    {
+                                        update_latency();
+                                        update_pruning();
+
+                                        // the resampling stages have a different cost in each mode, so start measuring again
+                                        profiler.reset();
+                                    }),
+    };
+
+    for (auto* param : std::initializer_list<juce::RangedAudioParameter*> {
+             state.params.offline_warm_up.get(),
+             state.params.offline_max_error.get(),
+             state.params.oversampling.get(),
+         })
+    {
+        // the offline renderer is rebuilt on the audio thread (since it's not real-time anyway)
+        callbacks += {
+            state.addParameterListener (*param,
+                                        chowdsp::ParameterListenerThread::MessageThread,
+                                        [this]
+                                        { offline_config_changed.store (true, std::memory_order_release); }),
         };
     }
+
+    callbacks += {
+        // the model costs depend on the activations (but otherwise the activation doesn't need a prune)
+        state.addParameterListener (*state.params.activation,
+                                    chowdsp::ParameterListenerThread::MessageThread,
+                                    [this]
+                                    {
+                                        if (state.params.cpu_budget_mode->get())
+                                            update_pruning();
+                                    }),
+        state.addParameterListener (*state.params.cpu_budget_mode,
+                                    chowdsp::ParameterListenerThread::MessageThread,
+                                    [this]
+                                    { update_budget_profiling(); }),
+    };
+
+    callbacks += {
+        prune_worker.on_cost_measurement_complete.connect ([this]
+                                                           { update_pruning(); }),
+    };
+
+    callbacks += {
+        state.addParameterListener (*state.params.accuracy_meter,
+                                    chowdsp::ParameterListenerThread::MessageThread,
+                                    [this]
+                                    { accuracy_meter.set_enabled (state.params.accuracy_meter->get()); }),
+    };
+
+    update_budget_profiling();
+    update_pruning();
+    prune_worker.startThread (juce::Thread::Priority::background);
+    budget_refit_timer.startTimer (2000);
+    accuracy_meter.set_enabled (state.params.accuracy_meter->get());
+    accuracy_meter.startThread (juce::Thread::Priority::low);
+}
+
+bool Neural_Pruning_Plugin::should_use_instant_switching() const
+{
+    // (in CPU budget mode, the hidden size doesn't come from the parameter)
+    return state.params.instant_switching->get()
+           && ! state.params.cpu_budget_mode->get()
+           && state.params.architecture->get() == Architecture::LSTM;
+}
+
+void Neural_Pruning_Plugin::timerCallback()
+{
+    stopTimer();
+    chowdsp::log ("Hidden size settled at {}", static_cast<int> (state.params.hidden_size->get()));
+    update_pruning();
+}
+
+void Neural_Pruning_Plugin::update_budget_profiling()
+{
+    // in CPU budget mode, the resampling stages always get profiled, since their cost comes out of the network's budget
+    const auto should_profile = state.params.cpu_budget_mode->get();
+    if (should_profile == is_profiling_for_budget)
+        return;
+
+    if (should_profile)
+        profiler.add_user();
+    else
+        profiler.remove_user();
+    is_profiling_for_budget = should_profile;
+}
+
+double Neural_Pruning_Plugin::get_network_cpu_budget() const
+{
+    // the resampling stages are timed per host sample
+    const auto sample_rate = getSampleRate() > 0.0 ? getSampleRate() : 48000.0;
+    const auto resampling_ns_per_sample = profiler.get_mean_ns_per_sample (Stage_Profiler::Stage::Upsample)
+                                          + profiler.get_mean_ns_per_sample (Stage_Profiler::Stage::Downsample);
+    const auto cpu_budget = static_cast<double> (state.params.cpu_budget->get());
+    return std::max (cpu_budget - resampling_ns_per_sample * 1.0e-9 * sample_rate, 0.0);
+}
+
+void Neural_Pruning_Plugin::refit_cpu_budget()
+{
+    // the resampling stages keep getting profiled while we run, so the network's
+    // share of the budget can move after the network has been fitted to it
+    if (! state.params.cpu_budget_mode->get())
+        return;
+
+    const auto fitted_budget = fitted_network_cpu_budget.load (std::memory_order_relaxed);
+    if (std::abs (get_network_cpu_budget() - fitted_budget) > 0.1 * fitted_budget)
+        update_pruning();
+}
+
+void Neural_Pruning_Plugin::update_pruning()
+{
+    const auto architecture = state.params.architecture->get();
+    const auto ranking = state.params.ranking->get();
+    const auto weight_format = state.params.weight_format->get();
+
+    // the masked model keeps running until the pruned model for this hidden size is ready
+    lstm_model.request_masked_hidden_size (should_use_instant_switching() ? static_cast<int> (state.params.hidden_size->get()) : 0,
+                                           ranking);
+
+    if (! state.params.cpu_budget_mode->get())
+    {
+        prune_worker.request_prune (static_cast<int> (state.params.hidden_size->get()), ranking, weight_format, architecture);
+        return;
+    }
+
+    const auto sample_rate = getSampleRate() > 0.0 ? getSampleRate() : 48000.0;
+    const auto network_sample_rate = sample_rate * Oversampling::get_ratio (state.params.oversampling->get(), sample_rate);
+    const auto num_streams = state.params.true_stereo->get()
+                                 ? std::clamp (getTotalNumInputChannels(), 1, LSTM_Model::max_num_streams)
+                                 : 1;
+    const auto cpu_budget = static_cast<double> (state.params.cpu_budget->get());
+
+    // whatever the resampling takes comes out of the network's budget
+    const auto network_cpu_budget = get_network_cpu_budget();
+    fitted_network_cpu_budget.store (network_cpu_budget, std::memory_order_relaxed);
+
+    if (architecture != Architecture::LSTM)
+    {
+        // the prune worker measures the pruned Dense/Conv networks itself, since their cost depends on the ranking
+        prune_worker.request_budget_prune (network_cpu_budget * 1.0e9 / network_sample_rate, num_streams, ranking, architecture);
+        return;
+    }
+
+    const auto activation = state.params.activation->get();
+    if (! prune_worker.model_costs.is_ready (weight_format, activation))
+    {
+        // we'll come back here once the costs have been measured
+        prune_worker.request_cost_measurement (weight_format, activation);
+        return;
+    }
+
+    const auto hidden_size = prune_worker.model_costs.get_largest_hidden_size (network_cpu_budget, network_sample_rate, num_streams);
+
+    logger.push_message ("CPU budget of {:.1f}% ({:.1f}% after resampling) at {} Hz ({} stream(s)) fits hidden size {} ({:.1f} ns/sample)",
+                         cpu_budget * 100.0,
+                         network_cpu_budget * 100.0,
+                         network_sample_rate,
+                         num_streams,
+                         hidden_size,
+                         prune_worker.model_costs.get_ns_per_sample (hidden_size, num_streams));
+    prune_worker.request_prune (hidden_size, ranking, weight_format);
+}
+
+void Neural_Pruning_Plugin::update_latency()
+{
+    const auto quality = state.params.oversampling->get();
+    const auto latency_samples = Oversampling::get_latency_samples (quality, getSampleRate()) + offline_batch_size;
+    chowdsp::log ("Oversampling: {} ({}x), latency: {} samples ({} from offline batching)",
+                  magic_enum::enum_name (quality),
+                  Oversampling::get_ratio (quality, getSampleRate()),
+                  latency_samples,
+                  offline_batch_size);
+    setLatencySamples (latency_samples);
 }
 
 void Neural_Pruning_Plugin::prepareToPlay (double sample_rate,
                                            int samples_per_block)
 {
-    const auto os_ratio = sample_rate <= 48000.0 ? 2 : 1;
-
-    const auto mono_spec = juce::dsp::ProcessSpec {
+    // prepare for the maximum number of streams, so we can switch in and out of true-stereo mode
+    const auto spec = juce::dsp::ProcessSpec {
         sample_rate,
         static_cast<uint32_t> (samples_per_block),
-        1,
-    };
-    const auto os_mono_spec = juce::dsp::ProcessSpec {
-        sample_rate * os_ratio,
-        static_cast<uint32_t> (samples_per_block * os_ratio),
-        1,
+        static_cast<uint32_t> (LSTM_Model::max_num_streams),
     };
 
-    upsampler.prepare (mono_spec, os_ratio);
-    downsampler.prepare (os_mono_spec, os_ratio);
+    oversampling.prepare (spec);
 
-    dc_blocker.prepare (mono_spec);
+    // When rendering offline, the network is delayed by a batch of (at least) one
+    // segment per thread, so that the segments can be rendered in parallel. The
+    // batch is set in host samples, so the latency doesn't depend on the oversampling.
+    offline_batcher.reset();
+    offline_renderer.reset();
+    offline_batch_size = isNonRealtime() && juce::SystemStats::getNumCpus() > 1
+                             ? std::max (samples_per_block, juce::SystemStats::getNumCpus() * min_offline_segment_size)
+                             : 0;
+    update_offline_renderer();
+    update_latency();
+
+    // the network's cost depends on the sample rate and oversampling, so re-evaluate the CPU budget
+    if (state.params.cpu_budget_mode->get())
+        update_pruning();
+
+    dc_blocker.prepare (spec);
     dc_blocker.setCutoffFrequency (10.0f);
+
+    auto max_ratio = 1;
+    for (auto quality : magic_enum::enum_values<Oversampling_Quality>())
+        max_ratio = std::max (max_ratio, Oversampling::get_ratio (quality, sample_rate));
+    accuracy_meter.prepare (samples_per_block * max_ratio);
+}
+
+void Neural_Pruning_Plugin::update_offline_renderer()
+{
+    offline_config_changed.store (false, std::memory_order_relaxed);
+    if (offline_batch_size == 0)
+        return;
+
+    const auto sample_rate = getSampleRate();
+    const auto os_ratio = Oversampling::get_ratio (state.params.oversampling->get(), sample_rate);
+    const auto batch_size = offline_batch_size * os_ratio;
+    if (offline_batcher == nullptr || offline_batcher->batch_size != batch_size)
+        offline_batcher = std::make_unique<Offline_Batcher> (batch_size);
+
+    // split each batch evenly between the threads
+    const auto num_threads = juce::SystemStats::getNumCpus();
+    const auto segment_size = std::max (batch_size / num_threads, min_offline_segment_size);
+    const auto warm_up_size = juce::roundToInt (0.001 * state.params.offline_warm_up->get() * sample_rate * os_ratio);
+    offline_renderer = std::make_unique<Segment_Renderer> (Segment_Renderer::Config {
+        .num_threads = num_threads,
+        .segment_size = segment_size,
+        .warm_up_size = warm_up_size,
+        .seam_check_size = 128,
+        .max_seam_error = juce::Decibels::decibelsToGain (state.params.offline_max_error->get()),
+    });
+    chowdsp::log ("Preparing for offline rendering, with {} threads, {} samples per batch, {} samples per segment, and {} samples of warm-up",
+                  offline_renderer->config.num_threads,
+                  batch_size,
+                  segment_size,
+                  warm_up_size);
 }
 
 void Neural_Pruning_Plugin::releaseResources()
@@ -54,25 +387,127 @@ void Neural_Pruning_Plugin::releaseResources()
 
 void Neural_Pruning_Plugin::processAudioBlock (juce::AudioBuffer<float>& buffer)
 {
-    // sum to mono
-    chowdsp::BufferView mono_buffer { buffer, 0, -1, 0, 1 };
-    chowdsp::BufferMath::sumToMono (buffer, mono_buffer);
+    using Stage = Stage_Profiler::Stage;
+    const auto num_samples = buffer.getNumSamples();
+    const auto total_timer = profiler.time_stage (Stage::Total, num_samples);
+
+    oversampling.set_quality (state.params.oversampling->get());
+    if (offline_batcher != nullptr && offline_config_changed.load (std::memory_order_acquire))
+        update_offline_renderer();
+    lstm_model.activation = state.params.activation->get();
+    dense_model.activation = state.params.activation->get();
+    conv_model.activation = state.params.activation->get();
+
+    // in true-stereo mode each channel runs through the network as a separate stream,
+    // otherwise we sum to mono
+    const auto num_streams = state.params.true_stereo->get()
+                                 ? std::min (buffer.getNumChannels(), LSTM_Model::max_num_streams)
+                                 : 1;
+    chowdsp::BufferView process_buffer { buffer, 0, -1, 0, num_streams };
+    if (num_streams == 1)
+    {
+        const auto timer = profiler.time_stage (Stage::Sum_To_Mono, num_samples);
+        chowdsp::BufferMath::sumToMono (buffer, process_buffer);
+    }
 
     // upsample
-    const auto os_buffer = upsampler.process (mono_buffer);
+    const auto os_buffer = [&]
+    {
+        const auto timer = profiler.time_stage (Stage::Upsample, num_samples);
+        return oversampling.upsample (process_buffer);
+    }();
 
     // process neural network
-    lstm_model.process (os_buffer.getWriteSpan (0));
+    {
+        // The models are resolved once per block, and the same models process the
+        // block, so a model that gets published part-way through can't end up running
+        // under the wrong stage. Until the first Dense/Conv model has been built, we keep
+        // running the LSTM.
+        auto architecture = state.params.architecture->get();
+        Feedforward_Model::Model* feedforward_model = nullptr;
+        if (architecture == Architecture::Dense)
+            feedforward_model = dense_model.update_active_model();
+        else if (architecture == Architecture::Conv)
+            feedforward_model = conv_model.update_active_model();
+        if (feedforward_model == nullptr)
+            architecture = Architecture::LSTM;
+
+        LSTM_Model::Block_Model lstm_block {};
+        if (architecture == Architecture::LSTM)
+            lstm_block = lstm_model.prepare_block();
+
+        // the masked LSTM is timed separately, so we can compare the cost of each switching mode
+        const auto network_stage = architecture == Architecture::Dense  ? Stage::Dense
+                                   : architecture == Architecture::Conv ? Stage::Conv
+                                   : lstm_block.is_masked               ? Stage::LSTM_Masked
+                                                                        : Stage::LSTM;
+        const auto timer = profiler.time_stage (network_stage, num_samples);
+        std::array<float*, LSTM_Model::max_num_streams> os_channels {};
+        for (int ch = 0; ch < num_streams; ++ch)
+            os_channels[(size_t) ch] = os_buffer.getWritePointer (ch);
+
+        // the reference model is the full-size LSTM, so there's nothing to compare the Dense/Conv networks against
+        // (and once we switch back to the LSTM, the reference model has to warm up again)
+        if (running_architecture.exchange (architecture, std::memory_order_relaxed) != architecture)
+            accuracy_meter.reset();
+
+        // the reference model only runs on the first stream (and while we're batching offline
+        // renders, the output doesn't line up with the input until the next batch)
+        const auto measure_accuracy = state.params.accuracy_meter->get()
+                                      && architecture == Architecture::LSTM
+                                      && offline_batcher == nullptr;
+        if (measure_accuracy)
+            accuracy_meter.capture_input (os_channels[0], os_buffer.getNumSamples());
+
+        const auto process_network = [&] (std::span<float* const> channels, int network_samples)
+        {
+            if (feedforward_model != nullptr)
+            {
+                feedforward_model->process (channels, network_samples);
+            }
+            else if (offline_renderer != nullptr && channels.size() == 1 && ! lstm_block.is_masked)
+            {
+                if (lstm_block.active_model != nullptr)
+                {
+                    const auto stats = offline_renderer->render (*lstm_block.active_model, { channels[0], (size_t) network_samples });
+                    if (stats.num_rerendered_segments > 0)
+                        logger.push_message ("Offline render: re-rendered {}/{} segments (max seam error: {})",
+                                             stats.num_rerendered_segments,
+                                             stats.num_segments,
+                                             stats.max_seam_error);
+                }
+            }
+            else
+            {
+                lstm_model.process (lstm_block, channels, network_samples);
+            }
+        };
+
+        const auto channels = std::span<float* const> { os_channels.data(), (size_t) num_streams };
+        if (offline_batcher != nullptr)
+            offline_batcher->process (channels, os_buffer.getNumSamples(), process_network);
+        else
+            process_network (channels, os_buffer.getNumSamples());
+
+        if (measure_accuracy)
+            accuracy_meter.push_output (os_channels[0], os_buffer.getNumSamples());
+    }
 
     // downsample
-    downsampler.process (os_buffer, mono_buffer);
+    {
+        const auto timer = profiler.time_stage (Stage::Downsample, num_samples);
+        oversampling.downsample (os_buffer, process_buffer);
+    }
 
     // dc blocker
-    dc_blocker.processBlock (mono_buffer);
+    {
+        const auto timer = profiler.time_stage (Stage::DC_Blocker, num_samples);
+        dc_blocker.processBlock (process_buffer);
+    }
 
-    // separate back out to stereo
-    for (int ch = 1; ch < buffer.getNumChannels(); ++ch)
-        chowdsp::BufferMath::copyBufferChannels (mono_buffer, buffer, 0, ch);
+    // copy the processed signal out to any remaining channels
+    for (int ch = num_streams; ch < buffer.getNumChannels(); ++ch)
+        chowdsp::BufferMath::copyBufferChannels (process_buffer, buffer, 0, ch);
 }
 
 juce::AudioProcessorEditor* Neural_Pruning_Plugin::createEditor()
@@ -4,11 +4,23 @@
 #include <chowdsp_filters/chowdsp_filters.h>
 #include <chowdsp_plugin_base/chowdsp_plugin_base.h>
 
+#include "accuracy_meter.h"
 #include "console_logger.h"
 #include "lstm_model.h"
+#include "oversampling.h"
+#include "prune_worker.h"
+#include "segment_renderer.h"
+#include "stage_profiler.h"
 
 struct Params : chowdsp::ParamHolder
 {
+    // the pruning parameters apply to each architecture (the hidden size sets the fraction of units to prune)
+    chowdsp::EnumChoiceParameter<Architecture>::Ptr architecture {
+        PID { "architecture", 100 },
+        "Architecture",
+        Architecture::LSTM,
+    };
+
     chowdsp::FloatParameter::Ptr hidden_size {
         PID { "hidden_size", 100 },
         "Pruned Hidden Size",
@@ -26,15 +38,95 @@ struct Params : chowdsp::ParamHolder
         Ranking::Mean_Activations,
     };
 
+    // quantizes the recurrent weights (to 12 bits stored as int16, or to int8), or stores them as fp16/bf16, or unit-by-unit, for the LSTM's SIMD kernels
+    chowdsp::EnumChoiceParameter<Weight_Format>::Ptr weight_format {
+        PID { "weight_format", 100 },
+        "Weight Format",
+        Weight_Format::Float32,
+    };
+
+    // faster approximations of the LSTM's gate activations (in the SIMD kernels), and the Conv network's tanh
+    chowdsp::EnumChoiceParameter<Activation>::Ptr activation {
+        PID { "activation", 100 },
+        "Activation",
+        Activation::Exact,
+    };
+
+    chowdsp::BoolParameter::Ptr true_stereo {
+        PID { "true_stereo", 100 },
+        "True Stereo",
+        false,
+    };
+
+    chowdsp::EnumChoiceParameter<Oversampling_Quality>::Ptr oversampling {
+        PID { "oversampling", 100 },
+        "Oversampling",
+        Oversampling_Quality::IIR_8th_Order,
+    };
+
+    // when enabled, the hidden size is chosen to fit within the CPU budget (measured on the running machine)
+    chowdsp::BoolParameter::Ptr cpu_budget_mode {
+        PID { "cpu_budget_mode", 100 },
+        "CPU Budget Mode",
+        false,
+    };
+
+    chowdsp::FloatParameter::Ptr cpu_budget {
+        PID { "cpu_budget", 100 },
+        "CPU Budget",
+        chowdsp::ParamUtils::createNormalisableRange (0.001f, 0.25f, 0.02f),
+        0.02f,
+        &chowdsp::ParamUtils::percentValToString,
+        &chowdsp::ParamUtils::stringToPercentVal,
+    };
+
+    // offline renders are split into segments that run in parallel (see Segment_Renderer)
+    chowdsp::TimeMsParameter::Ptr offline_warm_up {
+        PID { "offline_warm_up", 100 },
+        "Offline Warm-Up",
+        chowdsp::ParamUtils::createNormalisableRange (1.0f, 200.0f, 20.0f),
+        20.0f,
+    };
+
+    // runs the full-size model on a background thread, and measures how far the pruned model's output is from it
+    chowdsp::BoolParameter::Ptr accuracy_meter {
+        PID { "accuracy_meter", 100 },
+        "Accuracy Meter",
+        false,
+    };
+
+    chowdsp::GainDBParameter::Ptr offline_max_error {
+        PID { "offline_max_error", 100 },
+        "Offline Max Error",
+        juce::NormalisableRange<float> { -120.0f, -40.0f },
+        -80.0f,
+    };
+
+    // while the hidden size is moving, the LSTM runs at full size with the pruned units masked out,
+    // and only switches to the pruned model once the hidden size has settled (see Masked_LSTM_Model)
+    chowdsp::BoolParameter::Ptr instant_switching {
+        PID { "instant_switching", 100 },
+        "Instant Switching",
+        false,
+    };
+
+    chowdsp::TimeMsParameter::Ptr settle_time {
+        PID { "settle_time", 100 },
+        "Settle Time",
+        chowdsp::ParamUtils::createNormalisableRange (10.0f, 2000.0f, 250.0f),
+        250.0f,
+    };
+
     Params()
     {
-        add (hidden_size, ranking);
+        add (hidden_size, ranking, weight_format, activation, true_stereo, oversampling, cpu_budget_mode, cpu_budget, offline_warm_up, offline_max_error, accuracy_meter, architecture, instant_switching, settle_time);
     }
 };
 
 using State = chowdsp::PluginStateImpl<Params>;
 
-class Neural_Pruning_Plugin : public chowdsp::PluginBase<State>
+class Neural_Pruning_Plugin : public chowdsp::PluginBase<State>,
+                              private juce::Timer
 {
 public:
     Neural_Pruning_Plugin();
@@ -47,16 +139,62 @@ public:
 
     Console_Logger logger {};
 
+    std::shared_ptr<Shared_Model_Store> model_store; // shared with the other instances
     LSTM_Model lstm_model {};
 
+    std::shared_ptr<Shared_Feedforward_Store> dense_store;
+    std::shared_ptr<Shared_Feedforward_Store> conv_store;
+    Feedforward_Model dense_model {};
+    Feedforward_Model conv_model {};
+
+    Prune_Worker prune_worker { lstm_model, *model_store, { dense_model, *dense_store }, { conv_model, *conv_store }, logger };
+    Accuracy_Meter accuracy_meter { *model_store };
+
+    /** The network that the audio thread ran for the last block (the accuracy meter only measures the LSTM). */
+    std::atomic<Architecture> running_architecture { Architecture::LSTM };
+
     chowdsp::OnePoleSVF<float, chowdsp::OnePoleSVFType::Highpass> dc_blocker;
 
-    using AAFilter = chowdsp::EllipticFilter<8>;
-    chowdsp::Upsampler<float, AAFilter> upsampler;
-    chowdsp::Downsampler<float, AAFilter, false> downsampler;
+    Oversampling oversampling;
+
+    Stage_Profiler profiler {};
+    std::unique_ptr<Segment_Renderer> offline_renderer {};
+    std::unique_ptr<Offline_Batcher> offline_batcher {};
+    int offline_batch_size = 0; // in host samples, or zero if we're not batching
+    std::atomic<bool> offline_config_changed { false };
+    static constexpr int min_offline_segment_size = 1024;
 
     chowdsp::ScopedCallbackList callbacks {};
 
+    // the CPU budget that the network was last fitted to (as a fraction of a core, after the resampling stages)
+    std::atomic<double> fitted_network_cpu_budget { 0.0 };
+    bool is_profiling_for_budget = false; // message thread only
+    juce::TimedCallback budget_refit_timer { [this]
+                                             { refit_cpu_budget(); } };
+
 private:
+    void update_latency();
+
+    /** Rebuilds the offline renderer with the current parameters (not real-time safe). */
+    void update_offline_renderer();
+
+    /** Requests a prune to the hidden size from the parameters, or to fit the CPU budget (safe to call from any thread). */
+    void update_pruning();
+
+    /** Returns the fraction of a core that's left for the network, after the (profiled) resampling stages. */
+    double get_network_cpu_budget() const;
+
+    /** Fits the network to the CPU budget again, if the resampling stages' cost has moved since the last fit (message thread only). */
+    void refit_cpu_budget();
+
+    /** Keeps the profiler running in CPU budget mode (message thread only). */
+    void update_budget_profiling();
+
+    /** Returns true if changes to the hidden size should be followed by the masked model, before pruning. */
+    bool should_use_instant_switching() const;
+
+    /** Called once the hidden size has settled (when using instant switching). */
+    void timerCallback() override;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Neural_Pruning_Plugin)
 };
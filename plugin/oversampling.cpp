@@ -0,0 +1,131 @@
+#include "oversampling.h"
+
+int Oversampling::get_ratio (Oversampling_Quality quality, double sample_rate)
+{
+    const auto base_ratio = [quality]
+    {
+        switch (quality)
+        {
+            case Oversampling_Quality::None:
+                return 1;
+            case Oversampling_Quality::IIR_8th_Order_4x:
+                return 4;
+            default:
+                return 2;
+        }
+    }();
+
+    // the network was trained at 88.2/96 kHz, so there's no need to go any higher
+    return sample_rate <= 48000.0 ? base_ratio : std::max (base_ratio / 2, 1);
+}
+
+int Oversampling::get_latency_samples (Oversampling_Quality quality, double sample_rate)
+{
+    if (quality == Oversampling_Quality::Half_Band_FIR && get_ratio (quality, sample_rate) > 1)
+        return Half_Band_FIR::latency_samples; // half from the upsampler, half from the downsampler
+    return 0;
+}
+
+void Oversampling::prepare (const juce::dsp::ProcessSpec& spec)
+{
+    sample_rate = spec.sampleRate;
+
+    const auto prepare_iir = [&spec] (auto& resampler, int ratio)
+    {
+        if (ratio == 1)
+            return;
+
+        auto os_spec = spec;
+        os_spec.sampleRate *= ratio;
+        os_spec.maximumBlockSize *= (uint32_t) ratio;
+        resampler.upsampler.prepare (spec, ratio);
+        resampler.downsampler.prepare (os_spec, ratio);
+    };
+    prepare_iir (iir_4th_order, get_ratio (Oversampling_Quality::IIR_4th_Order, sample_rate));
+    prepare_iir (iir_8th_order, get_ratio (Oversampling_Quality::IIR_8th_Order, sample_rate));
+    prepare_iir (iir_8th_order_4x, get_ratio (Oversampling_Quality::IIR_8th_Order_4x, sample_rate));
+
+    fir_upsampler.prepare ((int) spec.numChannels);
+    fir_downsampler.prepare ((int) spec.numChannels);
+    fir_os_buffer.setMaxSize ((int) spec.numChannels, 2 * (int) spec.maximumBlockSize);
+}
+
+void Oversampling::set_quality (Oversampling_Quality new_quality) noexcept
+{
+    if (new_quality == quality)
+        return;
+
+    quality = new_quality;
+    if (get_ratio (quality, sample_rate) == 1)
+        return;
+
+    // the filters for the new mode have stale state from whenever they were last used
+    switch (quality)
+    {
+        case Oversampling_Quality::IIR_4th_Order:
+            iir_4th_order.upsampler.reset();
+            iir_4th_order.downsampler.reset();
+            break;
+        case Oversampling_Quality::IIR_8th_Order:
+            iir_8th_order.upsampler.reset();
+            iir_8th_order.downsampler.reset();
+            break;
+        case Oversampling_Quality::IIR_8th_Order_4x:
+            iir_8th_order_4x.upsampler.reset();
+            iir_8th_order_4x.downsampler.reset();
+            break;
+        case Oversampling_Quality::Half_Band_FIR:
+            fir_upsampler.reset();
+            fir_downsampler.reset();
+            break;
+        default:
+            break;
+    }
+}
+
+chowdsp::BufferView<float> Oversampling::upsample (const chowdsp::BufferView<float>& buffer) noexcept
+{
+    if (get_ratio (quality, sample_rate) == 1)
+        return buffer;
+
+    switch (quality)
+    {
+        case Oversampling_Quality::IIR_4th_Order:
+            return iir_4th_order.upsampler.process (buffer);
+        case Oversampling_Quality::IIR_8th_Order_4x:
+            return iir_8th_order_4x.upsampler.process (buffer);
+        case Oversampling_Quality::Half_Band_FIR:
+        {
+            const auto num_samples = buffer.getNumSamples();
+            fir_os_buffer.setCurrentSize (buffer.getNumChannels(), 2 * num_samples);
+            for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                fir_upsampler.upsample (buffer.getReadPointer (ch), fir_os_buffer.getWritePointer (ch), num_samples, ch);
+            return chowdsp::BufferView<float> { fir_os_buffer };
+        }
+        default:
+            return iir_8th_order.upsampler.process (buffer);
+    }
+}
+
+void Oversampling::downsample (const chowdsp::BufferView<float>& os_buffer, const chowdsp::BufferView<float>& buffer) noexcept
+{
+    if (get_ratio (quality, sample_rate) == 1)
+        return; // processed in-place
+
+    switch (quality)
+    {
+        case Oversampling_Quality::IIR_4th_Order:
+            iir_4th_order.downsampler.process (os_buffer, buffer);
+            break;
+        case Oversampling_Quality::IIR_8th_Order_4x:
+            iir_8th_order_4x.downsampler.process (os_buffer, buffer);
+            break;
+        case Oversampling_Quality::Half_Band_FIR:
+            for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                fir_downsampler.downsample (os_buffer.getReadPointer (ch), buffer.getWritePointer (ch), buffer.getNumSamples(), ch);
+            break;
+        default:
+            iir_8th_order.downsampler.process (os_buffer, buffer);
+            break;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chowdsp_buffers/chowdsp_buffers.h>
+#include <chowdsp_filters/chowdsp_filters.h>
+#include <chowdsp_dsp_utils/chowdsp_dsp_utils.h>
+
+#include "half_band_fir.h"
+
+enum class Oversampling_Quality
+{
+    None = 1,
+    IIR_4th_Order = 2,
+    IIR_8th_Order = 4,
+    Half_Band_FIR = 8,
+    IIR_8th_Order_4x = 16,
+};
+
+/**
+ * Resampling in and out of the rate that the neural network runs at.
+ *
+ * The filters for every quality mode are prepared up-front, so that the
+ * quality can be switched on the audio thread. At sample rates above
+ * 48 kHz, the oversampling ratio for each mode is halved.
+ */
+struct Oversampling
+{
+    static int get_ratio (Oversampling_Quality quality, double sample_rate);
+
+    /** Returns the latency (at the base sample rate) to report to the host. The IIR modes are minimum-phase. */
+    static int get_latency_samples (Oversampling_Quality quality, double sample_rate);
+
+    void prepare (const juce::dsp::ProcessSpec& spec);
+
+    /** Selects the quality mode (audio thread only), resetting the filters if the mode has changed. */
+    void set_quality (Oversampling_Quality new_quality) noexcept;
+
+    /** Returns the upsampled buffer, which may be the same buffer that was passed in. */
+    chowdsp::BufferView<float> upsample (const chowdsp::BufferView<float>& buffer) noexcept;
+    void downsample (const chowdsp::BufferView<float>& os_buffer, const chowdsp::BufferView<float>& buffer) noexcept;
+
+private:
+    Oversampling_Quality quality = Oversampling_Quality::IIR_8th_Order;
+    double sample_rate = 48000.0;
+
+    template <int order>
+    struct IIR_Resampler
+    {
+        chowdsp::Upsampler<float, chowdsp::EllipticFilter<order>> upsampler;
+        chowdsp::Downsampler<float, chowdsp::EllipticFilter<order>, false> downsampler;
+    };
+    IIR_Resampler<4> iir_4th_order;
+    IIR_Resampler<8> iir_8th_order;
+    IIR_Resampler<8> iir_8th_order_4x;
+
+    Half_Band_FIR fir_upsampler;
+    Half_Band_FIR fir_downsampler;
+    chowdsp::Buffer<float> fir_os_buffer;
+};
@@ -1,4 +1,5 @@
 #include "plugin_editor.h"
+#include <sstream>
 
 struct Console : juce::Component
 {
@@ -16,10 +17,7 @@ struct Console : juce::Component
         addAndMakeVisible (console_log);
 
         clear_logs_button.onClick = [this]
-        {
-            logger.log_text.clear();
-            logger.update_console();
-        };
+        { logger.clear(); };
         addAndMakeVisible (clear_logs_button);
     }
 
@@ -36,16 +34,123 @@ struct Console : juce::Component
     }
 };
 
+struct Profiler_View : juce::Component,
+                       private juce::Timer
+{
+    Neural_Pruning_Plugin& plugin;
+    Stage_Profiler& profiler;
+    std::vector<Stage_Profiler::Stats> stats {};
+    juce::TextButton reset_button { "RESET" };
+    juce::TextButton export_button { "EXPORT" };
+    std::unique_ptr<juce::FileChooser> file_chooser {};
+
+    explicit Profiler_View (Neural_Pruning_Plugin& neural_pruning_plugin)
+        : plugin { neural_pruning_plugin },
+          profiler { neural_pruning_plugin.profiler }
+    {
+        reset_button.onClick = [this]
+        { profiler.reset(); };
+        addAndMakeVisible (reset_button);
+
+        export_button.onClick = [this]
+        { export_stats(); };
+        addAndMakeVisible (export_button);
+
+        // only spend time measuring while someone's looking at the results
+        profiler.add_user();
+        startTimerHz (5);
+    }
+
+    ~Profiler_View() override
+    {
+        profiler.remove_user();
+    }
+
+    void timerCallback() override
+    {
+        stats = profiler.get_stats();
+        repaint();
+    }
+
+    void export_stats()
+    {
+        file_chooser = std::make_unique<juce::FileChooser> ("Export CPU Stats", juce::File {}, "*.csv");
+        file_chooser->launchAsync (juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::warnAboutOverwriting,
+                                   [this] (const juce::FileChooser& chooser)
+                                   {
+                                       const auto file = chooser.getResult();
+                                       if (file == juce::File {})
+                                           return;
+
+                                       std::ostringstream csv {};
+                                       profiler.export_csv (csv);
+                                       if (file.replaceWithText (csv.str()))
+                                           chowdsp::log ("Exported CPU stats to {}", file.getFullPathName().toStdString());
+                                   });
+    }
+
+    void paint (juce::Graphics& g) override
+    {
+        g.setColour (juce::Colours::white);
+        g.setFont (juce::FontOptions { "JetBrains Mono", 13.0f, juce::Font::plain });
+
+        auto b = getLocalBounds().reduced (4);
+        const auto draw_row = [&g, &b] (const juce::String& text)
+        { g.drawText (text, b.removeFromTop (15), juce::Justification::left); };
+
+        const auto quality = plugin.getState().params.oversampling->get();
+        draw_row ("Oversampling: " + juce::String { Oversampling::get_ratio (quality, plugin.getSampleRate()) }
+                  + "x, latency: " + juce::String { Oversampling::get_latency_samples (quality, plugin.getSampleRate()) } + " samples");
+        draw_row (juce::String { "Stage" }.paddedRight (' ', 12)
+                  + juce::String { "Block" }.paddedRight (' ', 12)
+                  + juce::String { "Mean (us)" }.paddedRight (' ', 11)
+                  + juce::String { "p99 (us)" }.paddedRight (' ', 11)
+                  + "Max (us)");
+        for (const auto& stage_stats : stats)
+        {
+            draw_row (juce::String { Stage_Profiler::get_stage_name (stage_stats.stage) }.paddedRight (' ', 12)
+                      + (juce::String { stage_stats.min_block_size } + "-" + juce::String { stage_stats.max_block_size }).paddedRight (' ', 12)
+                      + juce::String { stage_stats.mean_ns * 1.0e-3, 1 }.paddedRight (' ', 11)
+                      + juce::String { stage_stats.p99_ns * 1.0e-3, 1 }.paddedRight (' ', 11)
+                      + juce::String { stage_stats.max_ns * 1.0e-3, 1 });
+        }
+
+        if (plugin.getState().params.accuracy_meter->get())
+        {
+            const auto accuracy = plugin.accuracy_meter.get_stats();
+            if (plugin.running_architecture.load (std::memory_order_relaxed) != Architecture::LSTM)
+                draw_row ("Accuracy vs. " + juce::String { LSTM_Model::max_hidden_size } + "-unit LSTM: only measured while the LSTM is running");
+            else if (! accuracy.is_measuring)
+                draw_row ("Accuracy vs. " + juce::String { LSTM_Model::max_hidden_size } + "-unit LSTM: measuring...");
+            else
+                draw_row ("Accuracy vs. " + juce::String { LSTM_Model::max_hidden_size } + "-unit LSTM: MSE "
+                          + juce::String (accuracy.mse, 3, true)
+                          + ", ESR " + juce::String { 10.0 * std::log10 (std::max (accuracy.esr, 1.0e-20)), 1 } + " dB");
+        }
+    }
+
+    void resized() override
+    {
+        auto b = getLocalBounds().removeFromBottom (25).removeFromRight (140);
+        export_button.setBounds (b.removeFromRight (70));
+        reset_button.setBounds (b);
+    }
+};
+
 Plugin_Editor::Plugin_Editor (Neural_Pruning_Plugin& plugin)
     : AudioProcessorEditor { plugin }
 {
-    setSize (500, 400);
+    setSize (500, 600);
     auto b = getLocalBounds();
 
     auto* console = arena.allocate<Console> (plugin.logger);
     console->setBounds (b.removeFromBottom (250));
     addAndMakeVisible (console);
 
+    auto* profiler_view = arena.allocate<Profiler_View> (plugin);
+    profiler_view->setBounds (b.removeFromBottom (200));
+    addAndMakeVisible (profiler_view);
+
     auto* params_view = arena.allocate<chowdsp::ParametersView> (plugin.getState(), plugin.getState().params);
     params_view->setBounds (b);
     addAndMakeVisible (params_view);
@@ -0,0 +1,256 @@
+#include "prune_worker.h"
+
+struct Prune_Request
+{
+    uint32_t generation {};
+    Architecture architecture {};
+    int hidden_size {};
+    Ranking ranking {};
+    Weight_Format format {};
+};
+
+static uint64_t pack (const Prune_Request& request)
+{
+    return (static_cast<uint64_t> (request.generation) << 32)
+           | (static_cast<uint64_t> (static_cast<uint8_t> (request.architecture)) << 24)
+           | (static_cast<uint64_t> (request.hidden_size & 0xff) << 16)
+           | (static_cast<uint64_t> (static_cast<uint8_t> (request.ranking)) << 8)
+           | static_cast<uint64_t> (static_cast<uint8_t> (request.format));
+}
+
+static Prune_Request unpack (uint64_t packed)
+{
+    return {
+        .generation = static_cast<uint32_t> (packed >> 32),
+        .architecture = static_cast<Architecture> ((packed >> 24) & 0xff),
+        .hidden_size = static_cast<int> ((packed >> 16) & 0xff),
+        .ranking = static_cast<Ranking> ((packed >> 8) & 0xff),
+        .format = static_cast<Weight_Format> (packed & 0xff),
+    };
+}
+
+Prune_Worker::Prune_Worker (LSTM_Model& model, Shared_Model_Store& store, Feedforward_Target dense, Feedforward_Target conv, Console_Logger& console_logger)
+    : juce::Thread { "Prune Worker" },
+      lstm_model { model },
+      model_store { store },
+      dense_target { dense },
+      conv_target { conv },
+      logger { console_logger }
+{
+}
+
+Prune_Worker::~Prune_Worker()
+{
+    stopThread (1000);
+}
+
+void Prune_Worker::request_prune (int hidden_size, Ranking ranking, Weight_Format format, Architecture architecture)
+{
+    const auto generation = next_generation.fetch_add (1, std::memory_order_relaxed) + 1;
+    latest_request.store (pack ({ generation, architecture, hidden_size, ranking, format }), std::memory_order_release);
+    notify();
+}
+
+void Prune_Worker::request_budget_prune (double max_ns_per_sample, int num_streams, Ranking ranking, Architecture architecture)
+{
+    jassert (architecture != Architecture::LSTM);
+    budget_ns_per_sample.store (max_ns_per_sample, std::memory_order_relaxed);
+    budget_num_streams.store (num_streams, std::memory_order_relaxed);
+    request_prune (0, ranking, Weight_Format::Float32, architecture);
+}
+
+void Prune_Worker::request_cost_measurement (Weight_Format format, Activation activation)
+{
+    if (model_costs.is_ready (format, activation))
+        return;
+
+    requested_cost_config.store (Model_Cost_Table::get_config (format, activation), std::memory_order_release);
+    notify();
+}
+
+void Prune_Worker::run()
+{
+    uint32_t completed_generation = 0;
+    while (! threadShouldExit())
+    {
+        const auto request = unpack (latest_request.load (std::memory_order_acquire));
+        if (request.generation == completed_generation)
+        {
+            // nothing to do, so let's clean up whatever the audio thread has swapped out
+            lstm_model.free_retired_model();
+            dense_target.model.free_retired_model();
+            conv_target.model.free_retired_model();
+
+            if (const auto config = requested_cost_config.exchange (0, std::memory_order_acq_rel); config != 0)
+            {
+                const auto format = static_cast<Weight_Format> ((config >> 8) & 0xff);
+                const auto activation = static_cast<Activation> (config & 0xff);
+                if (model_costs.is_ready (format, activation))
+                    continue;
+
+                const auto should_cancel = [this, completed_generation, config]
+                {
+                    const auto requested_config = requested_cost_config.load (std::memory_order_relaxed);
+                    return threadShouldExit()
+                           || unpack (latest_request.load (std::memory_order_relaxed)).generation != completed_generation
+                           || (requested_config != 0 && requested_config != config);
+                };
+
+                logger.push_message ("Measuring model costs with {} weights and {} activations...",
+                                     magic_enum::enum_name (format),
+                                     magic_enum::enum_name (activation));
+                if (model_costs.measure (*model_store.original_weights, format, activation, should_cancel))
+                    on_cost_measurement_complete();
+                else
+                {
+                    // try again once the prune is done (unless there's a newer request by now)
+                    auto no_request = uint32_t {};
+                    requested_cost_config.compare_exchange_strong (no_request, config, std::memory_order_acq_rel);
+                }
+                continue;
+            }
+
+            if (! model_store.pruned_weights.fill_next())
+                wait (500);
+            continue;
+        }
+
+        const auto is_stale = [this, generation = request.generation]
+        {
+            return threadShouldExit()
+                   || unpack (latest_request.load (std::memory_order_relaxed)).generation != generation;
+        };
+
+        if (request.architecture != Architecture::LSTM)
+        {
+            // the ranking doesn't depend on the hidden size, so it's only worth cancelling if the ranking changes
+            const auto ranking_is_stale = [this, request]
+            {
+                if (threadShouldExit())
+                    return true;
+                const auto latest = unpack (latest_request.load (std::memory_order_relaxed));
+                return latest.architecture != request.architecture || latest.ranking != request.ranking;
+            };
+
+            auto& target = request.architecture == Architecture::Dense ? dense_target : conv_target;
+            auto hidden_size = request.hidden_size;
+            if (hidden_size == 0)
+            {
+                hidden_size = fit_feedforward_budget (target, request.architecture, request.ranking, is_stale, ranking_is_stale);
+                if (hidden_size == 0)
+                {
+                    logger.push_message ("Cancelled stale {} budget search", magic_enum::enum_name (request.architecture));
+                    completed_generation = request.generation;
+                    continue;
+                }
+            }
+
+            logger.push_message ("Pruning {} network to hidden size {} with ranking {}",
+                                 magic_enum::enum_name (request.architecture),
+                                 hidden_size,
+                                 magic_enum::enum_name (request.ranking));
+            if (auto new_model = target.store.make_model (hidden_size, request.ranking, is_stale, ranking_is_stale))
+            {
+                logger.push_message ("{} network has {} parameters ({} units)",
+                                     magic_enum::enum_name (request.architecture),
+                                     new_model->weights->get_num_params(),
+                                     new_model->weights->get_num_units());
+                target.model.free_retired_model();
+                target.model.publish_model (std::move (new_model));
+                on_prune_complete (request.architecture, hidden_size, request.ranking);
+            }
+            else if (! is_stale())
+                logger.push_message ("Unable to load the {} network!", magic_enum::enum_name (request.architecture));
+            else
+                logger.push_message ("Cancelled stale prune to hidden size {}", hidden_size);
+
+            completed_generation = request.generation;
+            continue;
+        }
+
+        logger.push_message ("Pruning to hidden size {} with ranking {} and {} weights (running in model size {})",
+                             request.hidden_size,
+                             magic_enum::enum_name (request.ranking),
+                             magic_enum::enum_name (request.format),
+                             LSTM_Model::get_model_size (request.hidden_size));
+        if (auto new_model = model_store.make_model (request.hidden_size, request.ranking, request.format, is_stale))
+        {
+            lstm_model.free_retired_model();
+            lstm_model.publish_model (std::move (new_model));
+            on_prune_complete (request.architecture, request.hidden_size, request.ranking);
+        }
+        else
+            logger.push_message ("Cancelled stale prune to hidden size {}", request.hidden_size);
+
+        completed_generation = request.generation;
+    }
+}
+
+std::optional<double> Prune_Worker::get_feedforward_cost (Feedforward_Target& target,
+                                                          Architecture architecture,
+                                                          int hidden_size,
+                                                          Ranking ranking,
+                                                          int num_streams,
+                                                          const std::function<bool()>& should_cancel,
+                                                          const std::function<bool()>& should_cancel_ranking)
+{
+    const auto key = std::make_tuple (architecture, hidden_size, ranking, num_streams);
+    if (const auto cached = feedforward_costs.find (key); cached != feedforward_costs.end())
+        return cached->second;
+
+    const auto model = target.store.make_model (hidden_size, ranking, should_cancel, should_cancel_ranking);
+    if (model == nullptr || (should_cancel != nullptr && should_cancel()))
+        return std::nullopt;
+
+    const auto cost = Feedforward_Model::measure_ns_per_sample (model->weights, num_streams);
+    feedforward_costs[key] = cost;
+    return cost;
+}
+
+int Prune_Worker::fit_feedforward_budget (Feedforward_Target& target,
+                                          Architecture architecture,
+                                          Ranking ranking,
+                                          const std::function<bool()>& should_cancel,
+                                          const std::function<bool()>& should_cancel_ranking)
+{
+    const auto max_ns_per_sample = budget_ns_per_sample.load (std::memory_order_relaxed);
+    const auto num_streams = budget_num_streams.load (std::memory_order_relaxed);
+    const auto fits = [&] (int hidden_size) -> std::optional<bool>
+    {
+        const auto cost = get_feedforward_cost (target, architecture, hidden_size, ranking, num_streams, should_cancel, should_cancel_ranking);
+        if (! cost.has_value())
+            return std::nullopt;
+        return *cost <= max_ns_per_sample;
+    };
+
+    // Each measurement means pruning and benchmarking a network, so rather than
+    // measuring every size (like Model_Cost_Table does for the LSTM), we assume the
+    // cost grows with the hidden size and binary search for the largest one that fits.
+    const auto max_fits = fits (LSTM_Model::max_hidden_size);
+    if (! max_fits.has_value())
+        return 0;
+
+    auto hidden_size = LSTM_Model::max_hidden_size;
+    if (! *max_fits)
+    {
+        auto low = LSTM_Model::min_hidden_size; // (if even the smallest network doesn't fit, we use it anyway)
+        auto high = LSTM_Model::max_hidden_size;
+        while (high - low > 1)
+        {
+            const auto mid = (low + high) / 2;
+            const auto mid_fits = fits (mid);
+            if (! mid_fits.has_value())
+                return 0;
+            (*mid_fits ? low : high) = mid;
+        }
+        hidden_size = low;
+    }
+
+    logger.push_message ("CPU budget of {:.1f} ns/sample ({} stream(s)) fits {} network hidden size {} ({:.1f} ns/sample)",
+                         max_ns_per_sample,
+                         num_streams,
+                         magic_enum::enum_name (architecture),
+                         hidden_size,
+                         feedforward_costs[std::make_tuple (architecture, hidden_size, ranking, num_streams)]);
+    return hidden_size;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <map>
+#include <optional>
+#include <tuple>
+
+#include <chowdsp_logging/chowdsp_logging.h>
+#include <juce_core/juce_core.h>
+
+#include "console_logger.h"
+#include "model_cost_table.h"
+#include "shared_model_store.h"
+
+/**
+ * Runs pruning on a low-priority background thread, for whichever
+ * architecture is being requested.
+ *
+ * Requests are collapsed so that only the most recent (architecture, hidden_size,
+ * ranking, format) request gets pruned, and any in-flight prune is cancelled as soon as it
+ * becomes stale. Pruned models share their weights with other instances via
+ * the model store. While idle, the worker measures the cost of each model
+ * size (if requested), and fills up the pruned model cache.
+ *
+ * The cost of a pruned Dense or Conv network depends on which layers lost
+ * their units, so those costs are measured per ranking, when a budget prune
+ * asks for them.
+ */
+struct Prune_Worker : juce::Thread
+{
+    struct Feedforward_Target
+    {
+        Feedforward_Model& model;
+        Shared_Feedforward_Store& store;
+    };
+
+    Prune_Worker (LSTM_Model& model, Shared_Model_Store& store, Feedforward_Target dense, Feedforward_Target conv, Console_Logger& console_logger);
+    ~Prune_Worker() override;
+
+    /**
+     * Requests a prune. This never blocks, and is safe to call from any thread.
+     * The weight format only applies to the LSTM.
+     */
+    void request_prune (int hidden_size,
+                        Ranking ranking,
+                        Weight_Format format = Weight_Format::Float32,
+                        Architecture architecture = Architecture::LSTM);
+
+    /**
+     * Requests the largest Dense or Conv network whose cost stays below the given
+     * number of nanoseconds per network sample (for all the streams). This never
+     * blocks, and is safe to call from any thread.
+     */
+    void request_budget_prune (double max_ns_per_sample, int num_streams, Ranking ranking, Architecture architecture);
+
+    /**
+     * Requests that the model costs get measured for a weight format and activation
+     * (if they haven't been already). Safe to call from any thread.
+     */
+    void request_cost_measurement (Weight_Format format, Activation activation);
+
+    /** Called from the worker thread whenever a pruned model has been published. */
+    chowdsp::Broadcaster<void (Architecture, int, Ranking)> on_prune_complete {};
+
+    /** Called from the worker thread once the model costs have been measured. */
+    chowdsp::Broadcaster<void()> on_cost_measurement_complete {};
+
+    void run() override;
+
+    LSTM_Model& lstm_model;
+    Shared_Model_Store& model_store;
+    Feedforward_Target dense_target;
+    Feedforward_Target conv_target;
+    Console_Logger& logger;
+    Model_Cost_Table model_costs {};
+
+    // [generation (32 bits) | architecture (8 bits) | hidden size (8 bits) | ranking (8 bits) | weight format (8 bits)]
+    std::atomic<uint64_t> latest_request {};
+    std::atomic<uint32_t> next_generation {};
+    std::atomic<uint32_t> requested_cost_config {}; // see Model_Cost_Table::get_config(), or zero if there's no request
+
+    // budget prunes are requested with a hidden size of zero
+    std::atomic<double> budget_ns_per_sample {};
+    std::atomic<int> budget_num_streams { 1 };
+
+private:
+    std::optional<double> get_feedforward_cost (Feedforward_Target& target,
+                                                Architecture architecture,
+                                                int hidden_size,
+                                                Ranking ranking,
+                                                int num_streams,
+                                                const std::function<bool()>& should_cancel,
+                                                const std::function<bool()>& should_cancel_ranking);
+
+    /** Returns the largest hidden size that fits the budget, or zero if the search was cancelled. */
+    int fit_feedforward_budget (Feedforward_Target& target,
+                                Architecture architecture,
+                                Ranking ranking,
+                                const std::function<bool()>& should_cancel,
+                                const std::function<bool()>& should_cancel_ranking);
+
+    // measured cost of each pruned (architecture, hidden size, ranking, number of streams), worker thread only
+    std::map<std::tuple<Architecture, int, Ranking, int>, double> feedforward_costs {};
+};
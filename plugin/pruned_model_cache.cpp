@@ -0,0 +1,128 @@
+#include "pruned_model_cache.h"
+
+static size_t ranking_index (Ranking ranking)
+{
+    if (ranking == Ranking::Min_Weights)
+        return 0;
+    if (ranking == Ranking::Mean_Activations)
+        return 1;
+    return 2;
+}
+
+Pruned_Model_Cache::Entry& Pruned_Model_Cache::get_entry (int hidden_size, Ranking ranking)
+{
+    return entries[ranking_index (ranking)][static_cast<size_t> (hidden_size - LSTM_Model::min_hidden_size)];
+}
+
+void Pruned_Model_Cache::reset (std::shared_ptr<const LSTM_Weights> original_weights)
+{
+    std::lock_guard lock { mutex };
+    for (auto& ranking_entries : entries)
+        ranking_entries.fill ({});
+    memory_usage_bytes = 0;
+
+    // all the rankings share the same un-pruned weights
+    for (auto ranking : { Ranking::Min_Weights, Ranking::Mean_Activations, Ranking::Minimization })
+        get_entry (LSTM_Model::max_hidden_size, ranking).weights = original_weights;
+}
+
+void Pruned_Model_Cache::store (int hidden_size, Ranking ranking, std::shared_ptr<const LSTM_Weights> weights)
+{
+    const auto budget = memory_budget_bytes.load (std::memory_order_relaxed);
+    const auto new_bytes = weights->size_bytes();
+    if (new_bytes > budget)
+        return;
+
+    // evict the least recently used variants until the new one fits
+    while (memory_usage_bytes + new_bytes > budget)
+    {
+        Entry* lru_entry = nullptr;
+        for (auto& ranking_entries : entries)
+        {
+            for (size_t i = 0; i < num_sizes - 1; ++i) // never evict the un-pruned weights
+            {
+                auto& entry = ranking_entries[i];
+                if (entry.weights != nullptr && (lru_entry == nullptr || entry.last_used < lru_entry->last_used))
+                    lru_entry = &entry;
+            }
+        }
+
+        if (lru_entry == nullptr)
+            return;
+
+        memory_usage_bytes -= lru_entry->weights->size_bytes();
+        *lru_entry = {};
+    }
+
+    memory_usage_bytes += new_bytes;
+    get_entry (hidden_size, ranking) = { std::move (weights), ++use_counter };
+}
+
+std::shared_ptr<const LSTM_Weights> Pruned_Model_Cache::get (int hidden_size,
+                                                             Ranking ranking,
+                                                             const std::function<bool()>& should_cancel)
+{
+    std::lock_guard lock { mutex };
+    if (memory_budget_bytes.load (std::memory_order_relaxed) == 0
+        || get_entry (LSTM_Model::max_hidden_size, ranking).weights == nullptr)
+        return {};
+
+    if (auto& entry = get_entry (hidden_size, ranking); entry.weights != nullptr)
+    {
+        entry.last_used = ++use_counter;
+        return entry.weights;
+    }
+
+    // find the nearest larger variant that we already have
+    auto parent_size = hidden_size + 1;
+    while (get_entry (parent_size, ranking).weights == nullptr)
+        ++parent_size;
+
+    const auto candidates = LSTM_Model::get_pruning_candidates (ranking);
+    auto weights = get_entry (parent_size, ranking).weights;
+    for (auto size = parent_size - 1; size >= hidden_size; --size)
+    {
+        if (should_cancel != nullptr && should_cancel())
+            return {};
+
+        const auto& to_prune = candidates[static_cast<size_t> (LSTM_Model::max_hidden_size - 1 - size)];
+        weights = std::make_shared<const LSTM_Weights> (weights->without_unit (to_prune.idx));
+        store (size, ranking, weights);
+    }
+
+    return weights;
+}
+
+bool Pruned_Model_Cache::fill_next()
+{
+    std::lock_guard lock { mutex };
+    const auto budget = memory_budget_bytes.load (std::memory_order_relaxed);
+    for (auto ranking : { Ranking::Mean_Activations, Ranking::Minimization, Ranking::Min_Weights })
+    {
+        for (auto size = LSTM_Model::max_hidden_size - 1; size >= LSTM_Model::min_hidden_size; --size)
+        {
+            if (get_entry (size, ranking).weights != nullptr)
+                continue;
+
+            // filling should never evict anything
+            if (memory_usage_bytes + LSTM_Weights::num_weights (size) * sizeof (float) + static_cast<size_t> (size) * sizeof (int) > budget)
+                return false;
+
+            const auto& parent = get_entry (size + 1, ranking).weights;
+            if (parent == nullptr)
+                break;
+
+            const auto& to_prune = LSTM_Model::get_pruning_candidates (ranking)[static_cast<size_t> (LSTM_Model::max_hidden_size - 1 - size)];
+            store (size, ranking, std::make_shared<const LSTM_Weights> (parent->without_unit (to_prune.idx)));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t Pruned_Model_Cache::get_memory_usage() const
+{
+    std::lock_guard lock { mutex };
+    return memory_usage_bytes;
+}
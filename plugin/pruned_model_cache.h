@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "lstm_model.h"
+
+/**
+ * Cache of flat, load-ready weights for every (ranking, hidden size) variant.
+ *
+ * Each variant is trimmed from the next-largest cached variant with the same
+ * ranking, so filling the cache (or missing it) only costs the incremental
+ * pruning work. When the memory budget is exceeded, the least recently used
+ * variants are evicted. The un-pruned weights are always kept.
+ *
+ * The cache is thread-safe (but not real-time safe), so it can be shared
+ * between plugin instances (see Shared_Model_Store).
+ */
+struct Pruned_Model_Cache
+{
+    static constexpr size_t default_memory_budget_bytes = 16 * 1024 * 1024;
+
+    void reset (std::shared_ptr<const LSTM_Weights> original_weights);
+
+    /**
+     * Returns the weights for a given variant, trimming them from the nearest
+     * cached variant if needed. Returns nullptr if the cache is disabled
+     * (i.e. the memory budget is zero), or if it was cancelled.
+     */
+    std::shared_ptr<const LSTM_Weights> get (int hidden_size,
+                                             Ranking ranking,
+                                             const std::function<bool()>& should_cancel = {});
+
+    /** Builds the next un-cached variant that fits in the memory budget. Returns false if there's nothing left to build. */
+    bool fill_next();
+
+    /** Sets the memory budget for the pruned variants (0 disables the cache). */
+    void set_memory_budget (size_t budget_bytes) { memory_budget_bytes.store (budget_bytes, std::memory_order_relaxed); }
+    size_t get_memory_usage() const;
+
+private:
+    static constexpr size_t num_rankings = 3;
+    static constexpr size_t num_sizes = LSTM_Model::max_hidden_size - LSTM_Model::min_hidden_size + 1;
+
+    struct Entry
+    {
+        std::shared_ptr<const LSTM_Weights> weights {};
+        uint64_t last_used {};
+    };
+
+    Entry& get_entry (int hidden_size, Ranking ranking);
+    void store (int hidden_size, Ranking ranking, std::shared_ptr<const LSTM_Weights> weights);
+
+    mutable std::mutex mutex {};
+    std::array<std::array<Entry, num_sizes>, num_rankings> entries {};
+    std::atomic<size_t> memory_budget_bytes { default_memory_budget_bytes };
+    size_t memory_usage_bytes {};
+    uint64_t use_counter {};
+};
@@ -0,0 +1,210 @@
+#include "segment_renderer.h"
+#include <cmath>
+
+static constexpr size_t max_state_size = 2 * LSTM_Model::max_model_size;
+
+static void process_mono (LSTM_Model::Model_Variant& model, float* data, int num_samples)
+{
+    float* const channels[] = { data };
+    std::visit ([&channels, num_samples] (auto& m)
+                { m.process (channels, num_samples); },
+                model);
+}
+
+static void get_state (const LSTM_Model::Model_Variant& model, std::vector<float>& state)
+{
+    std::visit ([&state] (const auto& m)
+                { m.get_state (state); },
+                model);
+}
+
+static void set_state (LSTM_Model::Model_Variant& model, const std::vector<float>& state)
+{
+    std::visit ([&state] (auto& m)
+                { m.set_state (state); },
+                model);
+}
+
+Segment_Renderer::Segment_Renderer (const Config& renderer_config)
+    : config { renderer_config }
+{
+    // the calling thread also renders, so it counts as a worker
+    const auto num_workers = (size_t) std::max (config.num_threads, 1);
+    for (size_t worker_idx = 0; worker_idx < num_workers; ++worker_idx)
+    {
+        worker_models.push_back (std::make_unique<LSTM_Model::Model_Variant>());
+        worker_scratch.emplace_back ((size_t) std::max (config.warm_up_size, config.seam_check_size));
+    }
+
+    for (size_t worker_idx = 1; worker_idx < num_workers; ++worker_idx)
+        threads.emplace_back ([this, worker_idx]
+                              { worker_thread_loop (worker_idx); });
+}
+
+Segment_Renderer::~Segment_Renderer()
+{
+    {
+        std::lock_guard lock { mutex };
+        should_exit = true;
+    }
+    work_available.notify_all();
+
+    for (auto& thread : threads)
+        thread.join();
+}
+
+void Segment_Renderer::worker_thread_loop (size_t worker_idx)
+{
+    uint64_t last_generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock lock { mutex };
+            work_available.wait (lock, [this, last_generation]
+                                 { return should_exit || job_generation != last_generation; });
+            if (should_exit)
+                return;
+            last_generation = job_generation;
+        }
+
+        run_jobs (worker_idx, last_generation);
+    }
+}
+
+void Segment_Renderer::run_jobs (size_t worker_idx, uint64_t generation)
+{
+    while (true)
+    {
+        int segment {};
+        {
+            // a worker that's still finishing off the previous render mustn't pick up jobs from the next one
+            std::lock_guard lock { mutex };
+            if (job_generation != generation || next_job >= num_segments)
+                return;
+            segment = next_job++;
+        }
+
+        render_segment (worker_idx, segment);
+
+        {
+            std::lock_guard lock { mutex };
+            if (--jobs_remaining == 0)
+                work_done.notify_all();
+        }
+    }
+}
+
+void Segment_Renderer::render_segment (size_t worker_idx, int segment)
+{
+    auto& model = *worker_models[worker_idx];
+    auto& scratch = worker_scratch[worker_idx];
+    const auto start = segment * config.segment_size;
+    const auto end = segment == num_segments - 1 ? (int) output.size() : start + config.segment_size;
+
+    // warm up the state, starting from zero
+    std::visit ([] (auto& m)
+                { m.lstm.reset(); },
+                model);
+    const auto warm_up_start = std::max (start - config.warm_up_size, 0);
+    std::copy (input.begin() + warm_up_start, input.begin() + start, scratch.begin());
+    process_mono (model, scratch.data(), start - warm_up_start);
+
+    process_mono (model, output.data() + start, end - start);
+    get_state (model, segment_end_states[(size_t) segment]);
+
+    // keep going into the next segment, so we can check the seam
+    if (segment < num_segments - 1)
+    {
+        auto& seam_output = seam_outputs[(size_t) segment];
+        std::copy (input.begin() + end, input.begin() + end + (int) seam_output.size(), seam_output.begin());
+        process_mono (model, seam_output.data(), (int) seam_output.size());
+    }
+}
+
+Segment_Renderer::Stats Segment_Renderer::render (LSTM_Model::Model_Variant& model, std::span<float> data)
+{
+    const auto num_samples = (int) data.size();
+    if (worker_models.size() < 2 || num_samples < 2 * config.segment_size)
+    {
+        process_mono (model, data.data(), num_samples);
+        return { .num_segments = 1 };
+    }
+
+    // the per-render state is shared with the workers, so it's only set up under the lock
+    uint64_t generation {};
+    {
+        std::lock_guard lock { mutex };
+        num_segments = num_samples / config.segment_size;
+        input.assign (data.begin(), data.end());
+        output = data;
+        segment_end_states.resize ((size_t) num_segments, std::vector<float> (max_state_size));
+        seam_outputs.resize ((size_t) num_segments);
+        for (auto& seam_output : seam_outputs)
+            seam_output.resize ((size_t) config.seam_check_size);
+
+        // every worker gets its own copy of the model
+        for (auto& worker_model : worker_models)
+            *worker_model = model;
+
+        // the first segment carries on from the current state (on this thread), and the rest get farmed out
+        next_job = 1;
+        jobs_remaining = num_segments - 1;
+        generation = ++job_generation;
+    }
+    work_available.notify_all();
+
+    process_mono (model, output.data(), config.segment_size);
+    get_state (model, segment_end_states[0]);
+    std::copy (input.begin() + config.segment_size, input.begin() + config.segment_size + config.seam_check_size, seam_outputs[0].begin());
+    process_mono (model, seam_outputs[0].data(), config.seam_check_size);
+
+    run_jobs (0, generation);
+    {
+        std::unique_lock lock { mutex };
+        work_done.wait (lock, [this]
+                        { return jobs_remaining == 0; });
+    }
+
+    // check the seams in order, so that a re-rendered segment can carry its state on to the next seam
+    Stats stats { .num_segments = num_segments };
+    auto& sequential_model = *worker_models[0];
+    for (int segment = 1; segment < num_segments; ++segment)
+    {
+        const auto start = segment * config.segment_size;
+        const auto end = segment == num_segments - 1 ? num_samples : start + config.segment_size;
+        const auto& seam_output = seam_outputs[(size_t) segment - 1];
+
+        auto seam_error = 0.0f;
+        for (size_t n = 0; n < seam_output.size(); ++n)
+            seam_error = std::max (seam_error, std::abs (seam_output[n] - output[(size_t) start + n]));
+        stats.max_seam_error = std::max (stats.max_seam_error, seam_error);
+
+        if (seam_error <= config.max_seam_error)
+            continue;
+
+        stats.num_rerendered_segments++;
+        set_state (sequential_model, segment_end_states[(size_t) segment - 1]);
+        std::copy (input.begin() + start, input.begin() + end, output.begin() + start);
+        process_mono (sequential_model, output.data() + start, end - start);
+        get_state (sequential_model, segment_end_states[(size_t) segment]);
+
+        if (segment < num_segments - 1)
+        {
+            auto& next_seam_output = seam_outputs[(size_t) segment];
+            std::copy (input.begin() + end, input.begin() + end + (int) next_seam_output.size(), next_seam_output.begin());
+            process_mono (sequential_model, next_seam_output.data(), (int) next_seam_output.size());
+        }
+    }
+
+    set_state (model, segment_end_states[(size_t) num_segments - 1]);
+    return stats;
+}
+
+Offline_Batcher::Offline_Batcher (int num_samples_per_batch)
+    : batch_size { num_samples_per_batch }
+{
+    for (auto& batch : input_batch)
+        batch.resize ((size_t) batch_size, 0.0f);
+    for (auto& batch : output_batch)
+        batch.resize ((size_t) batch_size, 0.0f);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "lstm_model.h"
+
+/**
+ * Renders long (mono) buffers through an LSTM model on several threads.
+ *
+ * The buffer is split into segments. The first segment continues from the
+ * model's current state, while every other segment starts from a zero state
+ * that gets "warmed up" on the input just before the segment start. Since
+ * the network forgets its initial state fairly quickly, the warmed-up state
+ * converges to the state that a sequential render would have had.
+ *
+ * To check this, each segment keeps rendering a little way into the next
+ * segment, and the outputs are compared at the seam. If the error at a seam
+ * is larger than the error bound, the segment after the seam gets rendered
+ * again, continuing from the state at the end of the previous segment.
+ *
+ * This is not real-time safe! It's only meant for offline rendering.
+ */
+struct Segment_Renderer
+{
+    struct Config
+    {
+        int num_threads = (int) std::thread::hardware_concurrency();
+        int segment_size = 16384;
+        int warm_up_size = 2048;
+        int seam_check_size = 256;
+        float max_seam_error = 1.0e-4f;
+    };
+
+    explicit Segment_Renderer (const Config& config);
+    ~Segment_Renderer();
+
+    struct Stats
+    {
+        int num_segments = 0;
+        int num_rerendered_segments = 0;
+        float max_seam_error = 0.0f;
+    };
+
+    /**
+     * Renders the data in-place, continuing from (and updating) the model state.
+     * Buffers that are too short to split up are rendered sequentially.
+     */
+    Stats render (LSTM_Model::Model_Variant& model, std::span<float> data);
+
+    const Config config;
+
+private:
+    void worker_thread_loop (size_t worker_idx);
+    void run_jobs (size_t worker_idx, uint64_t generation);
+    void render_segment (size_t worker_idx, int segment);
+
+    std::vector<std::thread> threads {};
+    std::vector<std::unique_ptr<LSTM_Model::Model_Variant>> worker_models {};
+    std::vector<std::vector<float>> worker_scratch {};
+
+    // per-render state, shared with the workers
+    std::vector<float> input {};
+    std::span<float> output {};
+    int num_segments = 0;
+    std::vector<std::vector<float>> segment_end_states {};
+    std::vector<std::vector<float>> seam_outputs {};
+
+    std::mutex mutex {};
+    std::condition_variable work_available {};
+    std::condition_variable work_done {};
+    uint64_t job_generation = 0;
+    int next_job = 0;
+    int jobs_remaining = 0;
+    bool should_exit = false;
+};
+
+/**
+ * Collects the host's blocks into batches that are long enough for the
+ * Segment_Renderer to split between its threads (at typical block sizes, a
+ * single block is too short to split up). The output is delayed by one batch,
+ * which the plugin reports as latency.
+ *
+ * Like the Segment_Renderer, this is only meant for offline rendering.
+ */
+struct Offline_Batcher
+{
+    explicit Offline_Batcher (int batch_size);
+
+    /**
+     * Pushes a block into the current batch, and replaces it with the output from
+     * the previous batch. Whenever a batch fills up, it gets rendered in-place with
+     * render_batch (std::span<float* const> channels, int num_samples).
+     */
+    template <typename Render_Batch>
+    void process (std::span<float* const> channels, int num_samples, Render_Batch&& render_batch)
+    {
+        for (int sample = 0; sample < num_samples;)
+        {
+            const auto chunk_size = std::min (num_samples - sample, batch_size - position);
+            for (size_t ch = 0; ch < channels.size(); ++ch)
+            {
+                auto* data = channels[ch] + sample;
+                std::copy (data, data + chunk_size, input_batch[ch].begin() + position);
+                std::copy (output_batch[ch].begin() + position, output_batch[ch].begin() + position + chunk_size, data);
+            }
+
+            sample += chunk_size;
+            position += chunk_size;
+            if (position < batch_size)
+                continue;
+
+            std::swap (input_batch, output_batch);
+            std::array<float*, LSTM_Model::max_num_streams> batch_channels {};
+            for (size_t ch = 0; ch < channels.size(); ++ch)
+                batch_channels[ch] = output_batch[ch].data();
+            render_batch (std::span<float* const> { batch_channels.data(), channels.size() }, batch_size);
+            position = 0;
+        }
+    }
+
+    const int batch_size;
+
+private:
+    std::array<std::vector<float>, LSTM_Model::max_num_streams> input_batch {};
+    std::array<std::vector<float>, LSTM_Model::max_num_streams> output_batch {};
+    int position = 0;
+};
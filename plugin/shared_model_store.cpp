@@ -0,0 +1,185 @@
+#include "shared_model_store.h"
+#include <numeric>
+
+std::shared_ptr<Shared_Model_Store> Shared_Model_Store::get (const std::string& model_id,
+                                                             const std::function<LSTM_Weights()>& load_weights)
+{
+    static std::mutex stores_mutex {};
+    static std::map<std::string, std::weak_ptr<Shared_Model_Store>> stores {};
+
+    std::lock_guard lock { stores_mutex };
+    if (auto store = stores[model_id].lock())
+        return store;
+
+    auto store = std::make_shared<Shared_Model_Store> (load_weights());
+    stores[model_id] = store;
+    return store;
+}
+
+Shared_Model_Store::Shared_Model_Store (LSTM_Weights&& weights)
+    : original_weights { std::make_shared<const LSTM_Weights> (std::move (weights)) }
+{
+    pruned_weights.reset (original_weights);
+}
+
+std::unique_ptr<LSTM_Model::Model_Variant> Shared_Model_Store::make_model (int hidden_size,
+                                                                          Ranking ranking,
+                                                                          Weight_Format format,
+                                                                          const std::function<bool()>& should_cancel)
+{
+    // the un-pruned model is the same for every ranking
+    const auto key = std::make_tuple (hidden_size,
+                                      hidden_size == LSTM_Model::max_hidden_size ? Ranking::Mean_Activations : ranking,
+                                      format);
+    {
+        std::lock_guard lock { mutex };
+        if (auto weights = shared_weights[key].lock())
+            return LSTM_Model::make_model (hidden_size, weights);
+    }
+
+    // build the weights without holding the lock, so other instances can keep going
+    auto weights = [&]
+    {
+        if (format == Weight_Format::Interleaved)
+            return make_interleaved_weights (hidden_size, ranking, should_cancel);
+
+        if (auto cached_weights = pruned_weights.get (hidden_size, ranking, should_cancel))
+        {
+            std::vector<int> unit_positions ((size_t) hidden_size);
+            std::iota (unit_positions.begin(), unit_positions.end(), 0);
+            return LSTM_Model::make_shared_weights (*cached_weights, unit_positions, format);
+        }
+
+        if (should_cancel != nullptr && should_cancel())
+            return LSTM_Model::Shared_Weights {};
+        return LSTM_Model::make_shared_weights (*original_weights, LSTM_Model::get_surviving_units (hidden_size, ranking), format);
+    }();
+
+    if (weights == nullptr)
+        return {};
+
+    {
+        // if another instance got there first, we should share its weights instead
+        std::lock_guard lock { mutex };
+        auto& shared_entry = shared_weights[key];
+        if (auto existing_weights = shared_entry.lock())
+            weights = std::move (existing_weights);
+        else
+            shared_entry = weights;
+    }
+
+    return LSTM_Model::make_model (hidden_size, weights);
+}
+
+LSTM_Model::Shared_Weights Shared_Model_Store::make_interleaved_weights (int hidden_size,
+                                                                         Ranking ranking,
+                                                                         const std::function<bool()>& should_cancel)
+{
+    std::call_once (interleaved_weights_flag,
+                    [this]
+                    { interleaved_weights = std::make_unique<const Interleaved_LSTM_Weights> (Interleaved_LSTM_Weights::from_rtneural (*original_weights)); });
+
+    // remove the pruned units one by one, in the order of the ranking
+    auto pruned_interleaved_weights = *interleaved_weights;
+    const auto num_pruned = (size_t) (LSTM_Model::max_hidden_size - hidden_size);
+    for (const auto& candidate : LSTM_Model::get_pruning_candidates (ranking).first (num_pruned))
+    {
+        if (should_cancel != nullptr && should_cancel())
+            return {};
+        pruned_interleaved_weights.remove_unit (candidate.idx);
+    }
+
+    return LSTM_Model::make_shared_weights (pruned_interleaved_weights);
+}
+
+size_t Shared_Model_Store::get_num_shared_weights()
+{
+    std::lock_guard lock { mutex };
+    std::erase_if (shared_weights,
+                   [] (const auto& entry)
+                   { return entry.second.expired(); });
+    return shared_weights.size();
+}
+
+std::shared_ptr<Shared_Feedforward_Store> Shared_Feedforward_Store::get (const std::string& model_id,
+                                                                         const std::function<Feedforward_Weights()>& load_weights)
+{
+    static std::mutex stores_mutex {};
+    static std::map<std::string, std::weak_ptr<Shared_Feedforward_Store>> stores {};
+
+    std::lock_guard lock { stores_mutex };
+    if (auto store = stores[model_id].lock())
+        return store;
+
+    auto store = std::make_shared<Shared_Feedforward_Store> (load_weights);
+    stores[model_id] = store;
+    return store;
+}
+
+Shared_Feedforward_Store::Shared_Feedforward_Store (std::function<Feedforward_Weights()> weights_loader)
+    : load_weights { std::move (weights_loader) }
+{
+}
+
+std::shared_ptr<const Feedforward_Weights> Shared_Feedforward_Store::get_original_weights()
+{
+    std::lock_guard lock { weights_mutex };
+    if (! std::exchange (tried_loading, true))
+    {
+        auto weights = load_weights();
+        if (! weights.layers.empty())
+            original_weights = std::make_shared<const Feedforward_Weights> (std::move (weights));
+    }
+    return original_weights;
+}
+
+std::span<const Pruning_Candidate> Shared_Feedforward_Store::get_pruning_candidates (const Feedforward_Weights& weights,
+                                                                                   Ranking ranking,
+                                                                                   const std::function<bool()>& should_cancel)
+{
+    // the candidates don't change once they've been ranked, so they can be used without the lock
+    auto& ranked = ranked_units[(size_t) ranking];
+    std::lock_guard lock { ranked.mutex };
+    if (ranked.candidates.empty())
+        ranked.candidates = weights.rank_units (ranking, should_cancel);
+    return ranked.candidates;
+}
+
+std::unique_ptr<Feedforward_Model::Model> Shared_Feedforward_Store::make_model (int hidden_size,
+                                                                                Ranking ranking,
+                                                                                const std::function<bool()>& should_cancel,
+                                                                                const std::function<bool()>& should_cancel_ranking)
+{
+    // the un-pruned model is the same for every ranking
+    const auto key = std::make_tuple (hidden_size, hidden_size == LSTM_Model::max_hidden_size ? Ranking::Mean_Activations : ranking);
+    {
+        std::lock_guard lock { mutex };
+        if (auto weights = shared_weights[key].lock())
+            return std::make_unique<Feedforward_Model::Model> (std::move (weights));
+    }
+
+    const auto original = get_original_weights();
+    if (original == nullptr)
+        return {};
+
+    auto weights = original;
+    if (hidden_size < LSTM_Model::max_hidden_size)
+    {
+        const auto candidates = get_pruning_candidates (*original, ranking, should_cancel_ranking);
+        if (candidates.empty() || (should_cancel != nullptr && should_cancel()))
+            return {};
+        weights = std::make_shared<const Feedforward_Weights> (original->gather_units (original->get_surviving_units (hidden_size, candidates)));
+    }
+
+    {
+        // if another instance got there first, we should share its weights instead
+        std::lock_guard lock { mutex };
+        auto& shared_entry = shared_weights[key];
+        if (auto existing_weights = shared_entry.lock())
+            weights = std::move (existing_weights);
+        else
+            shared_entry = weights;
+    }
+
+    return std::make_unique<Feedforward_Model::Model> (std::move (weights));
+}
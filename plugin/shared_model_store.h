@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#include "feedforward_model.h"
+#include "lstm_interleaved_weights.h"
+#include "pruned_model_cache.h"
+
+/**
+ * Process-wide store of read-only model data, so that plugin instances
+ * running the same model don't each need to parse the weights, keep a
+ * copy of them, and prune (or quantize) them.
+ *
+ * There's one store per model, which lives for as long as some instance
+ * is holding on to it. Within a store, the weights for each (ranking,
+ * hidden size, weight format) are built the first time that an instance
+ * asks for them, and are then shared with every other instance that asks,
+ * so each instance only owns its models' recurrent state. The shared weights are
+ * freed once none of the instances are using them.
+ *
+ * The Interleaved format is pruned in its own layout (see
+ * Interleaved_LSTM_Weights::remove_unit()), starting from an interleaved
+ * copy of the original weights, which is made the first time it's needed.
+ *
+ * The store is thread-safe, but not real-time safe.
+ */
+struct Shared_Model_Store
+{
+    /** Returns the store for a model, calling load_weights if no one else has the model loaded. */
+    static std::shared_ptr<Shared_Model_Store> get (const std::string& model_id,
+                                                    const std::function<LSTM_Weights()>& load_weights);
+
+    explicit Shared_Model_Store (LSTM_Weights&& weights);
+
+    const std::shared_ptr<const LSTM_Weights> original_weights;
+
+    /** Flat pruned weights, filled up in the background by the prune workers. */
+    Pruned_Model_Cache pruned_weights {};
+
+    /**
+     * Creates a model for the given ranking, hidden size, and weight format,
+     * building the shared weights if need be. Returns nullptr if it was cancelled.
+     */
+    std::unique_ptr<LSTM_Model::Model_Variant> make_model (int hidden_size,
+                                                           Ranking ranking,
+                                                           Weight_Format format = Weight_Format::Float32,
+                                                           const std::function<bool()>& should_cancel = {});
+
+    /** Returns the number of weight sets that are currently being shared. */
+    size_t get_num_shared_weights();
+
+private:
+    LSTM_Model::Shared_Weights make_interleaved_weights (int hidden_size, Ranking ranking, const std::function<bool()>& should_cancel);
+
+    std::once_flag interleaved_weights_flag {};
+    std::unique_ptr<const Interleaved_LSTM_Weights> interleaved_weights {};
+
+    std::mutex mutex {};
+    std::map<std::tuple<int, Ranking, Weight_Format>, std::weak_ptr<const void>> shared_weights {};
+};
+
+/**
+ * The same idea as Shared_Model_Store, but for the Dense and Conv1D networks.
+ *
+ * The weights are loaded the first time that an instance needs them, and
+ * each ranking is computed the first time that an instance prunes with it
+ * (see Feedforward_Weights::rank_units()). Each ranking has its own lock, so
+ * any other instances that want the same ranking wait for it to finish, rather
+ * than computing it again. Pruned weights are shared between instances, keyed
+ * by (hidden size, ranking).
+ *
+ * The store is thread-safe, but not real-time safe.
+ */
+struct Shared_Feedforward_Store
+{
+    /** Returns the store for a model (the weights aren't loaded until they're needed). */
+    static std::shared_ptr<Shared_Feedforward_Store> get (const std::string& model_id,
+                                                          const std::function<Feedforward_Weights()>& load_weights);
+
+    explicit Shared_Feedforward_Store (std::function<Feedforward_Weights()> load_weights);
+
+    /** Returns the un-pruned weights, loading them if need be. Returns nullptr if the model couldn't be loaded. */
+    std::shared_ptr<const Feedforward_Weights> get_original_weights();
+
+    /**
+     * Creates a model for the given ranking and hidden size (relative to the LSTM's hidden size,
+     * see Feedforward_Weights::get_surviving_units()), building the shared weights if need be.
+     * Returns nullptr if it was cancelled, or if the model couldn't be loaded.
+     *
+     * Computing a ranking can take a few seconds, and doesn't depend on the hidden size, so it
+     * has its own cancellation check (e.g. for when the ranking changes), and keeps going if the
+     * prune is cancelled otherwise, so that the next prune with the same ranking can use it.
+     */
+    std::unique_ptr<Feedforward_Model::Model> make_model (int hidden_size,
+                                                          Ranking ranking,
+                                                          const std::function<bool()>& should_cancel = {},
+                                                          const std::function<bool()>& should_cancel_ranking = {});
+
+private:
+    std::span<const Pruning_Candidate> get_pruning_candidates (const Feedforward_Weights& weights,
+                                                               Ranking ranking,
+                                                               const std::function<bool()>& should_cancel);
+
+    std::function<Feedforward_Weights()> load_weights;
+
+    std::mutex weights_mutex {}; // held while loading
+    std::shared_ptr<const Feedforward_Weights> original_weights {};
+    bool tried_loading = false;
+
+    struct Ranked_Units
+    {
+        std::mutex mutex {}; // held while ranking
+        std::vector<Pruning_Candidate> candidates {};
+    };
+    static constexpr size_t num_rankings = 3;
+    std::array<Ranked_Units, num_rankings> ranked_units {};
+
+    std::mutex mutex {};
+    std::map<std::tuple<int, Ranking>, std::weak_ptr<const Feedforward_Weights>> shared_weights {};
+};
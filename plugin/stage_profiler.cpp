@@ -0,0 +1,159 @@
+#include "stage_profiler.h"
+#include <algorithm>
+#include <bit>
+
+const char* Stage_Profiler::get_stage_name (Stage stage)
+{
+    switch (stage)
+    {
+        case Stage::Sum_To_Mono:
+            return "Sum To Mono";
+        case Stage::Upsample:
+            return "Upsample";
+        case Stage::LSTM:
+            return "LSTM";
+        case Stage::LSTM_Masked:
+            return "LSTM Masked";
+        case Stage::Dense:
+            return "Dense";
+        case Stage::Conv:
+            return "Conv";
+        case Stage::Downsample:
+            return "Downsample";
+        case Stage::DC_Blocker:
+            return "DC Blocker";
+        case Stage::Total:
+            return "Total";
+    }
+    return "";
+}
+
+size_t Stage_Profiler::get_bin (uint64_t duration_ns) noexcept
+{
+    if (duration_ns < 4)
+        return (size_t) duration_ns;
+
+    // 4 bins per octave, using the two bits below the leading bit
+    const auto octave = (size_t) std::bit_width (duration_ns) - 1;
+    const auto sub_bin = (size_t) (duration_ns >> (octave - 2)) & 3;
+    return std::min ((octave - 1) * 4 + sub_bin, num_bins - 1);
+}
+
+double Stage_Profiler::get_bin_upper_edge (size_t bin) noexcept
+{
+    if (bin < 4)
+        return (double) (bin + 1);
+
+    const auto octave = bin / 4 + 1;
+    const auto sub_bin = bin % 4;
+    return (double) ((uint64_t) (5 + sub_bin) << (octave - 2));
+}
+
+size_t Stage_Profiler::get_block_size_class (int block_size) noexcept
+{
+    return std::min ((size_t) std::bit_width ((unsigned int) std::max (block_size, 0)), num_block_size_classes - 1);
+}
+
+void Stage_Profiler::record (Stage stage, int block_size, int64_t duration_ns) noexcept
+{
+    const auto ns = (uint64_t) std::max (duration_ns, (int64_t) 0);
+    auto& histogram = histograms[(size_t) stage][get_block_size_class (block_size)];
+
+    // the audio thread is the only writer, so we don't need any read-modify-write atomics here
+    const auto bin = get_bin (ns);
+    histogram.counts[bin].store (histogram.counts[bin].load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    histogram.total_ns.store (histogram.total_ns.load (std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    histogram.total_samples.store (histogram.total_samples.load (std::memory_order_relaxed) + (uint64_t) std::max (block_size, 0), std::memory_order_relaxed);
+    if (ns > histogram.max_ns.load (std::memory_order_relaxed))
+        histogram.max_ns.store (ns, std::memory_order_relaxed);
+    histogram.num_blocks.store (histogram.num_blocks.load (std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void Stage_Profiler::reset() noexcept
+{
+    for (auto& stage_histograms : histograms)
+    {
+        for (auto& histogram : stage_histograms)
+        {
+            histogram.num_blocks.store (0, std::memory_order_relaxed);
+            for (auto& count : histogram.counts)
+                count.store (0, std::memory_order_relaxed);
+            histogram.total_ns.store (0, std::memory_order_relaxed);
+            histogram.total_samples.store (0, std::memory_order_relaxed);
+            histogram.max_ns.store (0, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::vector<Stage_Profiler::Stats> Stage_Profiler::get_stats() const
+{
+    std::vector<Stats> all_stats {};
+    for (size_t stage_idx = 0; stage_idx < num_stages; ++stage_idx)
+    {
+        for (size_t size_class = 0; size_class < num_block_size_classes; ++size_class)
+        {
+            const auto& histogram = histograms[stage_idx][size_class];
+            const auto num_blocks = histogram.num_blocks.load (std::memory_order_acquire);
+            if (num_blocks == 0)
+                continue;
+
+            std::array<uint32_t, num_bins> counts {};
+            uint64_t total_count = 0;
+            for (size_t bin = 0; bin < num_bins; ++bin)
+            {
+                counts[bin] = histogram.counts[bin].load (std::memory_order_relaxed);
+                total_count += counts[bin];
+            }
+
+            auto p99_ns = 0.0;
+            uint64_t cumulative_count = 0;
+            for (size_t bin = 0; bin < num_bins; ++bin)
+            {
+                cumulative_count += counts[bin];
+                if (cumulative_count * 100 >= total_count * 99)
+                {
+                    p99_ns = get_bin_upper_edge (bin);
+                    break;
+                }
+            }
+
+            all_stats.push_back ({
+                .stage = static_cast<Stage> (stage_idx),
+                .min_block_size = size_class == 0 ? 0 : 1 << (size_class - 1),
+                .max_block_size = (1 << size_class) - 1,
+                .num_blocks = num_blocks,
+                .mean_ns = (double) histogram.total_ns.load (std::memory_order_relaxed) / (double) num_blocks,
+                .p99_ns = std::min (p99_ns, (double) histogram.max_ns.load (std::memory_order_relaxed)),
+                .max_ns = (double) histogram.max_ns.load (std::memory_order_relaxed),
+            });
+        }
+    }
+    return all_stats;
+}
+
+double Stage_Profiler::get_mean_ns_per_sample (Stage stage) const noexcept
+{
+    uint64_t total_ns = 0;
+    uint64_t total_samples = 0;
+    for (const auto& histogram : histograms[(size_t) stage])
+    {
+        total_ns += histogram.total_ns.load (std::memory_order_relaxed);
+        total_samples += histogram.total_samples.load (std::memory_order_relaxed);
+    }
+    return total_samples > 0 ? (double) total_ns / (double) total_samples : 0.0;
+}
+
+void Stage_Profiler::export_csv (std::ostream& os) const
+{
+    os << "stage,min_block_size,max_block_size,num_blocks,mean_ns,p99_ns,max_ns\n";
+    for (const auto& stats : get_stats())
+    {
+        os << get_stage_name (stats.stage) << ','
+           << stats.min_block_size << ','
+           << stats.max_block_size << ','
+           << stats.num_blocks << ','
+           << stats.mean_ns << ','
+           << stats.p99_ns << ','
+           << stats.max_ns << '\n';
+    }
+}
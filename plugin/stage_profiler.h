@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/**
+ * Lock-free timing histograms for each stage of the audio callback.
+ *
+ * The audio thread is the only writer, and records into log-spaced histograms
+ * (4 bins per octave of nanoseconds), with a separate set of histograms for each
+ * octave of block sizes. Any other thread can read the stats while the audio
+ * thread is running.
+ *
+ * Timing only happens while something is using the results (i.e. while the
+ * editor is open, or in CPU budget mode), otherwise each Scoped_Timer costs a
+ * single relaxed atomic load.
+ */
+struct Stage_Profiler
+{
+    enum class Stage
+    {
+        Sum_To_Mono,
+        Upsample,
+        LSTM,
+        LSTM_Masked,
+        Dense,
+        Conv,
+        Downsample,
+        DC_Blocker,
+        Total,
+    };
+    static constexpr size_t num_stages = 9;
+    static constexpr size_t num_bins = 4 * 26; // up to ~67 ms
+    static constexpr size_t num_block_size_classes = 15; // up to 16384 samples
+
+    static const char* get_stage_name (Stage stage);
+
+    /** Starts or stops timing for one user of the results (safe to call from any thread). */
+    void add_user() noexcept { num_users.fetch_add (1, std::memory_order_relaxed); }
+    void remove_user() noexcept { num_users.fetch_sub (1, std::memory_order_relaxed); }
+    std::atomic<int> num_users { 0 };
+
+    struct [[nodiscard]] Scoped_Timer
+    {
+        Scoped_Timer (Stage_Profiler& p, Stage s, int block_size) noexcept
+            : profiler { p.num_users.load (std::memory_order_relaxed) > 0 ? &p : nullptr },
+              stage { s },
+              num_samples { block_size }
+        {
+            if (profiler != nullptr)
+                start = std::chrono::steady_clock::now();
+        }
+
+        ~Scoped_Timer()
+        {
+            if (profiler != nullptr)
+                profiler->record (stage, num_samples, std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now() - start).count());
+        }
+
+        Scoped_Timer (const Scoped_Timer&) = delete;
+        Scoped_Timer& operator= (const Scoped_Timer&) = delete;
+
+    private:
+        Stage_Profiler* profiler;
+        Stage stage;
+        int num_samples;
+        std::chrono::steady_clock::time_point start {};
+    };
+
+    Scoped_Timer time_stage (Stage stage, int block_size) noexcept { return { *this, stage, block_size }; }
+
+    /** Records a measurement (audio thread only). */
+    void record (Stage stage, int block_size, int64_t duration_ns) noexcept;
+
+    struct Stats
+    {
+        Stage stage {};
+        int min_block_size {};
+        int max_block_size {};
+        uint32_t num_blocks {};
+        double mean_ns {};
+        double p99_ns {};
+        double max_ns {};
+    };
+
+    /** Returns the stats for every stage and block size that has measurements. */
+    std::vector<Stats> get_stats() const;
+
+    /** Returns the mean time that a stage has taken per sample (over every block size), or zero if it hasn't been measured. */
+    double get_mean_ns_per_sample (Stage stage) const noexcept;
+
+    /** Writes the stats as CSV. */
+    void export_csv (std::ostream& os) const;
+
+    /** Clears the histograms (if the audio thread is recording at the same time, a few measurements may be skewed). */
+    void reset() noexcept;
+
+private:
+    static size_t get_bin (uint64_t duration_ns) noexcept;
+    static double get_bin_upper_edge (size_t bin) noexcept;
+    static size_t get_block_size_class (int block_size) noexcept;
+
+    struct Histogram
+    {
+        std::array<std::atomic<uint32_t>, num_bins> counts {};
+        std::atomic<uint32_t> num_blocks { 0 };
+        std::atomic<uint64_t> total_ns { 0 };
+        std::atomic<uint64_t> total_samples { 0 };
+        std::atomic<uint64_t> max_ns { 0 };
+    };
+    std::array<std::array<Histogram, num_block_size_classes>, num_stages> histograms {};
+};
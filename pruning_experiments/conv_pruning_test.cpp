@@ -5,67 +5,7 @@
 
 #include <RTNeural/RTNeural.h>
 
-static std::tuple<std::vector<float>, std::vector<float>> get_audio_data()
-{
-    // re-use the same data that we used for training
-    static constexpr int seek_offset = 2'000'000;
-    static constexpr int num_samples = 1'471'622;
-
-    // Or, use validation data
-    // static constexpr int seek_offset = 1'500'000;
-    // static constexpr int num_samples = 500'000;
-
-    std::vector<float> in_data (num_samples);
-    std::vector<float> target_data (num_samples);
-
-    {
-        const auto audio_path { std::string { TRAIN_DIR } + "/fuzz_input.wav" };
-        SF_INFO audio_file_info;
-        auto* audio_file = sf_open (audio_path.c_str(), SFM_READ, &audio_file_info);
-        sf_seek (audio_file, seek_offset, SEEK_SET);
-        sf_read_float (audio_file, in_data.data(), (sf_count_t) in_data.size());
-        sf_close (audio_file);
-    }
-
-    {
-        // this file is stereo, but we're only going to use the left channel
-        const auto audio_path { std::string { TRAIN_DIR } + "/fuzz_15_50.wav" };
-        SF_INFO audio_file_info;
-        auto* audio_file = sf_open (audio_path.c_str(), SFM_READ, &audio_file_info);
-        sf_seek (audio_file, seek_offset, SEEK_SET);
-
-        std::vector<float> stereo_data (num_samples * 2);
-        sf_read_float (audio_file, stereo_data.data(), (sf_count_t) target_data.size());
-        sf_close (audio_file);
-
-        for (int n = 0; n < num_samples; ++n)
-            target_data[n] = stereo_data[2 * n];
-    }
-
-    return std::make_tuple (in_data, target_data);
-}
-
-static auto get_model_json()
-{
-    const auto model_path { std::string { TRAIN_DIR } + "/conv.json" };
-    nlohmann::json model_json {};
-    std::ifstream { model_path, std::ifstream::binary } >> model_json;
-    return model_json;
-}
-
-static auto compute_mse (std::span<const float> x, std::span<const float> y)
-{
-    const auto N = x.size();
-
-    auto square_error_accum = 0.0f;
-    for (int n = 0; n < N; ++n)
-    {
-        const auto sample_error = (x[n] - y[n]);
-        square_error_accum += sample_error * sample_error;
-    }
-
-    return square_error_accum / static_cast<float> (N);
-}
+#include "experiment_utils.h"
 
 struct Model
 {
@@ -75,7 +15,11 @@ struct Model
     std::vector<RTNeural::Conv1D<float>> conv_layers {};
     RTNeural::TanhActivation<float> tanh_activation { layer_width };
     std::optional<RTNeural::Dense<float>> dense_layer {};
-    alignas (16) std::array<std::array<float, layer_width>, num_layers + 1> layer_io {};
+    alignas (64) std::array<std::array<float, layer_width>, num_layers + 1> layer_io {};
+
+    // the approximations run through the LSTM's SIMD kernels (see lstm_kernels.h)
+    Activation activation = Activation::Exact;
+    const lstm_kernels::Kernel* simd_kernel = lstm_kernels::get_kernel();
 
     explicit Model (const nlohmann::json& model_json)
     {
@@ -107,15 +51,23 @@ struct Model
         assert (in_size == 1);
     }
 
+    void apply_tanh (float* x) noexcept
+    {
+        if (activation == Activation::Exact || simd_kernel == nullptr)
+            tanh_activation.forward (x, x);
+        else
+            simd_kernel->apply_tanh (x, x, layer_width, activation);
+    }
+
     float forward (const float* in) noexcept
     {
         conv_layers.front().forward (in, layer_io.front().data());
-        tanh_activation.forward (layer_io.front().data(), layer_io.front().data());
+        apply_tanh (layer_io.front().data());
 
         for (int i = 0; i < num_layers - 1; ++i)
         {
             conv_layers[i + 1].forward (layer_io[i].data(), layer_io[i + 1].data());
-            tanh_activation.forward (layer_io[i + 1].data(), layer_io[i + 1].data());
+            apply_tanh (layer_io[i + 1].data());
         }
         dense_layer->forward (layer_io[num_layers - 1].data(), layer_io[num_layers].data());
 
@@ -338,7 +290,27 @@ static float rank_minimization (nlohmann::json model_json,
     const auto model_out = run_model (model, in_data, false);
     const auto mse = compute_mse (model_out, target_data);
 
-    return mse;
+    return static_cast<float> (mse);
+}
+
+/** Reports the MSE and speed-up for each of the activation approximations */
+static void compare_activations (const nlohmann::json& model_json, std::span<const float> in_data, std::span<const float> target_data)
+{
+    auto exact_seconds = 0.0f;
+    for (auto activation : { Activation::Exact, Activation::Rational, Activation::Polynomial, Activation::Table })
+    {
+        Model model { model_json };
+        model.activation = activation;
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        const auto model_out = run_model (model, in_data, false);
+        const auto seconds = std::chrono::duration<float> { std::chrono::high_resolution_clock::now() - start }.count();
+        if (activation == Activation::Exact)
+            exact_seconds = seconds;
+
+        std::cout << "  Activation " << get_activation_name (activation) << " MSE: " << compute_mse (model_out, target_data)
+                  << ", speed-up: " << exact_seconds / seconds << "x\n";
+    }
 }
 
 enum class Ranking
@@ -411,7 +383,7 @@ int main()
     std::cout << "Conv. network pruning test\n";
 
     const auto [in_data, target_data] = get_audio_data();
-    auto model_json = get_model_json();
+    auto model_json = get_model_json ("conv");
 
     // {
     //     std::cout << "Parameter count: " << count_params (model_json) << '\n';
@@ -436,6 +408,7 @@ int main()
         Model model { model_json };
         const auto model_out = run_model (model, in_data, true, 5);
         std::cout << "Prune " << iter << " MSE: " << compute_mse (model_out, target_data) << '\n';
+        compare_activations (model_json, in_data, target_data);
 
         static constexpr auto n_prune = 6;
         model_json = prune (model_json, pruning_candidates, n_prune * iter, n_prune);
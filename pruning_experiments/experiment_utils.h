@@ -0,0 +1,82 @@
+#pragma once
+
+#include <RTNeural/RTNeural.h>
+#include <fstream>
+#include <sndfile.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "lstm_kernels.h"
+
+// helpers shared by the experiments that run the plugin's models on the training data
+
+/** Returns the input and target (left channel) audio that we used for training. */
+inline std::tuple<std::vector<float>, std::vector<float>> get_audio_data()
+{
+    // re-use the same data that we used for training
+    static constexpr int seek_offset = 2'000'000;
+    static constexpr int num_samples = 1'471'622;
+
+    std::vector<float> in_data (num_samples);
+    std::vector<float> target_data (num_samples);
+
+    {
+        const auto audio_path { std::string { TRAIN_DIR } + "/fuzz_input.wav" };
+        SF_INFO audio_file_info;
+        auto* audio_file = sf_open (audio_path.c_str(), SFM_READ, &audio_file_info);
+        sf_seek (audio_file, seek_offset, SEEK_SET);
+        sf_readf_float (audio_file, in_data.data(), (sf_count_t) in_data.size());
+        sf_close (audio_file);
+    }
+
+    {
+        // this file is stereo, but we're only going to use the left channel
+        const auto audio_path { std::string { TRAIN_DIR } + "/fuzz_15_50.wav" };
+        SF_INFO audio_file_info;
+        auto* audio_file = sf_open (audio_path.c_str(), SFM_READ, &audio_file_info);
+        sf_seek (audio_file, seek_offset, SEEK_SET);
+
+        std::vector<float> stereo_data (num_samples * 2);
+        sf_readf_float (audio_file, stereo_data.data(), (sf_count_t) target_data.size());
+        sf_close (audio_file);
+
+        for (int n = 0; n < num_samples; ++n)
+            target_data[(size_t) n] = stereo_data[2 * (size_t) n];
+    }
+
+    return std::make_tuple (in_data, target_data);
+}
+
+/** Loads one of the model JSON files from the training directory (e.g. "lstm"). */
+inline nlohmann::json get_model_json (const std::string& model_name)
+{
+    const auto model_path { std::string { TRAIN_DIR } + "/" + model_name + ".json" };
+    nlohmann::json model_json {};
+    std::ifstream { model_path, std::ifstream::binary } >> model_json;
+    return model_json;
+}
+
+inline double compute_mse (std::span<const float> x, std::span<const float> y)
+{
+    auto square_error_accum = 0.0;
+    for (size_t n = 0; n < x.size(); ++n)
+    {
+        const auto sample_error = (double) (x[n] - y[n]);
+        square_error_accum += sample_error * sample_error;
+    }
+
+    return square_error_accum / static_cast<double> (x.size());
+}
+inline std::string_view get_activation_name (Activation activation)
+{
+    if (activation == Activation::Rational)
+        return "rational";
+    if (activation == Activation::Polynomial)
+        return "polynomial";
+    if (activation == Activation::Table)
+        return "table";
+    return "exact";
+}
@@ -0,0 +1,131 @@
+#include <chrono>
+#include <iostream>
+
+#include "experiment_utils.h"
+#include "feedforward_model.h"
+
+/**
+ * Checks the plugin's Dense and Conv1D engine (see Feedforward_Model) against
+ * RTNeural's layers, and then reports the parameter count, speed, and error
+ * of each architecture, for each ranking and pruned hidden size.
+ */
+
+/** Runs the model JSON through RTNeural's run-time layers, one sample at a time. */
+static std::vector<float> run_reference (const nlohmann::json& model_json, std::span<const float> input)
+{
+    std::vector<std::unique_ptr<RTNeural::Layer<float>>> layers {};
+    int in_size = 1;
+    for (auto& layer : model_json["layers"])
+    {
+        const auto out_size = layer["shape"].back().get<int>();
+        if (layer["type"] == "conv1d")
+        {
+            const auto kernel_size = layer["kernel_size"].back().get<int>();
+            const auto dilation = layer["dilation"].back().get<int>();
+            auto conv1d = std::make_unique<RTNeural::Conv1D<float>> (in_size, out_size, kernel_size, dilation);
+            RTNeural::json_parser::loadConv1D<float> (*conv1d, kernel_size, dilation, layer["weights"]);
+            layers.push_back (std::move (conv1d));
+        }
+        else if (layer["type"] == "dense")
+        {
+            auto dense = std::make_unique<RTNeural::Dense<float>> (in_size, out_size);
+            RTNeural::json_parser::loadDense<float> (*dense, layer["weights"]);
+            layers.push_back (std::move (dense));
+        }
+
+        const auto activation = layer["activation"].get<std::string>();
+        if (activation == "relu")
+            layers.push_back (std::make_unique<RTNeural::ReLuActivation<float>> (out_size));
+        else if (activation == "tanh")
+            layers.push_back (std::make_unique<RTNeural::TanhActivation<float>> (out_size));
+        in_size = out_size;
+    }
+
+    std::vector<float> output (input.size());
+    std::array<std::array<float, 64>, 2> layer_io {};
+    for (size_t n = 0; n < input.size(); ++n)
+    {
+        layer_io[0][0] = input[n];
+        for (auto& layer : layers)
+        {
+            layer->forward (layer_io[0].data(), layer_io[1].data());
+            std::swap (layer_io[0], layer_io[1]);
+        }
+        output[n] = layer_io[0][0];
+    }
+
+    return output;
+}
+
+static std::string_view get_ranking_name (Ranking ranking)
+{
+    if (ranking == Ranking::Min_Weights)
+        return "min. weights";
+    if (ranking == Ranking::Mean_Activations)
+        return "mean activations";
+    return "minimization";
+}
+
+static std::vector<float> run_model (Feedforward_Model::Model& model, std::span<const float> input, double& ns_per_sample)
+{
+    std::vector<float> output { input.begin(), input.end() };
+
+    // use an awkward block size, so that we test the sub-blocks
+    static constexpr int block_size = 100;
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (size_t block_start = 0; block_start < output.size(); block_start += block_size)
+    {
+        float* const channels[] = { output.data() + block_start };
+        model.process (channels, (int) std::min (output.size() - block_start, (size_t) block_size));
+    }
+    const auto duration = std::chrono::duration<double, std::nano> (std::chrono::high_resolution_clock::now() - start);
+    ns_per_sample = duration.count() / (double) output.size();
+
+    return output;
+}
+
+int main()
+{
+    const auto [in_data, target_data] = get_audio_data();
+
+    for (const auto* model_name : { "dense", "conv" })
+    {
+        const auto model_json = get_model_json (model_name);
+        const auto weights = std::make_shared<const Feedforward_Weights> (Feedforward_Weights::from_json (model_json));
+        std::cout << "Model: " << model_name << ", " << weights->get_num_units() << " units, "
+                  << weights->get_num_params() << " parameters" << std::endl;
+
+        {
+            const auto check_input = std::span { in_data }.first (48'000);
+            const auto reference_out = run_reference (model_json, check_input);
+            Feedforward_Model::Model model { weights };
+            double ns_per_sample {};
+            const auto model_out = run_model (model, check_input, ns_per_sample);
+            std::cout << "  MSE vs. RTNeural: " << compute_mse (model_out, reference_out) << std::endl;
+        }
+
+        for (auto ranking : { Ranking::Min_Weights, Ranking::Mean_Activations, Ranking::Minimization })
+        {
+            const auto start = std::chrono::high_resolution_clock::now();
+            const auto pruning_candidates = weights->rank_units (ranking);
+            const auto duration = std::chrono::duration<double> (std::chrono::high_resolution_clock::now() - start);
+            std::cout << "  Ranking: " << get_ranking_name (ranking) << " (" << duration.count() << " seconds)" << std::endl;
+
+            for (int hidden_size = LSTM_Model::max_hidden_size; hidden_size >= LSTM_Model::min_hidden_size; hidden_size -= 12)
+            {
+                const auto pruned_weights = std::make_shared<const Feedforward_Weights> (
+                    weights->gather_units (weights->get_surviving_units (hidden_size, pruning_candidates)));
+
+                Feedforward_Model::Model model { pruned_weights };
+                double ns_per_sample {};
+                const auto model_out = run_model (model, in_data, ns_per_sample);
+                std::cout << "    Hidden size " << hidden_size << ": "
+                          << pruned_weights->get_num_params() << " parameters, "
+                          << ns_per_sample << " ns/sample, "
+                          << "MSE: " << compute_mse (model_out, target_data) << std::endl;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <chrono>
+#include <iostream>
+
+#include "experiment_utils.h"
+#include "lstm_model.h"
+
+/**
+ * Compares the activation approximations (see Activation) for the plugin's
+ * LSTM model, for each pruned hidden size. For each approximation, this reports
+ * the MSE against the training data (the same way as in lstm_pruning_test),
+ * and the speed-up compared to the exact activations.
+ */
+
+int main()
+{
+    const auto [in_data, target_data] = get_audio_data();
+    const auto weights = LSTM_Weights::from_json (get_model_json ("lstm"));
+    const auto ranking = Ranking::Mean_Activations;
+
+    const auto* simd_kernel = lstm_kernels::get_kernel();
+    if (simd_kernel == nullptr)
+    {
+        std::cout << "No SIMD kernels available, so the activations can't be approximated!" << std::endl;
+        return 1;
+    }
+    std::cout << "Using " << simd_kernel->name << " kernels, with mean activations ranking" << std::endl;
+
+    std::vector<float> out_data (in_data.size());
+    for (int hidden_size = LSTM_Model::max_hidden_size; hidden_size >= LSTM_Model::min_hidden_size; hidden_size -= 4)
+    {
+        const auto shared_weights = LSTM_Model::make_shared_weights (weights, LSTM_Model::get_surviving_units (hidden_size, ranking));
+
+        auto exact_ns_per_sample = 0.0;
+        for (auto activation : { Activation::Exact, Activation::Rational, Activation::Polynomial, Activation::Table })
+        {
+            auto model = LSTM_Model::make_model (hidden_size, shared_weights);
+            std::copy (in_data.begin(), in_data.end(), out_data.begin());
+
+            const auto start = std::chrono::high_resolution_clock::now();
+            std::visit (
+                [&out_data, activation] (auto& m)
+                {
+                    m.lstm.activation = activation;
+                    float* const channels[] = { out_data.data() };
+                    m.process (channels, (int) out_data.size());
+                },
+                *model);
+            const auto duration = std::chrono::duration<double, std::nano> (std::chrono::high_resolution_clock::now() - start);
+
+            const auto ns_per_sample = duration.count() / (double) in_data.size();
+            if (activation == Activation::Exact)
+                exact_ns_per_sample = ns_per_sample;
+
+            std::cout << "Hidden size " << hidden_size << ", " << get_activation_name (activation) << ": "
+                      << "MSE: " << compute_mse (out_data, target_data) << ", "
+                      << ns_per_sample << " ns/sample (speed-up: " << exact_ns_per_sample / ns_per_sample << "x)" << std::endl;
+        }
+    }
+
+    return 0;
+}
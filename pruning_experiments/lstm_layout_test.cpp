@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "experiment_utils.h"
+#include "lstm_interleaved_weights.h"
+#include "lstm_model.h"
+#include "shared_model_store.h"
+
+/**
+ * Compares the gate-interleaved, unit-contiguous weights layout (see
+ * Interleaved_LSTM_Weights) with the Keras/RTNeural layout: checks that the
+ * converters round-trip, times removing units one at a time in each layout,
+ * and compares the speed of the SIMD kernels for each layout, for each
+ * pruned hidden size (with the models built by Shared_Model_Store, which
+ * prunes the interleaved layout with remove_unit()).
+ */
+
+static void check_pruning (const LSTM_Weights& weights, Ranking ranking)
+{
+    auto keras_weights = weights;
+    auto interleaved_weights = Interleaved_LSTM_Weights::from_json (weights.to_json());
+    if (! std::ranges::equal (interleaved_weights.to_rtneural().values(), weights.values()))
+        std::cout << "Interleaved weights don't round-trip!" << std::endl;
+
+    std::chrono::duration<double, std::micro> keras_duration {};
+    std::chrono::duration<double, std::micro> interleaved_duration {};
+    auto all_match = true;
+    for (const auto& candidate : LSTM_Model::get_pruning_candidates (ranking).first (LSTM_Model::max_hidden_size - LSTM_Model::min_hidden_size))
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        keras_weights = keras_weights.without_unit (candidate.idx);
+        keras_duration += std::chrono::high_resolution_clock::now() - start;
+
+        start = std::chrono::high_resolution_clock::now();
+        interleaved_weights.remove_unit (candidate.idx);
+        interleaved_duration += std::chrono::high_resolution_clock::now() - start;
+
+        all_match &= std::ranges::equal (interleaved_weights.to_rtneural().values(), keras_weights.values());
+    }
+
+    std::cout << "Pruning from " << LSTM_Model::max_hidden_size << " to " << LSTM_Model::min_hidden_size << " units: "
+              << keras_duration.count() << " us (Keras layout), "
+              << interleaved_duration.count() << " us (interleaved layout), "
+              << (all_match ? "weights match" : "weights DON'T match!") << std::endl;
+}
+
+int main()
+{
+    const auto [in_data, target_data] = get_audio_data();
+    const auto weights = LSTM_Weights::from_json (get_model_json ("lstm"));
+    const auto ranking = Ranking::Mean_Activations;
+
+    const auto* simd_kernel = lstm_kernels::get_kernel();
+    if (simd_kernel == nullptr)
+    {
+        std::cout << "No SIMD kernels available, so the interleaved layout can't be used!" << std::endl;
+        return 1;
+    }
+    std::cout << "Using " << simd_kernel->name << " kernels, with mean activations ranking" << std::endl;
+
+    check_pruning (weights, ranking);
+    Shared_Model_Store store { LSTM_Weights { weights } };
+
+    std::vector<float> gate_major_out (in_data.size());
+    std::vector<float> interleaved_out (in_data.size());
+    for (int hidden_size = LSTM_Model::max_hidden_size; hidden_size >= LSTM_Model::min_hidden_size; hidden_size -= 4)
+    {
+        std::array<double, 2> ns_per_sample {};
+        for (auto format : { Weight_Format::Float32, Weight_Format::Interleaved })
+        {
+            auto model = store.make_model (hidden_size, ranking, format);
+            auto& out_data = format == Weight_Format::Float32 ? gate_major_out : interleaved_out;
+            std::copy (in_data.begin(), in_data.end(), out_data.begin());
+
+            const auto start = std::chrono::high_resolution_clock::now();
+            std::visit (
+                [&out_data] (auto& m)
+                {
+                    float* const channels[] = { out_data.data() };
+                    m.process (channels, (int) out_data.size());
+                },
+                *model);
+            const auto duration = std::chrono::duration<double, std::nano> (std::chrono::high_resolution_clock::now() - start);
+            ns_per_sample[format == Weight_Format::Float32 ? 0 : 1] = duration.count() / (double) in_data.size();
+        }
+
+        std::cout << "Hidden size " << hidden_size << ": "
+                  << ns_per_sample[0] << " ns/sample (gate-major), "
+                  << ns_per_sample[1] << " ns/sample (interleaved), "
+                  << "MSE between layouts: " << compute_mse (interleaved_out, gate_major_out) << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#include "lstm_model.h"
+
+/**
+ * Benchmarks the per-sample cost of the plugin's LSTM_Model for every hidden size.
+ * This gets built once per model grid (see lstm_model.h), so comparing the output
+ * (including the binary size) shows the trade-off between the grid sizes.
+ * It also compares the per-channel cost of running a stereo signal as a batch
+ * through one model with running each channel through its own model.
+ */
+
+static auto get_model_weights()
+{
+    const auto model_path { std::string { TRAIN_DIR } + "/lstm.json" };
+    nlohmann::json model_json {};
+    std::ifstream { model_path, std::ifstream::binary } >> model_json;
+    return LSTM_Weights::from_json (model_json);
+}
+
+int main (int, char* argv[])
+{
+    static constexpr int block_size = 128;
+    static constexpr int num_blocks = 4'000;
+
+    std::cout << "Benchmarking LSTM model with model grid: " << LSTM_Model::model_grid << std::endl;
+
+    std::vector<float> test_data (block_size);
+    std::vector<float> process_data (block_size);
+    std::mt19937 rng { 0x1234 };
+    std::uniform_real_distribution<float> dist { -1.0f, 1.0f };
+    for (auto& x : test_data)
+        x = dist (rng);
+
+    LSTM_Model lstm_model {};
+    lstm_model.original_weights = std::make_shared<const LSTM_Weights> (get_model_weights());
+
+    auto total_ns_per_sample = 0.0;
+    for (int hidden_size = LSTM_Model::min_hidden_size; hidden_size <= LSTM_Model::max_hidden_size; ++hidden_size)
+    {
+        lstm_model.prune (hidden_size, Ranking::Min_Weights);
+
+        // the first block swaps in the new model
+        std::copy (test_data.begin(), test_data.end(), process_data.begin());
+        lstm_model.process (process_data);
+        lstm_model.free_retired_model();
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (int block = 0; block < num_blocks; ++block)
+        {
+            std::copy (test_data.begin(), test_data.end(), process_data.begin());
+            lstm_model.process (process_data);
+        }
+        const auto duration = std::chrono::duration<double, std::nano> (std::chrono::high_resolution_clock::now() - start);
+
+        const auto ns_per_sample = duration.count() / static_cast<double> (num_blocks * block_size);
+        total_ns_per_sample += ns_per_sample;
+        std::cout << "Hidden size " << hidden_size
+                  << " (model size " << LSTM_Model::get_model_size (hidden_size) << "): "
+                  << ns_per_sample << " ns/sample" << std::endl;
+    }
+
+    const auto num_sizes = LSTM_Model::max_hidden_size - LSTM_Model::min_hidden_size + 1;
+    std::cout << "Average: " << total_ns_per_sample / static_cast<double> (num_sizes) << " ns/sample" << std::endl;
+
+    // compare running both channels as a batch (true-stereo) with running each channel in its own model
+    auto total_stereo_speed_up = 0.0;
+    for (int hidden_size = LSTM_Model::min_hidden_size; hidden_size <= LSTM_Model::max_hidden_size; ++hidden_size)
+    {
+        const auto two_models_ns_per_sample = 2.0 * LSTM_Model::measure_ns_per_sample (hidden_size, *lstm_model.original_weights, 1);
+        const auto batched_ns_per_sample = LSTM_Model::measure_ns_per_sample (hidden_size, *lstm_model.original_weights, 2);
+        const auto speed_up = two_models_ns_per_sample / batched_ns_per_sample;
+        total_stereo_speed_up += speed_up;
+        std::cout << "Hidden size " << hidden_size << " (stereo): "
+                  << batched_ns_per_sample / 2.0 << " ns/sample/channel batched, "
+                  << two_models_ns_per_sample / 2.0 << " ns/sample/channel with two models, "
+                  << "speed-up: " << speed_up << "x" << std::endl;
+    }
+    std::cout << "Average stereo speed-up: " << total_stereo_speed_up / static_cast<double> (num_sizes) << "x" << std::endl;
+    std::cout << "Number of model variants: " << std::variant_size_v<LSTM_Model::Model_Variant> << std::endl;
+    std::cout << "Binary size: " << std::filesystem::file_size (argv[0]) / 1024 << " kB" << std::endl;
+
+    return 0;
+}
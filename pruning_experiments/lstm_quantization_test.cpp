@@ -0,0 +1,91 @@
+#include <chrono>
+#include <iostream>
+
+#include "experiment_utils.h"
+#include "lstm_model.h"
+
+/**
+ * Measures how much quantizing the recurrent weights (or storing them
+ * as fp16/bf16, see Weight_Format)
+ * adds to the error of the plugin's LSTM model, for each pruned hidden size.
+ * The errors are measured against the training data, the same way as in
+ * lstm_pruning_test.
+ */
+
+static std::string_view get_format_name (Weight_Format format)
+{
+    if (format == Weight_Format::Int12)
+        return "int12 (stored as int16)";
+    if (format == Weight_Format::Int8)
+        return "int8";
+    if (format == Weight_Format::Float16)
+        return "fp16";
+    if (format == Weight_Format::BFloat16)
+        return "bf16";
+    return "float32";
+}
+
+/** Returns the number of bytes that the recurrent matvec streams through for each sample */
+static size_t get_recurrent_bytes (int hidden_size, Weight_Format format)
+{
+    const auto padded_size = (size_t) lstm_kernels::padded_size (LSTM_Model::get_model_size (hidden_size));
+    const auto num_units = (size_t) LSTM_Model::get_model_size (hidden_size);
+    if (format == Weight_Format::Int12)
+        return 4 * padded_size * ((num_units + 1) / 2) * 2 * sizeof (int16_t);
+    if (format == Weight_Format::Int8)
+        return 4 * padded_size * ((num_units + 1) / 2) * 2 * sizeof (int8_t);
+    if (format == Weight_Format::Float16 || format == Weight_Format::BFloat16)
+        return 4 * padded_size * num_units * sizeof (uint16_t);
+    return 4 * padded_size * num_units * sizeof (float);
+}
+
+int main()
+{
+    const auto [in_data, target_data] = get_audio_data();
+    const auto weights = LSTM_Weights::from_json (get_model_json ("lstm"));
+    const auto ranking = Ranking::Mean_Activations;
+
+    const auto* simd_kernel = lstm_kernels::get_kernel();
+    if (simd_kernel == nullptr)
+    {
+        std::cout << "No SIMD kernels available, so the weights can't be quantized!" << std::endl;
+        return 1;
+    }
+    std::cout << "Using " << simd_kernel->name << " kernels, with mean activations ranking" << std::endl;
+
+    std::vector<float> float_out (in_data.size());
+    std::vector<float> quantized_out (in_data.size());
+    for (int hidden_size = LSTM_Model::max_hidden_size; hidden_size >= LSTM_Model::min_hidden_size; hidden_size -= 4)
+    {
+        const auto unit_positions = LSTM_Model::get_surviving_units (hidden_size, ranking);
+        for (auto format : { Weight_Format::Float32, Weight_Format::Int12, Weight_Format::Int8, Weight_Format::Float16, Weight_Format::BFloat16 })
+        {
+            auto model = LSTM_Model::make_model (hidden_size, LSTM_Model::make_shared_weights (weights, unit_positions, format));
+            auto& out_data = format == Weight_Format::Float32 ? float_out : quantized_out;
+            std::copy (in_data.begin(), in_data.end(), out_data.begin());
+
+            const auto start = std::chrono::high_resolution_clock::now();
+            std::visit (
+                [&out_data] (auto& m)
+                {
+                    float* const channels[] = { out_data.data() };
+                    m.process (channels, (int) out_data.size());
+                },
+                *model);
+            const auto duration = std::chrono::duration<double, std::nano> (std::chrono::high_resolution_clock::now() - start);
+
+            std::cout << "Hidden size " << hidden_size << ", " << get_format_name (format) << ": "
+                      << "MSE: " << compute_mse (out_data, target_data);
+            if (format != Weight_Format::Float32)
+                std::cout << " (vs. float: " << compute_mse (out_data, float_out) << ")";
+            const auto resident_bytes = std::visit ([] (const auto& m)
+                                                    { return m.weights->lstm.size_bytes(); },
+                                                    *model);
+            std::cout << ", " << duration.count() / (double) in_data.size() << " ns/sample, "
+                      << get_recurrent_bytes (hidden_size, format) / 1024.0 << " kB of recurrent weights, "
+                      << resident_bytes / 1024.0 << " kB of LSTM weights in memory" << std::endl;
+        }
+    }
+
+    return 0;
+}
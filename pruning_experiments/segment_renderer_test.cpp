@@ -0,0 +1,78 @@
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+#include "experiment_utils.h"
+#include "segment_renderer.h"
+
+/**
+ * Checks that the Segment_Renderer's parallel render matches a sequential
+ * render of the same model, both with the default error bound, and with an
+ * error bound so tight that every seam gets re-rendered (which should match
+ * exactly).
+ */
+
+static constexpr int num_samples = 200'000;
+
+static std::unique_ptr<LSTM_Model::Model_Variant> make_model (const LSTM_Weights& weights)
+{
+    std::vector<int> unit_positions ((size_t) weights.hidden_size);
+    std::iota (unit_positions.begin(), unit_positions.end(), 0);
+    return LSTM_Model::make_model (weights.hidden_size, LSTM_Model::make_shared_weights (weights, unit_positions));
+}
+
+static float get_max_error (std::span<const float> x, std::span<const float> y)
+{
+    auto max_error = 0.0f;
+    for (size_t n = 0; n < x.size(); ++n)
+        max_error = std::max (max_error, std::abs (x[n] - y[n]));
+    return max_error;
+}
+
+int main()
+{
+    const auto [in_data, target_data] = get_audio_data();
+    const auto input = std::span { in_data }.first (num_samples);
+    const auto weights = LSTM_Weights::from_json (get_model_json ("lstm"));
+
+    std::vector<float> sequential_out { input.begin(), input.end() };
+    {
+        auto model = make_model (weights);
+        float* const channels[] = { sequential_out.data() };
+        std::visit ([&channels] (auto& m)
+                    { m.process (channels, num_samples); },
+                    *model);
+    }
+
+    auto success = true;
+    for (const auto max_seam_error : { 1.0e-4f, 0.0f })
+    {
+        Segment_Renderer renderer { {
+            .num_threads = 4,
+            .segment_size = num_samples / 12,
+            .warm_up_size = 2048,
+            .seam_check_size = 256,
+            .max_seam_error = max_seam_error,
+        } };
+
+        auto model = make_model (weights);
+        std::vector<float> parallel_out { input.begin(), input.end() };
+        const auto stats = renderer.render (*model, parallel_out);
+        const auto max_error = get_max_error (parallel_out, sequential_out);
+        std::cout << "Error bound " << max_seam_error << ": "
+                  << stats.num_segments << " segments, "
+                  << stats.num_rerendered_segments << " re-rendered, "
+                  << "max. seam error: " << stats.max_seam_error << ", "
+                  << "max. error vs. sequential render: " << max_error << std::endl;
+
+        // with no error bound every seam gets re-rendered, so the render is fully sequential
+        const auto error_bound = max_seam_error > 0.0f ? 1.0e-5f : 0.0f;
+        if (max_error > error_bound)
+        {
+            std::cout << "  Parallel render doesn't match the sequential render!" << std::endl;
+            success = false;
+        }
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <new>
+#include <numbers>
+#include <random>
+#include <thread>
+
+#include "neural_pruning_plugin.h"
+#include "rt_check.h"
+
+/**
+ * Real-time safety checker for the plugin's audio path.
+ *
+ * Runs the plugin through a range of sample rates and (varying) block sizes, while the
+ * parameters get swept underneath it, so that models get pruned and swapped in, and the
+ * architectures, weight formats, and oversampling modes all change while processing.
+ * Every call to processBlock() runs inside a Scoped_Audio_Callback, so any allocation,
+ * lock, or blocking system call aborts with a stack trace (see rt_check.h).
+ *
+ * The audio runs on its own thread, in real-time, while the main thread runs the message
+ * loop, so that the parameter listeners and background threads behave like they would in a host.
+ */
+
+// operator new/delete would be caught by the malloc/free checks anyway, but this makes the reports clearer
+void* operator new (std::size_t size)
+{
+    rt_check_function_call ("operator new");
+    if (auto* ptr = std::malloc (std::max (size, (std::size_t) 1)))
+        return ptr;
+    throw std::bad_alloc {};
+}
+
+void* operator new (std::size_t size, std::align_val_t alignment)
+{
+    rt_check_function_call ("operator new");
+    void* ptr {};
+    if (posix_memalign (&ptr, std::max ((std::size_t) alignment, sizeof (void*)), std::max (size, (std::size_t) 1)) == 0)
+        return ptr;
+    throw std::bad_alloc {};
+}
+
+void operator delete (void* ptr) noexcept
+{
+    if (ptr != nullptr)
+        rt_check_function_call ("operator delete");
+    std::free (ptr);
+}
+
+void operator delete (void* ptr, std::align_val_t) noexcept
+{
+    if (ptr != nullptr)
+        rt_check_function_call ("operator delete");
+    std::free (ptr);
+}
+
+struct Run_Config
+{
+    double sample_rate {};
+    int max_block_size {};
+    bool enable_profiler {}; // (the profiler is usually only enabled while the editor is open)
+};
+
+static constexpr std::array run_configs {
+    Run_Config { 44100.0, 512, false },
+    Run_Config { 48000.0, 64, true },
+    Run_Config { 48000.0, 2048, false },
+    Run_Config { 88200.0, 256, true },
+    Run_Config { 96000.0, 1024, false },
+};
+
+static constexpr double seconds_per_config = 4.0;
+static constexpr double hidden_size_sweep_period = 1.7; // seconds
+static constexpr double parameter_change_interval = 0.15; // seconds
+
+static void run_audio_thread (Neural_Pruning_Plugin& plugin)
+{
+    std::minstd_rand rng { 0x5eed };
+    const auto& parameters = plugin.getParameters();
+    std::uniform_real_distribution<float> parameter_value { 0.0f, 1.0f };
+    std::uniform_int_distribution<int> parameter_index { 0, parameters.size() - 1 };
+
+    const auto num_channels = std::max (plugin.getTotalNumInputChannels(), plugin.getTotalNumOutputChannels());
+    juce::MidiBuffer midi {};
+
+    for (const auto& config : run_configs)
+    {
+        std::cout << "Running at " << config.sample_rate << " Hz, with blocks of up to " << config.max_block_size
+                  << " samples" << (config.enable_profiler ? " (profiler enabled)" : "") << std::endl;
+
+        plugin.profiler.enabled = config.enable_profiler;
+        plugin.setRateAndBufferSizeDetails (config.sample_rate, config.max_block_size);
+        plugin.prepareToPlay (config.sample_rate, config.max_block_size);
+
+        juce::AudioBuffer<float> buffer { num_channels, config.max_block_size };
+        std::uniform_int_distribution<int> block_size_dist { 1, config.max_block_size };
+
+        const auto total_samples = (int64_t) (seconds_per_config * config.sample_rate);
+        auto next_parameter_change = (int64_t) 0;
+        for (int64_t sample_count = 0; sample_count < total_samples;)
+        {
+            const auto time = (double) sample_count / config.sample_rate;
+
+            // the hidden size keeps moving, and every so often some other parameter jumps to a random value
+            plugin.getState().params.hidden_size->setValueNotifyingHost (0.5f + 0.5f * (float) std::sin (2.0 * std::numbers::pi * time / hidden_size_sweep_period));
+            if (sample_count >= next_parameter_change)
+            {
+                auto* parameter = parameters[parameter_index (rng)];
+                parameter->setValueNotifyingHost (parameter_value (rng));
+                next_parameter_change += (int64_t) (parameter_change_interval * config.sample_rate);
+            }
+
+            // use the same buffer for each block (shrinking it doesn't re-allocate)
+            const auto block_size = block_size_dist (rng);
+            buffer.setSize (num_channels, block_size, false, false, true);
+            for (int ch = 0; ch < num_channels; ++ch)
+                for (int n = 0; n < block_size; ++n)
+                    buffer.setSample (ch, n, 0.5f * (float) std::sin (2.0 * std::numbers::pi * 220.0 * (double) (sample_count + n) / config.sample_rate));
+
+            {
+                Scoped_Audio_Callback audio_callback {};
+                plugin.processBlock (buffer, midi);
+            }
+
+            // run in real-time, so that the background threads can keep up
+            sample_count += block_size;
+            std::this_thread::sleep_for (std::chrono::duration<double> ((double) block_size / config.sample_rate));
+        }
+
+        plugin.releaseResources();
+    }
+}
+
+int main()
+{
+    juce::ScopedJuceInitialiser_GUI juce_initialiser {};
+    auto plugin = std::make_unique<Neural_Pruning_Plugin>();
+
+    std::thread audio_thread {
+        [&plugin]
+        {
+            run_audio_thread (*plugin);
+            juce::MessageManager::getInstance()->stopDispatchLoop();
+        }
+    };
+    juce::MessageManager::getInstance()->runDispatchLoop();
+    audio_thread.join();
+
+    plugin.reset();
+    std::cout << "No real-time safety violations found!" << std::endl;
+    return 0;
+}
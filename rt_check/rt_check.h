@@ -0,0 +1,30 @@
+#pragma once
+
+/**
+ * Real-time safety checks for the audio thread.
+ *
+ * The rt_check_interposer library interposes the allocation functions (malloc,
+ * free, etc.), the blocking pthread calls (mutex and rwlock locks, condition
+ * variable waits), and a few blocking system calls (sched_yield, sleeps, read
+ * and write). While a thread is inside an audio callback, any call to them
+ * prints the function name and a stack trace, and then aborts.
+ *
+ * Only the calling thread is checked, so the other threads can carry on as normal.
+ */
+extern "C"
+{
+    void rt_check_enter_audio_callback() noexcept;
+    void rt_check_exit_audio_callback() noexcept;
+
+    /** Reports a violation (and aborts) if the calling thread is inside an audio callback. */
+    void rt_check_function_call (const char* function_name) noexcept;
+}
+
+struct Scoped_Audio_Callback
+{
+    Scoped_Audio_Callback() noexcept { rt_check_enter_audio_callback(); }
+    ~Scoped_Audio_Callback() { rt_check_exit_audio_callback(); }
+
+    Scoped_Audio_Callback (const Scoped_Audio_Callback&) = delete;
+    Scoped_Audio_Callback& operator= (const Scoped_Audio_Callback&) = delete;
+};
@@ -0,0 +1,277 @@
+// the fortified versions of read() etc. are inline wrappers, which would clash with our definitions
+#undef _FORTIFY_SOURCE
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rt_check.h"
+
+/**
+ * Interposes the functions that aren't allowed on the audio thread (see rt_check.h).
+ *
+ * On Linux, this library defines the functions itself, so they take precedence over
+ * libc's, and forwards to the next definition (i.e. libc's). On macOS, the wrappers are
+ * registered with dyld's interposing table instead, and calls from inside this library
+ * still go to the original functions.
+ */
+
+// the thread's audio callback depth (we use a pthread key, since thread_local variables may allocate on first use)
+static pthread_key_t audio_callback_key {};
+static bool is_key_ready = false;
+
+static intptr_t get_audio_callback_depth() noexcept
+{
+    return is_key_ready ? reinterpret_cast<intptr_t> (pthread_getspecific (audio_callback_key)) : 0;
+}
+
+static void set_audio_callback_depth (intptr_t depth) noexcept
+{
+    pthread_setspecific (audio_callback_key, reinterpret_cast<void*> (depth));
+}
+
+static void write_message (const char* message) noexcept
+{
+    [[maybe_unused]] const auto result = write (STDERR_FILENO, message, std::strlen (message));
+}
+
+extern "C"
+{
+    void rt_check_enter_audio_callback() noexcept
+    {
+        set_audio_callback_depth (get_audio_callback_depth() + 1);
+    }
+
+    void rt_check_exit_audio_callback() noexcept
+    {
+        set_audio_callback_depth (get_audio_callback_depth() - 1);
+    }
+
+    void rt_check_function_call (const char* function_name) noexcept
+    {
+        if (get_audio_callback_depth() == 0)
+            return;
+
+        // stop checking, so that we can write out the report
+        set_audio_callback_depth (0);
+
+        write_message ("\nReal-time safety violation: ");
+        write_message (function_name);
+        write_message (" was called from the audio callback\n");
+
+        void* frames[128];
+        const auto num_frames = backtrace (frames, 128);
+        backtrace_symbols_fd (frames, num_frames, STDERR_FILENO);
+
+        std::abort();
+    }
+}
+
+#if defined(__APPLE__)
+#define RT_CHECK_WRAPPER(function) rt_check_##function
+#define RT_CHECK_NEXT(function) function
+#define RT_CHECK_NEXT_ALLOC(function) function
+#define RT_CHECK_NOEXCEPT
+#else
+#define RT_CHECK_WRAPPER(function) function
+#define RT_CHECK_NEXT(function) get_next_function (next_##function, #function)
+#define RT_CHECK_NEXT_ALLOC(function) __libc_##function
+#define RT_CHECK_NOEXCEPT noexcept // (to match glibc's declarations)
+
+// glibc's own allocation functions (we can't look up malloc with dlsym(), since dlsym() may call malloc)
+extern "C"
+{
+    void* __libc_malloc (size_t);
+    void* __libc_calloc (size_t, size_t);
+    void* __libc_realloc (void*, size_t);
+    void __libc_free (void*);
+}
+
+template <typename Fn>
+static Fn get_next_function (Fn& next_function, const char* name) noexcept
+{
+    if (next_function == nullptr)
+        next_function = reinterpret_cast<Fn> (dlsym (RTLD_NEXT, name));
+    return next_function;
+}
+
+static decltype (&posix_memalign) next_posix_memalign {};
+static decltype (&aligned_alloc) next_aligned_alloc {};
+static decltype (&pthread_mutex_lock) next_pthread_mutex_lock {};
+static decltype (&pthread_rwlock_rdlock) next_pthread_rwlock_rdlock {};
+static decltype (&pthread_rwlock_wrlock) next_pthread_rwlock_wrlock {};
+static decltype (&pthread_cond_wait) next_pthread_cond_wait {};
+static decltype (&pthread_cond_timedwait) next_pthread_cond_timedwait {};
+static decltype (&sched_yield) next_sched_yield {};
+static decltype (&nanosleep) next_nanosleep {};
+static decltype (&usleep) next_usleep {};
+static decltype (&read) next_read {};
+static decltype (&write) next_write {};
+#endif
+
+extern "C"
+{
+    // allocation
+    void* RT_CHECK_WRAPPER (malloc) (size_t size) RT_CHECK_NOEXCEPT
+    {
+        rt_check_function_call ("malloc");
+        return RT_CHECK_NEXT_ALLOC (malloc) (size);
+    }
+
+    void* RT_CHECK_WRAPPER (calloc) (size_t num, size_t size) RT_CHECK_NOEXCEPT
+    {
+        rt_check_function_call ("calloc");
+        return RT_CHECK_NEXT_ALLOC (calloc) (num, size);
+    }
+
+    void* RT_CHECK_WRAPPER (realloc) (void* ptr, size_t size) RT_CHECK_NOEXCEPT
+    {
+        rt_check_function_call ("realloc");
+        return RT_CHECK_NEXT_ALLOC (realloc) (ptr, size);
+    }
+
+    void RT_CHECK_WRAPPER (free) (void* ptr) RT_CHECK_NOEXCEPT
+    {
+        if (ptr != nullptr)
+            rt_check_function_call ("free");
+        RT_CHECK_NEXT_ALLOC (free) (ptr);
+    }
+
+    int RT_CHECK_WRAPPER (posix_memalign) (void** ptr, size_t alignment, size_t size) RT_CHECK_NOEXCEPT
+    {
+        rt_check_function_call ("posix_memalign");
+        return RT_CHECK_NEXT (posix_memalign) (ptr, alignment, size);
+    }
+
+    void* RT_CHECK_WRAPPER (aligned_alloc) (size_t alignment, size_t size) RT_CHECK_NOEXCEPT
+    {
+        rt_check_function_call ("aligned_alloc");
+        return RT_CHECK_NEXT (aligned_alloc) (alignment, size);
+    }
+
+    // locking
+    int RT_CHECK_WRAPPER (pthread_mutex_lock) (pthread_mutex_t* mutex) RT_CHECK_NOEXCEPT
+    {
+        rt_check_function_call ("pthread_mutex_lock");
+        return RT_CHECK_NEXT (pthread_mutex_lock) (mutex);
+    }
+
+    int RT_CHECK_WRAPPER (pthread_rwlock_rdlock) (pthread_rwlock_t* lock) RT_CHECK_NOEXCEPT
+    {
+        rt_check_function_call ("pthread_rwlock_rdlock");
+        return RT_CHECK_NEXT (pthread_rwlock_rdlock) (lock);
+    }
+
+    int RT_CHECK_WRAPPER (pthread_rwlock_wrlock) (pthread_rwlock_t* lock) RT_CHECK_NOEXCEPT
+    {
+        rt_check_function_call ("pthread_rwlock_wrlock");
+        return RT_CHECK_NEXT (pthread_rwlock_wrlock) (lock);
+    }
+
+    int RT_CHECK_WRAPPER (pthread_cond_wait) (pthread_cond_t* condition, pthread_mutex_t* mutex)
+    {
+        rt_check_function_call ("pthread_cond_wait");
+        return RT_CHECK_NEXT (pthread_cond_wait) (condition, mutex);
+    }
+
+    int RT_CHECK_WRAPPER (pthread_cond_timedwait) (pthread_cond_t* condition, pthread_mutex_t* mutex, const timespec* abstime)
+    {
+        rt_check_function_call ("pthread_cond_timedwait");
+        return RT_CHECK_NEXT (pthread_cond_timedwait) (condition, mutex, abstime);
+    }
+
+    // blocking system calls (e.g. a spin-lock backing off, or logging straight to a file)
+    int RT_CHECK_WRAPPER (sched_yield)() RT_CHECK_NOEXCEPT
+    {
+        rt_check_function_call ("sched_yield");
+        return RT_CHECK_NEXT (sched_yield)();
+    }
+
+    int RT_CHECK_WRAPPER (nanosleep) (const timespec* duration, timespec* remaining)
+    {
+        rt_check_function_call ("nanosleep");
+        return RT_CHECK_NEXT (nanosleep) (duration, remaining);
+    }
+
+    int RT_CHECK_WRAPPER (usleep) (useconds_t microseconds)
+    {
+        rt_check_function_call ("usleep");
+        return RT_CHECK_NEXT (usleep) (microseconds);
+    }
+
+    ssize_t RT_CHECK_WRAPPER (read) (int fd, void* buffer, size_t num_bytes)
+    {
+        rt_check_function_call ("read");
+        return RT_CHECK_NEXT (read) (fd, buffer, num_bytes);
+    }
+
+    ssize_t RT_CHECK_WRAPPER (write) (int fd, const void* buffer, size_t num_bytes)
+    {
+        rt_check_function_call ("write");
+        return RT_CHECK_NEXT (write) (fd, buffer, num_bytes);
+    }
+}
+
+#if defined(__APPLE__)
+struct Interpose
+{
+    const void* replacement;
+    const void* original;
+};
+
+#define RT_CHECK_INTERPOSE(function)                                                          \
+    __attribute__ ((used)) static const Interpose interpose_##function                        \
+        __attribute__ ((section ("__DATA,__interpose"))) = {                                  \
+            reinterpret_cast<const void*> (&rt_check_##function),                             \
+            reinterpret_cast<const void*> (&function),                                        \
+        };
+
+RT_CHECK_INTERPOSE (malloc)
+RT_CHECK_INTERPOSE (calloc)
+RT_CHECK_INTERPOSE (realloc)
+RT_CHECK_INTERPOSE (free)
+RT_CHECK_INTERPOSE (posix_memalign)
+RT_CHECK_INTERPOSE (aligned_alloc)
+RT_CHECK_INTERPOSE (pthread_mutex_lock)
+RT_CHECK_INTERPOSE (pthread_rwlock_rdlock)
+RT_CHECK_INTERPOSE (pthread_rwlock_wrlock)
+RT_CHECK_INTERPOSE (pthread_cond_wait)
+RT_CHECK_INTERPOSE (pthread_cond_timedwait)
+RT_CHECK_INTERPOSE (sched_yield)
+RT_CHECK_INTERPOSE (nanosleep)
+RT_CHECK_INTERPOSE (usleep)
+RT_CHECK_INTERPOSE (read)
+RT_CHECK_INTERPOSE (write)
+#endif
+
+__attribute__ ((constructor)) static void init_rt_check()
+{
+    pthread_key_create (&audio_callback_key, nullptr);
+    is_key_ready = true;
+
+#if ! defined(__APPLE__)
+    // look everything up front, since dlsym() might allocate or lock
+    (void) RT_CHECK_NEXT (posix_memalign);
+    (void) RT_CHECK_NEXT (aligned_alloc);
+    (void) RT_CHECK_NEXT (pthread_mutex_lock);
+    (void) RT_CHECK_NEXT (pthread_rwlock_rdlock);
+    (void) RT_CHECK_NEXT (pthread_rwlock_wrlock);
+    (void) RT_CHECK_NEXT (pthread_cond_wait);
+    (void) RT_CHECK_NEXT (pthread_cond_timedwait);
+    (void) RT_CHECK_NEXT (sched_yield);
+    (void) RT_CHECK_NEXT (nanosleep);
+    (void) RT_CHECK_NEXT (usleep);
+    (void) RT_CHECK_NEXT (read);
+    (void) RT_CHECK_NEXT (write);
+#endif
+
+    // the first call to backtrace() loads the unwinder, which allocates
+    void* frames[1];
+    backtrace (frames, 1);
+}